@@ -0,0 +1,98 @@
+/*
+	Throughput of member content copy: old block-by-block loop against CopyEngine.
+
+	g++ -O2 -std=c++17 -I../src CopyBenchmark.cpp ../src/Copy/CopyEngine.cpp -o CopyBenchmark
+	./CopyBenchmark [size in MiB] [chunk size in KiB]
+*/
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <unistd.h>
+
+#include "Copy/CopyEngine.h"
+
+static const char * sourceName = "copy_bench_source.bin";
+static const char * targetName = "copy_bench_target.tar";
+
+/* the loop TarPacker used before CopyEngine */
+static void
+blockCopy(std::ifstream & input, std::ofstream & output, int64_t size)
+{
+	ContentData buffer;
+	std::memset(&buffer, '\0', BLOCK_SIZE);
+
+	while (input.tellg() != size)
+	{
+		if (size - input.tellg() >= BLOCK_SIZE)
+		{
+			input.read((char*)&buffer, BLOCK_SIZE);
+		}
+		else
+		{
+			input.read((char*)&buffer, size - input.tellg());
+		}
+
+		output.write((char*)&buffer, BLOCK_SIZE);
+	}
+}
+
+static void
+makeSource(uint64_t size)
+{
+	std::ofstream source(sourceName, std::ios::binary);
+	std::vector<char> data(1024 * 1024);
+	for (size_t i = 0; i < data.size(); ++i)
+	{
+		data[i] = (char)(i * 131 + 7);
+	}
+
+	for (uint64_t left = size; left > 0; )
+	{
+		size_t n = left < data.size() ? left : data.size();
+		source.write(data.data(), n);
+		left -= n;
+	}
+}
+
+template <typename Copy>
+static double
+measure(const char * label, uint64_t size, Copy copy)
+{
+	std::ifstream input(sourceName, std::ios::binary);
+	std::ofstream output(targetName, std::ios::binary);
+
+	auto start = std::chrono::steady_clock::now();
+	copy(input, output);
+	output.flush();
+	auto end = std::chrono::steady_clock::now();
+
+	double seconds = std::chrono::duration<double>(end - start).count();
+	double mbps = size / (1024.0 * 1024.0) / seconds;
+	printf("%-12s %10.3f s %10.1f MiB/s\n", label, seconds, mbps);
+	return mbps;
+}
+
+int main(int argc, char ** argv)
+{
+	uint64_t sizeMiB = argc > 1 ? std::stoull(argv[1]) : 512;
+	size_t chunkKiB = argc > 2 ? std::stoul(argv[2]) : COPY_CHUNK_SIZE / 1024;
+
+	/* odd size so that the tail padding path is measured too */
+	uint64_t size = sizeMiB * 1024 * 1024 + 123;
+	makeSource(size);
+
+	double before = measure("block", size, [&](std::ifstream & in, std::ofstream & out) {
+		blockCopy(in, out, size);
+	});
+
+	CopyEngine engine(chunkKiB * 1024);
+	double after = measure("chunked", size, [&](std::ifstream & in, std::ofstream & out) {
+		engine.copyPadded(in, out, size);
+	});
+
+	printf("chunk %zu KiB, speedup x%.2f\n", engine.getChunkSize() / 1024, after / before);
+
+	unlink(sourceName);
+	unlink(targetName);
+	return 0;
+}
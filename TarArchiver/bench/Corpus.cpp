@@ -0,0 +1,362 @@
+#include <fcntl.h>
+#include <ftw.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <set>
+#include <vector>
+
+#include "Corpus.h"
+
+#define CORPUS_MTIME 1600000000			/* every entry, so archives don't change with the day */
+#define CORPUS_CHUNK (1 << 20)
+
+static const char * kindNames[CORPUS_KIND_COUNT] = { "tiny", "huge", "deep", "sparse", "symlinks" };
+
+/* splitmix64: small, fast and the same everywhere */
+class Random
+{
+private:
+	uint64_t state;
+
+public:
+	explicit Random(uint64_t seed) : state(seed) {}
+
+	uint64_t next()
+	{
+		uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		return z ^ (z >> 31);
+	}
+
+	uint64_t below(uint64_t limit) { return limit ? next() % limit : 0; }
+};
+
+/* letters and spaces, about 4.7 bits a byte */
+static void
+fillText(Random & random, char * data, size_t size)
+{
+	for (size_t i = 0; i < size; i += 8)
+	{
+		uint64_t bits = random.next();
+		for (size_t j = 0; j < 8 && i + j < size; ++j, bits >>= 8)
+		{
+			uint8_t letter = bits & 31;
+			data[i + j] = letter < 26 ? 'a' + letter : ' ';
+		}
+	}
+}
+
+static bool
+writeFile(const std::string & path, uint64_t size, Random & random, std::vector<char> & buffer)
+{
+	int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+	if (fd == -1)
+	{
+		return false;
+	}
+
+	bool written = true;
+	while (written && size)
+	{
+		size_t piece = std::min<uint64_t>(size, buffer.size());
+		fillText(random, buffer.data(), piece);
+		written = write(fd, buffer.data(), piece) == (ssize_t)piece;
+		size -= piece;
+	}
+	return close(fd) == 0 && written;
+}
+
+/* extents at random places of equal slots, the tail of the file is a hole */
+static bool
+writeSparseFile(const std::string & path, uint64_t size, size_t extentCount, uint64_t extentSize,
+	Random & random, std::vector<char> & buffer)
+{
+	int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+	if (fd == -1)
+	{
+		return false;
+	}
+
+	bool written = ftruncate(fd, size) == 0;
+	uint64_t slot = size / extentCount;
+	for (size_t i = 0; written && i < extentCount; ++i)
+	{
+		uint64_t offset = i * slot + (random.below(slot - extentSize) & ~(uint64_t)4095);
+		for (uint64_t done = 0; written && done < extentSize; )
+		{
+			size_t piece = std::min<uint64_t>(extentSize - done, buffer.size());
+			fillText(random, buffer.data(), piece);
+			written = pwrite(fd, buffer.data(), piece, offset + done) == (ssize_t)piece;
+			done += piece;
+		}
+	}
+	return close(fd) == 0 && written;
+}
+
+static std::string
+randomWord(Random & random, size_t length)
+{
+	std::string word(length, 'a');
+	for (char & letter : word)
+	{
+		letter = 'a' + random.below(26);
+	}
+	return word;
+}
+
+static size_t
+scaled(size_t count, double scale)
+{
+	return std::max<size_t>(1, (size_t)(count * scale));
+}
+
+static bool
+generateTiny(const std::string & path, double scale, Random & random, std::vector<char> & buffer)
+{
+	size_t count = scaled(20000, scale);
+	std::string dir;
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (i % 200 == 0)
+		{
+			dir = path + "/d" + std::to_string(i / 200);
+			if (mkdir(dir.c_str(), 0755))
+			{
+				return false;
+			}
+		}
+
+		/* most are small, like sources and configs */
+		uint64_t size = random.below(4097) * random.below(4097) / 4096;
+		if (!writeFile(dir + "/f" + std::to_string(i) + ".txt", size, random, buffer))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool
+generateHuge(const std::string & path, double scale, Random & random, std::vector<char> & buffer)
+{
+	uint64_t size = std::max<uint64_t>(1, (uint64_t)((128ULL << 20) * scale));
+	for (size_t i = 0; i < 4; ++i)
+	{
+		/* tails don't end on a block */
+		if (!writeFile(path + "/huge" + std::to_string(i) + ".bin", size + random.below(512), random, buffer))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool
+generateDeep(const std::string & path, double scale, Random & random, std::vector<char> & buffer)
+{
+	size_t chains = scaled(16, scale);
+	for (size_t chain = 0; chain < chains; ++chain)
+	{
+		std::string dir = path + "/chain" + std::to_string(chain);
+		for (size_t level = 0; level < 48; ++level)
+		{
+			if (level)
+			{
+				dir += "/level" + std::to_string(level) + "_" + randomWord(random, 8);
+			}
+			if (mkdir(dir.c_str(), 0755))
+			{
+				return false;
+			}
+
+			for (size_t i = 0; i < 4; ++i)
+			{
+				if (!writeFile(dir + "/file" + std::to_string(i), random.below(16384), random, buffer))
+				{
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+static bool
+generateSparse(const std::string & path, double scale, Random & random, std::vector<char> & buffer)
+{
+	size_t count = scaled(16, scale);
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (!writeSparseFile(path + "/sparse" + std::to_string(i) + ".img", 64 << 20, 8, 256 << 10, random, buffer))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool
+generateSymlinks(const std::string & path, double scale, Random & random, std::vector<char> & buffer)
+{
+	size_t targets = scaled(1000, scale);
+	size_t links = scaled(10000, scale);
+	size_t dirLinks = scaled(500, scale);
+	size_t hardLinks = scaled(1000, scale);
+
+	const std::string targetDir = path + "/targets";
+	const std::string linkDir = path + "/links";
+	const std::string hardDir = path + "/hard";
+	if (mkdir(targetDir.c_str(), 0755) || mkdir(linkDir.c_str(), 0755) || mkdir(hardDir.c_str(), 0755))
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i < targets; ++i)
+	{
+		if (!writeFile(targetDir + "/t" + std::to_string(i), 1024, random, buffer))
+		{
+			return false;
+		}
+	}
+
+	std::string dir;
+	for (size_t i = 0; i < links; ++i)
+	{
+		if (i % 1000 == 0)
+		{
+			dir = linkDir + "/l" + std::to_string(i / 1000);
+			if (mkdir(dir.c_str(), 0755))
+			{
+				return false;
+			}
+		}
+		std::string target = "../../targets/t" + std::to_string(random.below(targets));
+		if (symlink(target.c_str(), (dir + "/s" + std::to_string(i)).c_str()))
+		{
+			return false;
+		}
+	}
+
+	for (size_t i = 0; i < dirLinks; ++i)
+	{
+		if (symlink("../targets", (linkDir + "/dir" + std::to_string(i)).c_str()))
+		{
+			return false;
+		}
+	}
+
+	for (size_t i = 0; i < hardLinks; ++i)
+	{
+		std::string target = targetDir + "/t" + std::to_string(random.below(targets));
+		if (link(target.c_str(), (hardDir + "/h" + std::to_string(i)).c_str()))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+const char *
+Corpus::name(CorpusKind kind)
+{
+	return kindNames[(size_t)kind];
+}
+
+bool
+Corpus::parseKind(std::string_view name, CorpusKind & kind)
+{
+	for (size_t i = 0; i < CORPUS_KIND_COUNT; ++i)
+	{
+		if (name == kindNames[i])
+		{
+			kind = (CorpusKind)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+static int
+fixTime(const char * path, const struct stat *, int, struct FTW *)
+{
+	struct timespec times[2];
+	times[0].tv_sec = CORPUS_MTIME;
+	times[0].tv_nsec = 0;
+	times[1] = times[0];
+	return utimensat(AT_FDCWD, path, times, AT_SYMLINK_NOFOLLOW);
+}
+
+bool
+Corpus::generate(CorpusKind kind, const std::string & path, double scale, uint64_t seed,
+	CorpusStats & stats)
+{
+	if (mkdir(path.c_str(), 0755))
+	{
+		return false;
+	}
+
+	/* each kind has its own stream, one corpus doesn't shift another */
+	Random random(seed * CORPUS_KIND_COUNT + (uint64_t)kind);
+	std::vector<char> buffer(CORPUS_CHUNK);
+
+	bool generated = false;
+	switch (kind)
+	{
+	case CorpusKind::TINY:
+		generated = generateTiny(path, scale, random, buffer);
+		break;
+
+	case CorpusKind::HUGE:
+		generated = generateHuge(path, scale, random, buffer);
+		break;
+
+	case CorpusKind::DEEP:
+		generated = generateDeep(path, scale, random, buffer);
+		break;
+
+	case CorpusKind::SPARSE:
+		generated = generateSparse(path, scale, random, buffer);
+		break;
+
+	case CorpusKind::SYMLINKS:
+		generated = generateSymlinks(path, scale, random, buffer);
+		break;
+	}
+
+	/* children before their directory, writing in it would change its mtime again */
+	return generated && nftw(path.c_str(), fixTime, 64, FTW_PHYS | FTW_DEPTH) == 0 &&
+		measure(path, stats);
+}
+
+/* nftw passes no context */
+static CorpusStats * counted;
+static std::set<std::pair<dev_t, ino_t>> * linkedFiles;
+
+static int
+countEntry(const char *, const struct stat * s, int type, struct FTW *)
+{
+	if (type == FTW_NS || type == FTW_DNR)
+	{
+		return -1;
+	}
+
+	counted->entries++;
+	if (S_ISREG(s->st_mode) && (s->st_nlink == 1 || linkedFiles->insert({ s->st_dev, s->st_ino }).second))
+	{
+		counted->files++;
+		counted->bytes += s->st_size;
+	}
+	return 0;
+}
+
+bool
+Corpus::measure(const std::string & path, CorpusStats & stats)
+{
+	std::set<std::pair<dev_t, ino_t>> linked;
+	stats = CorpusStats();
+	counted = &stats;
+	linkedFiles = &linked;
+	return nftw(path.c_str(), countEntry, 64, FTW_PHYS) == 0;
+}
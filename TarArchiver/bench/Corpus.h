@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/*
+	Synthetic trees for the benchmarks. Same kind, scale and seed give the same
+	names, contents, holes and mtimes, so archives of two commits can be compared
+	byte for byte. Content is lowercase words, compressible like text.
+
+	tiny      many files of at most 4 KiB in directories of 200
+	huge      few files of 128 MiB
+	deep      chains of 48 directories, paths run past 255 characters
+	sparse    files of 64 MiB apparent size with 2 MiB of data in 8 extents
+	symlinks  few targets, many file and directory symlinks and hard links
+*/
+enum class CorpusKind
+{
+	TINY,
+	HUGE,
+	DEEP,
+	SPARSE,
+	SYMLINKS,
+};
+
+#define CORPUS_KIND_COUNT 5
+
+struct CorpusStats
+{
+	uint64_t entries = 0;	/* every name in the tree, root included */
+	uint64_t files = 0;		/* regular files, a hard link is counted once */
+	uint64_t bytes = 0;		/* apparent size of those files */
+};
+
+class Corpus
+{
+public:
+	static const char * name(CorpusKind kind);
+
+	static bool parseKind(std::string_view name, CorpusKind & kind);
+
+	/* tree at path, which must not exist yet; scale multiplies counts and sizes */
+	static bool generate(CorpusKind kind, const std::string & path, double scale, uint64_t seed,
+		CorpusStats & stats);
+
+	/* entries, files and bytes of any tree, as generate counts them */
+	static bool measure(const std::string & path, CorpusStats & stats);
+};
@@ -0,0 +1,53 @@
+/*
+	Writes the corpora of EndToEndBenchmark, to run other tools on the same trees.
+
+	cmake --build build --target CorpusGenerator
+	./CorpusGenerator <tiny|huge|deep|sparse|symlinks|all> <directory> [scale] [seed]
+*/
+#include <cstdio>
+#include <string>
+#include <sys/stat.h>
+
+#include "Corpus.h"
+
+int main(int argc, char ** argv)
+{
+	if (argc < 3)
+	{
+		printf("usage: %s <tiny|huge|deep|sparse|symlinks|all> <directory> [scale] [seed]\n", argv[0]);
+		return 2;
+	}
+
+	std::string kindName = argv[1];
+	std::string directory = argv[2];
+	double scale = argc > 3 ? std::stod(argv[3]) : 1.0;
+	uint64_t seed = argc > 4 ? std::stoull(argv[4]) : 1;
+
+	CorpusKind only = CorpusKind::TINY;
+	if (kindName != "all" && !Corpus::parseKind(kindName, only))
+	{
+		printf("Unknown corpus %s.\n", kindName.c_str());
+		return 2;
+	}
+
+	mkdir(directory.c_str(), 0755);
+	for (size_t i = 0; i < CORPUS_KIND_COUNT; ++i)
+	{
+		CorpusKind kind = (CorpusKind)i;
+		if (kindName != "all" && kind != only)
+		{
+			continue;
+		}
+
+		CorpusStats stats;
+		std::string path = directory + "/" + Corpus::name(kind);
+		if (!Corpus::generate(kind, path, scale, seed, stats))
+		{
+			printf("Can't generate %s, it must not exist yet.\n", path.c_str());
+			return 1;
+		}
+		printf("%-9s %8llu entries %8llu files %12llu bytes\n", Corpus::name(kind),
+			(unsigned long long)stats.entries, (unsigned long long)stats.files, (unsigned long long)stats.bytes);
+	}
+	return 0;
+}
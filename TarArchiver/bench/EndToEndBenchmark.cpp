@@ -0,0 +1,503 @@
+/*
+	Pack, list and extract of the synthetic corpora, see Corpus.h.
+	Each phase runs in its own child process: wall time, throughput in MB/s and files/s,
+	peak RSS, cpu times, faults and context switches are its own. Syscalls are counted
+	with ptrace in an untimed first pass, which also warms the page cache; timed runs
+	are not traced. Results are JSON lines, one per corpus, phase and run, to follow
+	a commit against the next; a table goes to stderr.
+
+	cmake --build build --target bench          (all corpora, results in build/bench_results.jsonl)
+	./EndToEndBenchmark [--corpus <kind>]... [--scale <x>] [--seed <n>] [--runs <n>]
+		[--work <dir>] [--json <file>] [--label <text>] [--threads <n>] [--zero-copy]
+		[--uring] [--mmap] [--no-syscalls] [--clean]
+
+	Corpora are kept in <work>/corpus-<scale>-<seed> and reused, --clean removes them after the run.
+*/
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#include <signal.h>
+#include <sys/ptrace.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "Corpus.h"
+#include "Packer/TarPacker.h"
+#include "Unpacker/TarUnpacker.h"
+
+struct Options
+{
+	std::vector<CorpusKind> kinds;
+	double scale = 1.0;
+	uint64_t seed = 1;
+	size_t runs = 3;
+	std::string work = "bench_work";
+	std::string json;		/* stdout when empty */
+	std::string label;
+	size_t threads = 1;
+	bool zeroCopy = false;
+	bool uring = false;
+	bool mapped = false;
+	bool syscalls = true;
+	bool clean = false;
+};
+
+struct PhaseResult
+{
+	bool ok = false;
+	double seconds = 0;
+	struct rusage usage = {};
+};
+
+/* swallows the listing */
+class NullBuf : public std::streambuf
+{
+protected:
+	int_type overflow(int_type c) override { return traits_type::not_eof(c); }
+	std::streamsize xsputn(const char *, std::streamsize n) override { return n; }
+};
+
+typedef std::function<bool()> Phase;
+
+/* messages of the library would mix into JSON on stdout */
+static void
+silence()
+{
+	int null = open("/dev/null", O_WRONLY);
+	if (null != -1)
+	{
+		dup2(null, STDOUT_FILENO);
+		close(null);
+	}
+}
+
+static bool
+runTimed(const Phase & phase, PhaseResult & result)
+{
+	int fds[2];
+	if (pipe(fds))
+	{
+		return false;
+	}
+
+	fflush(nullptr);
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		close(fds[0]);
+		silence();
+		auto start = std::chrono::steady_clock::now();
+		bool ok = phase();
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		ssize_t sent = write(fds[1], &seconds, sizeof(seconds));
+		_exit(ok && sent == sizeof(seconds) ? 0 : 1);
+	}
+	close(fds[1]);
+	if (pid == -1)
+	{
+		close(fds[0]);
+		return false;
+	}
+
+	bool received = read(fds[0], &result.seconds, sizeof(result.seconds)) == sizeof(result.seconds);
+	close(fds[0]);
+
+	int status = 0;
+	wait4(pid, &status, 0, &result.usage);
+	result.ok = received && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+	return result.ok;
+}
+
+/* syscalls of the child and its threads, -1 if it can't be traced */
+static int64_t
+runTraced(const Phase & phase)
+{
+	fflush(nullptr);
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		silence();
+		if (ptrace(PTRACE_TRACEME, 0, nullptr, nullptr) == -1)
+		{
+			_exit(2);
+		}
+		raise(SIGSTOP);
+		_exit(phase() ? 0 : 1);
+	}
+	if (pid == -1)
+	{
+		return -1;
+	}
+
+	int status = 0;
+	if (waitpid(pid, &status, 0) != pid || !WIFSTOPPED(status) ||
+		ptrace(PTRACE_SETOPTIONS, pid, nullptr, PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE | PTRACE_O_EXITKILL) == -1)
+	{
+		kill(pid, SIGKILL);
+		waitpid(pid, &status, 0);
+		return -1;
+	}
+	ptrace(PTRACE_SYSCALL, pid, nullptr, nullptr);
+
+	/* every thread stops on entry and on exit of each syscall, entries are counted */
+	int64_t count = 0;
+	bool ok = false;
+	std::map<pid_t, bool> inside;
+	for (;;)
+	{
+		pid_t thread = waitpid(-1, &status, __WALL);
+		if (thread == -1)
+		{
+			break;
+		}
+		if (WIFEXITED(status) || WIFSIGNALED(status))
+		{
+			if (thread == pid)
+			{
+				ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+			}
+			inside.erase(thread);
+			continue;
+		}
+
+		int signal = 0;
+		int stop = WSTOPSIG(status);
+		if (stop == (SIGTRAP | 0x80))
+		{
+			bool & entered = inside[thread];
+			count += !entered;
+			entered = !entered;
+		}
+		else if (stop != SIGTRAP && stop != SIGSTOP)
+		{
+			/* events and the first stop of new threads are ours, other signals go on */
+			signal = stop;
+		}
+		ptrace(PTRACE_SYSCALL, thread, nullptr, signal);
+	}
+
+	return ok ? count : -1;
+}
+
+static std::string
+jsonText(const std::string & text)
+{
+	std::string quoted = "\"";
+	for (char c : text)
+	{
+		if (c == '"' || c == '\\')
+		{
+			quoted += '\\';
+		}
+		if ((unsigned char)c >= 0x20)
+		{
+			quoted += c;
+		}
+	}
+	return quoted + '"';
+}
+
+static double
+seconds(const struct timeval & time)
+{
+	return time.tv_sec + time.tv_usec / 1e6;
+}
+
+static void
+report(FILE * output, const Options & options, const char * corpus, const char * phase, size_t run,
+	const CorpusStats & stats, uint64_t archiveBytes, const PhaseResult & result, int64_t syscalls)
+{
+	double megabytes = stats.bytes / 1e6;
+	const struct rusage & usage = result.usage;
+
+	fprintf(output, "{\"label\":%s,\"time\":%lld,\"corpus\":\"%s\",\"phase\":\"%s\",\"run\":%zu,"
+		"\"ok\":%s,\"scale\":%g,\"seed\":%llu,\"threads\":%zu,\"zero_copy\":%s,\"uring\":%s,\"mmap\":%s,"
+		"\"entries\":%llu,\"files\":%llu,\"bytes\":%llu,\"archive_bytes\":%llu,"
+		"\"seconds\":%.6f,\"mb_per_s\":%.3f,\"files_per_s\":%.1f,"
+		"\"max_rss_kb\":%ld,\"user_s\":%.6f,\"system_s\":%.6f,\"minor_faults\":%ld,\"major_faults\":%ld,"
+		"\"voluntary_switches\":%ld,\"involuntary_switches\":%ld,\"syscalls\":",
+		jsonText(options.label).c_str(), (long long)time(nullptr), corpus, phase, run,
+		result.ok ? "true" : "false", options.scale, (unsigned long long)options.seed, options.threads,
+		options.zeroCopy ? "true" : "false", options.uring ? "true" : "false", options.mapped ? "true" : "false",
+		(unsigned long long)stats.entries, (unsigned long long)stats.files, (unsigned long long)stats.bytes,
+		(unsigned long long)archiveBytes, result.seconds, megabytes / result.seconds, stats.entries / result.seconds,
+		usage.ru_maxrss, seconds(usage.ru_utime), seconds(usage.ru_stime), usage.ru_minflt, usage.ru_majflt,
+		usage.ru_nvcsw, usage.ru_nivcsw);
+	if (syscalls < 0)
+	{
+		fprintf(output, "null}\n");
+	}
+	else
+	{
+		fprintf(output, "%lld}\n", (long long)syscalls);
+	}
+	fflush(output);
+
+	fprintf(stderr, "%-9s %-8s %2zu %9.3f s %10.1f MB/s %11.0f files/s %9ld KiB rss %11lld syscalls%s\n",
+		corpus, phase, run, result.seconds, megabytes / result.seconds, stats.entries / result.seconds,
+		usage.ru_maxrss, (long long)syscalls, result.ok ? "" : "  FAILED");
+}
+
+/* generated once per scale and seed, a corpus without its mark was cut short */
+static bool
+prepareCorpus(CorpusKind kind, const std::string & directory, const Options & options, CorpusStats & stats)
+{
+	std::string path = directory + "/" + Corpus::name(kind);
+	std::string mark = path + ".done";
+
+	struct stat s;
+	if (stat(mark.c_str(), &s) == 0)
+	{
+		return Corpus::measure(path, stats);
+	}
+
+	TarUnpacker::removePath(path);
+	fprintf(stderr, "generating %s\n", path.c_str());
+	if (!Corpus::generate(kind, path, options.scale, options.seed, stats))
+	{
+		return false;
+	}
+
+	int fd = open(mark.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+	return fd != -1 && close(fd) == 0;
+}
+
+static bool
+benchCorpus(CorpusKind kind, const std::string & corpusDir, const std::string & outputDir,
+	const Options & options, FILE * output)
+{
+	CorpusStats stats;
+	if (!prepareCorpus(kind, corpusDir, options, stats))
+	{
+		fprintf(stderr, "Can't generate corpus %s.\n", Corpus::name(kind));
+		return false;
+	}
+
+	const char * name = Corpus::name(kind);
+	const std::string source = corpusDir + "/" + name;
+	const std::string archive = outputDir + "/" + name + ".tar";
+	const std::string extracted = outputDir + "/" + name;
+
+	/* phases run in children, configured there; the archive goes into the current directory */
+	Phase pack = [&] {
+		TarPacker packer;
+		packer.setThreadCount(options.threads);
+		packer.setZeroCopy(options.zeroCopy);
+		packer.setUring(options.uring);
+		packer.setSparse(kind == CorpusKind::SPARSE);
+		if (chdir(outputDir.c_str()))
+		{
+			return false;
+		}
+		return packer.pack(source);
+	};
+
+	Phase list = [&] {
+		NullBuf nullBuf;
+		std::ostream null(&nullBuf);
+		TarUnpacker unpacker;
+		unpacker.setMapped(options.mapped);
+		return unpacker.list(archive, null);
+	};
+
+	Phase extract = [&] {
+		TarUnpacker unpacker;
+		unpacker.setThreadCount(options.threads);
+		unpacker.setZeroCopy(options.zeroCopy);
+		unpacker.setUring(options.uring);
+		unpacker.setMapped(options.mapped);
+		return unpacker.unpack(archive);
+	};
+
+	struct
+	{
+		const char * name;
+		Phase * phase;
+		int64_t syscalls;
+	} phases[] = { { "pack", &pack, -1 }, { "list", &list, -1 }, { "extract", &extract, -1 } };
+
+	bool passed = true;
+	for (size_t run = 0; run <= options.runs; ++run)
+	{
+		uint64_t archiveBytes = 0;
+		for (auto & phase : phases)
+		{
+			/* extraction goes into an empty directory every time */
+			if (phase.phase == &extract)
+			{
+				TarUnpacker::removePath(extracted);
+			}
+
+			PhaseResult result;
+			if (run == 0)
+			{
+				/* warm-up */
+				if (options.syscalls)
+				{
+					phase.syscalls = runTraced(*phase.phase);
+				}
+				else
+				{
+					runTimed(*phase.phase, result);
+				}
+				continue;
+			}
+			runTimed(*phase.phase, result);
+
+			/* an empty archive counts as a failed pack too */
+			struct stat s;
+			if (stat(archive.c_str(), &s) == 0)
+			{
+				archiveBytes = s.st_size;
+			}
+			if (phase.phase == &pack)
+			{
+				result.ok = result.ok && archiveBytes > 0;
+			}
+			if (phase.phase == &extract)
+			{
+				CorpusStats unpacked;
+				result.ok = result.ok && Corpus::measure(extracted, unpacked) &&
+					unpacked.entries == stats.entries && unpacked.bytes == stats.bytes;
+			}
+
+			report(output, options, name, phase.name, run, stats, archiveBytes, result, phase.syscalls);
+			passed = passed && result.ok;
+		}
+	}
+
+	TarUnpacker::removePath(extracted);
+	TarUnpacker::removePath(archive);
+	return passed;
+}
+
+static void
+usage(const char * program)
+{
+	fprintf(stderr, "usage: %s [--corpus tiny|huge|deep|sparse|symlinks]... [--scale <x>] [--seed <n>]\n"
+		"  [--runs <n>] [--work <dir>] [--json <file>] [--label <text>] [--threads <n>]\n"
+		"  [--zero-copy] [--uring] [--mmap] [--no-syscalls] [--clean]\n", program);
+}
+
+int main(int argc, char ** argv)
+{
+	Options options;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		CorpusKind kind;
+
+		if (arg == "--corpus" && hasValue && Corpus::parseKind(argv[i + 1], kind))
+		{
+			options.kinds.push_back(kind);
+			++i;
+		}
+		else if (arg == "--scale" && hasValue)
+		{
+			options.scale = std::stod(argv[++i]);
+		}
+		else if (arg == "--seed" && hasValue)
+		{
+			options.seed = std::stoull(argv[++i]);
+		}
+		else if (arg == "--runs" && hasValue)
+		{
+			options.runs = std::stoul(argv[++i]);
+		}
+		else if (arg == "--work" && hasValue)
+		{
+			options.work = argv[++i];
+		}
+		else if (arg == "--json" && hasValue)
+		{
+			options.json = argv[++i];
+		}
+		else if (arg == "--label" && hasValue)
+		{
+			options.label = argv[++i];
+		}
+		else if (arg == "--threads" && hasValue)
+		{
+			options.threads = std::stoul(argv[++i]);
+		}
+		else if (arg == "--zero-copy")
+		{
+			options.zeroCopy = true;
+		}
+		else if (arg == "--uring")
+		{
+			options.uring = true;
+		}
+		else if (arg == "--mmap")
+		{
+			options.mapped = true;
+		}
+		else if (arg == "--no-syscalls")
+		{
+			options.syscalls = false;
+		}
+		else if (arg == "--clean")
+		{
+			options.clean = true;
+		}
+		else
+		{
+			usage(argv[0]);
+			return 2;
+		}
+	}
+
+	if (options.kinds.empty())
+	{
+		for (size_t i = 0; i < CORPUS_KIND_COUNT; ++i)
+		{
+			options.kinds.push_back((CorpusKind)i);
+		}
+	}
+
+	/* paths stay valid after the pack phase changes directory */
+	mkdir(options.work.c_str(), 0755);
+	char * work = realpath(options.work.c_str(), nullptr);
+	if (!work)
+	{
+		fprintf(stderr, "Can't create %s.\n", options.work.c_str());
+		return 1;
+	}
+	char scale[32];
+	snprintf(scale, sizeof(scale), "%g", options.scale);
+	const std::string corpusDir = std::string(work) + "/corpus-" + scale + "-" + std::to_string(options.seed);
+	const std::string outputDir = std::string(work) + "/output";
+	free(work);
+	mkdir(corpusDir.c_str(), 0755);
+	mkdir(outputDir.c_str(), 0755);
+
+	FILE * output = options.json.empty() ? stdout : fopen(options.json.c_str(), "a");
+	if (!output)
+	{
+		fprintf(stderr, "Can't open %s.\n", options.json.c_str());
+		return 1;
+	}
+
+	bool passed = true;
+	for (CorpusKind kind : options.kinds)
+	{
+		passed = benchCorpus(kind, corpusDir, outputDir, options, output) && passed;
+	}
+
+	if (output != stdout)
+	{
+		fclose(output);
+	}
+	TarUnpacker::removePath(outputDir);
+	if (options.clean)
+	{
+		TarUnpacker::removePath(corpusDir);
+	}
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,162 @@
+/*
+	Headers per second: checksum and numeric fields of ustar headers,
+	old byte loop / strtol / division encoder against HeaderCodec.
+
+	g++ -O2 -std=c++17 -I../src HeaderBenchmark.cpp ../src/Header/HeaderCodec.cpp -o HeaderBenchmark
+	./HeaderBenchmark [headers in thousands] [rounds]
+*/
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+#include "Header/HeaderCodec.h"
+
+/* the loops TarPacker and TarUnpacker used before HeaderCodec */
+static int64_t
+oldChecksum(const PosixHeader & header)
+{
+	int64_t checksum = 0;
+	const uint8_t * bytes = reinterpret_cast<const uint8_t *>(&header);
+	for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+		checksum += bytes[i];
+	}
+	return checksum;
+}
+
+static void
+oldToOctStr(int64_t value, int8_t * res, int32_t n)
+{
+	uint32_t radix = 8;
+
+	int32_t i = n - 2;
+	while (value > 0)
+	{
+		res[i] = (value % radix) + '0';
+		value /= radix;
+		i--;
+	}
+
+	while (i >= 0)
+	{
+		res[i] = '0';
+		i--;
+	}
+
+	res[n - 1] = '\0';
+}
+
+static uint64_t
+oldDecode(const PosixHeader & header)
+{
+	return strtol((char*)header.mode, nullptr, 8) + strtol((char*)header.uid, nullptr, 8) +
+		strtol((char*)header.gid, nullptr, 8) + strtol((char*)header.size, nullptr, 8) +
+		strtoll((char*)header.mtime, nullptr, 8) + strtoll((char*)header.chksum, nullptr, 8);
+}
+
+static uint64_t
+newDecode(const PosixHeader & header)
+{
+	return HeaderCodec::parseOctal(header.mode, sizeof(header.mode)) +
+		HeaderCodec::parseOctal(header.uid, sizeof(header.uid)) +
+		HeaderCodec::parseOctal(header.gid, sizeof(header.gid)) +
+		HeaderCodec::parseOctal(header.size, sizeof(header.size)) +
+		HeaderCodec::parseOctal(header.mtime, sizeof(header.mtime)) +
+		HeaderCodec::parseOctal(header.chksum, sizeof(header.chksum));
+}
+
+static void
+oldEncode(PosixHeader & header, uint64_t seed)
+{
+	int8_t res[12];
+	oldToOctStr(seed & 0777, res, sizeof(header.mode));
+	std::memcpy(header.mode, res, sizeof(header.mode));
+	oldToOctStr(seed % 60000, res, sizeof(header.uid));
+	std::memcpy(header.uid, res, sizeof(header.uid));
+	oldToOctStr(seed % 60000, res, sizeof(header.gid));
+	std::memcpy(header.gid, res, sizeof(header.gid));
+	oldToOctStr(seed * 977, res, sizeof(header.size));
+	std::memcpy(header.size, res, sizeof(header.size));
+	oldToOctStr(1600000000 + seed, res, sizeof(header.mtime));
+	std::memcpy(header.mtime, res, sizeof(header.mtime));
+	oldToOctStr(oldChecksum(header), res, 7);
+	std::memcpy(header.chksum, res, 6);
+}
+
+static void
+newEncode(PosixHeader & header, uint64_t seed)
+{
+	HeaderCodec::toOctal(seed & 0777, header.mode, sizeof(header.mode));
+	HeaderCodec::toOctal(seed % 60000, header.uid, sizeof(header.uid));
+	HeaderCodec::toOctal(seed % 60000, header.gid, sizeof(header.gid));
+	HeaderCodec::toOctal(seed * 977, header.size, sizeof(header.size));
+	HeaderCodec::toOctal(1600000000 + seed, header.mtime, sizeof(header.mtime));
+	HeaderCodec::toOctal(HeaderCodec::sum(&header), header.chksum, 7);
+}
+
+template <typename Step>
+static double
+measure(const char * label, std::vector<PosixHeader> & headers, size_t rounds, Step step)
+{
+	uint64_t result = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (size_t round = 0; round < rounds; ++round)
+	{
+		for (size_t i = 0; i < headers.size(); ++i)
+		{
+			result += step(headers[i], i);
+		}
+	}
+	auto end = std::chrono::steady_clock::now();
+
+	double seconds = std::chrono::duration<double>(end - start).count();
+	double rate = headers.size() * rounds / seconds;
+	/* result printed so that nothing is optimized away */
+	printf("%-16s %10.3f s %12.0f headers/s  (%llx)\n", label, seconds, rate, (unsigned long long)(result & 0xffff));
+	return rate;
+}
+
+int main(int argc, char ** argv)
+{
+	size_t count = (argc > 1 ? std::stoul(argv[1]) : 1000) * 1000;
+	size_t rounds = argc > 2 ? std::stoul(argv[2]) : 5;
+
+	std::vector<PosixHeader> headers(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		PosixHeader & header = headers[i];
+		std::memset(&header, 0, BLOCK_SIZE);
+		snprintf((char*)header.name, sizeof(header.name), "dir%zu/file%zu.txt", i % 97, i);
+		std::memcpy(header.magic, TMAGIC, TMAGLEN);
+		header.typeflag = REGTYPE;
+		std::memset(header.chksum, ' ', sizeof(header.chksum));
+		newEncode(header, i);
+
+		if (HeaderCodec::sum(&header) != HeaderCodec::sumScalar(&header) ||
+			HeaderCodec::checksum(header) != HeaderCodec::parseOctal(header.chksum, sizeof(header.chksum)))
+		{
+			printf("checksum mismatch at %zu\n", i);
+			return 1;
+		}
+		if (oldDecode(header) != newDecode(header))
+		{
+			printf("decode mismatch at %zu\n", i);
+			return 1;
+		}
+	}
+
+	printf("%zu headers x %zu rounds, checksum by %s\n", count, rounds, HeaderCodec::sumName());
+
+	double before = measure("sum scalar", headers, rounds, [](PosixHeader & h, size_t) { return oldChecksum(h); });
+	double after = measure("sum dispatched", headers, rounds, [](PosixHeader & h, size_t) { return HeaderCodec::sum(&h); });
+	printf("checksum speedup x%.2f\n", after / before);
+
+	before = measure("decode strtol", headers, rounds, [](PosixHeader & h, size_t) { return oldDecode(h); });
+	after = measure("decode codec", headers, rounds, [](PosixHeader & h, size_t) { return newDecode(h); });
+	printf("decode speedup x%.2f\n", after / before);
+
+	before = measure("encode old", headers, rounds, [](PosixHeader & h, size_t i) { oldEncode(h, i); return (uint64_t)h.chksum[0]; });
+	after = measure("encode codec", headers, rounds, [](PosixHeader & h, size_t i) { newEncode(h, i); return (uint64_t)h.chksum[0]; });
+	printf("encode speedup x%.2f\n", after / before);
+
+	return 0;
+}
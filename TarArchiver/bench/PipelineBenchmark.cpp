@@ -0,0 +1,130 @@
+/*
+	Heap allocations per member on the header pipeline: pack headers, list, extract.
+	Every malloc is counted (operator new and libc included, glibc only);
+	after warm-up a member should cost none.
+
+	g++ -O2 -std=c++17 -I../src PipelineBenchmark.cpp $(find ../src -name '*.cpp' ! -name main.cpp) -lpthread -o PipelineBenchmark
+	./PipelineBenchmark [members in thousands]
+*/
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+
+#include "Packer/TarPacker.h"
+#include "Unpacker/TarUnpacker.h"
+
+static std::atomic<uint64_t> allocations(0);
+
+/* glibc: malloc of the program replaces the one of libc, so operator new and libc itself are counted */
+extern "C" void * __libc_malloc(size_t size);
+extern "C" void * __libc_calloc(size_t count, size_t size);
+extern "C" void * __libc_realloc(void * p, size_t size);
+
+extern "C" void *
+malloc(size_t size)
+{
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	return __libc_malloc(size);
+}
+
+extern "C" void *
+calloc(size_t count, size_t size)
+{
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	return __libc_calloc(count, size);
+}
+
+extern "C" void *
+realloc(void * p, size_t size)
+{
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	return __libc_realloc(p, size);
+}
+
+/* swallows everything, so only the pipeline itself is measured */
+class NullBuf : public std::streambuf
+{
+protected:
+	int_type overflow(int_type c) override { return traits_type::not_eof(c); }
+	std::streamsize xsputn(const char *, std::streamsize n) override { return n; }
+};
+
+static const char * workDir = "pipeline_bench";
+
+template <typename Step>
+static void
+measure(const char * label, size_t members, Step step)
+{
+	uint64_t before = allocations.load();
+	auto start = std::chrono::steady_clock::now();
+	bool ok = step();
+	auto end = std::chrono::steady_clock::now();
+	uint64_t count = allocations.load() - before;
+
+	double seconds = std::chrono::duration<double>(end - start).count();
+	printf("%-14s %8.3f s %12.0f members/s %10llu allocations %8.4f per member%s\n", label, seconds,
+		members / seconds, (unsigned long long)count, (double)count / members, ok ? "" : "  FAILED");
+}
+
+int main(int argc, char ** argv)
+{
+	size_t count = (argc > 1 ? std::stoul(argv[1]) : 20) * 1000;
+
+	std::string source = std::string(workDir) + "/src";
+	mkdir(workDir, 0755);
+	mkdir(source.c_str(), 0755);
+	for (size_t i = 0; i < count; ++i)
+	{
+		std::ofstream file(source + "/member_with_a_long_name_" + std::to_string(i), std::ios::binary);
+		file << "content of member " << i << '\n';
+	}
+
+	NullBuf nullBuf;
+	std::ostream null(&nullBuf);
+
+	/* header build, encode, write */
+	TarPacker packer;
+	struct stat s;
+	lstat(source.c_str(), &s);
+	const std::string name = "src/member_with_a_long_name";
+	measure("pack headers", count, [&] {
+		for (size_t i = 0; i < count; ++i)
+		{
+			HeaderInfo headerInfo;
+			packer.createHeader(headerInfo, name, REGTYPE, s);
+			packer.convertHeader(headerInfo);
+			packer.writeHeader(null, headerInfo);
+		}
+		return true;
+	});
+
+	std::ostringstream archive;
+	packer.packStream(archive, std::string(workDir) + "/", "src");
+	const std::string archivePath = std::string(workDir) + "/bench.tar";
+	{
+		std::ofstream file(archivePath, std::ios::binary);
+		file << archive.str();
+	}
+
+	TarUnpacker unpacker;
+	unpacker.list(archivePath, null);
+	measure("list", count, [&] { return unpacker.list(archivePath, null); });
+
+	/* first pass grows the reused buffers, second is the steady state */
+	std::string targetA = std::string(workDir) + "/a";
+	std::string targetB = std::string(workDir) + "/b";
+	mkdir(targetA.c_str(), 0755);
+	mkdir(targetB.c_str(), 0755);
+	{
+		std::istringstream input(archive.str());
+		unpacker.unpackStream(input, targetA);
+	}
+	std::istringstream input(archive.str());
+	measure("extract", count, [&] { return unpacker.unpackStream(input, targetB); });
+
+	std::string cleanup = std::string("rm -rf ") + workDir;
+	return system(cleanup.c_str());
+}
@@ -0,0 +1,121 @@
+#include "ArchiveBuilder.h"
+
+ArchiveBuilder::ArchiveBuilder(size_t capacity)
+	: target(&arena)
+{
+	arena.reserve(capacity);
+}
+
+struct stat
+ArchiveBuilder::makeStat(const MemberAttributes & attributes, mode_t type, uint64_t size)
+{
+	struct stat s = {};
+	s.st_mode = type | (attributes.mode & RWX);
+	s.st_uid = attributes.uid;
+	s.st_gid = attributes.gid;
+	s.st_size = size;
+	s.st_mtim.tv_sec = attributes.mtime;
+	s.st_mtim.tv_nsec = attributes.mtimeNsec;
+	return s;
+}
+
+bool
+ArchiveBuilder::writeMember(HeaderInfo & headerInfo, const MemberAttributes & attributes)
+{
+	if (finished || headerInfo.name.empty())
+	{
+		return false;
+	}
+
+	if (!attributes.uname.empty())
+	{
+		headerInfo.uname = attributes.uname;
+	}
+	if (!attributes.gname.empty())
+	{
+		headerInfo.gname = attributes.gname;
+	}
+
+	packer.convertHeader(headerInfo);
+	packer.writeHeader(target, headerInfo);
+	return target.good();
+}
+
+bool
+ArchiveBuilder::addFile(std::string_view name, const void * content, size_t size,
+	const MemberAttributes & attributes)
+{
+	struct stat s = makeStat(attributes, S_IFREG, size);
+
+	HeaderInfo headerInfo;
+	packer.createHeader(headerInfo, name, REGTYPE, s);
+	if (!writeMember(headerInfo, attributes))
+	{
+		return false;
+	}
+
+	target.write((const char*)content, size);
+	return CopyEngine::writePadding(target, size);
+}
+
+bool
+ArchiveBuilder::addDirectory(std::string_view name, const MemberAttributes & attributes)
+{
+	dirName.assign(name);
+	if (!dirName.empty() && dirName.back() != '/')
+	{
+		dirName += '/';
+	}
+	struct stat s = makeStat(attributes, S_IFDIR, 0);
+
+	HeaderInfo headerInfo;
+	packer.createHeader(headerInfo, dirName, DIRTYPE, s);
+	return writeMember(headerInfo, attributes);
+}
+
+bool
+ArchiveBuilder::addSymlink(std::string_view name, std::string_view target,
+	const MemberAttributes & attributes)
+{
+	struct stat s = makeStat(attributes, S_IFLNK, target.length());
+
+	HeaderInfo headerInfo;
+	packer.createHeader(headerInfo, name, SYMTYPE, s, target);
+	return writeMember(headerInfo, attributes);
+}
+
+bool
+ArchiveBuilder::finish()
+{
+	static const ContentData zeros = { 0 };
+
+	if (!finished)
+	{
+		target.write((const char*)&zeros, BLOCK_SIZE);
+		target.write((const char*)&zeros, BLOCK_SIZE);
+		finished = true;
+	}
+	return target.good();
+}
+
+std::string
+ArchiveBuilder::take()
+{
+	std::string archive = arena.take();
+	clear();
+	return archive;
+}
+
+void
+ArchiveBuilder::clear()
+{
+	arena.clear();
+	target.clear();
+	finished = false;
+}
+
+void
+ArchiveBuilder::setPreciseTimes(bool enable)
+{
+	packer.setPreciseTimes(enable);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "../Packer/TarPacker.h"
+#include "../Sink/OutputSink.h"
+
+/* what a member made from memory has instead of a stat */
+struct MemberAttributes
+{
+	mode_t mode = 0644;
+	uid_t uid = 0;
+	gid_t gid = 0;
+	time_t mtime = 0;
+	uint32_t mtimeNsec = 0;		/* written with setPreciseTimes only */
+	std::string_view uname;		/* empty: looked up by uid, gid */
+	std::string_view gname;
+};
+
+/*
+	Archive made in memory from buffers, no file system involved: bundles,
+	request bodies, test fixtures. Members are appended in call order into one
+	growable arena, through the same header code as TarPacker, so long names,
+	big sizes and ids get their pax headers. Read it back with MemberReader.
+*/
+class ArchiveBuilder
+{
+private:
+	TarPacker packer;
+	MemorySink arena;
+	std::ostream target;
+	std::string dirName;
+	bool finished = false;
+
+	static struct stat makeStat(const MemberAttributes & attributes, mode_t type, uint64_t size);
+
+	/* headerInfo from createHeader, names of attributes go in before it is converted */
+	bool writeMember(HeaderInfo & headerInfo, const MemberAttributes & attributes);
+
+public:
+	/* capacity is reserved for the arena up front, it still grows past it */
+	explicit ArchiveBuilder(size_t capacity = 0);
+
+	ArchiveBuilder(const ArchiveBuilder &) = delete;
+	ArchiveBuilder & operator=(const ArchiveBuilder &) = delete;
+
+	/* content is copied into the arena; false after finish() */
+	bool addFile(std::string_view name, const void * content, size_t size,
+		const MemberAttributes & attributes = MemberAttributes());
+
+	/* trailing '/' is added when missing */
+	bool addDirectory(std::string_view name, const MemberAttributes & attributes = { 0755 });
+
+	bool addSymlink(std::string_view name, std::string_view target,
+		const MemberAttributes & attributes = { 0777 });
+
+	/* end blocks, the arena is a complete archive after it */
+	bool finish();
+
+	/* archive so far, data() stays valid until the next add or take() */
+	const std::string & data() const { return arena.data(); }
+	std::string take();
+
+	/* next archive is built over this one, arena capacity is kept */
+	void clear();
+
+	/* nanoseconds of mtime go into pax records, see TarPacker::setPreciseTimes */
+	void setPreciseTimes(bool enable);
+};
@@ -0,0 +1,142 @@
+#include "Codec.h"
+
+#ifdef TAR_WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef TAR_WITH_ZSTD
+#include <zstd.h>
+#endif
+#ifdef TAR_WITH_LZ4
+#include <lz4frame.h>
+#endif
+
+bool
+Codec::available(Compression type)
+{
+	switch (type)
+	{
+	case Compression::NONE:
+		return true;
+#ifdef TAR_WITH_ZLIB
+	case Compression::GZIP:
+		return true;
+#endif
+#ifdef TAR_WITH_ZSTD
+	case Compression::ZSTD:
+		return true;
+#endif
+#ifdef TAR_WITH_LZ4
+	case Compression::LZ4:
+		return true;
+#endif
+	default:
+		return false;
+	}
+}
+
+Compression
+Codec::detect(const uint8_t * magic, size_t length)
+{
+	if (length >= 2 && magic[0] == 0x1f && magic[1] == 0x8b)
+	{
+		return Compression::GZIP;
+	}
+
+	if (length >= 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd)
+	{
+		return Compression::ZSTD;
+	}
+
+	if (length >= 4 && magic[0] == 0x04 && magic[1] == 0x22 && magic[2] == 0x4d && magic[3] == 0x18)
+	{
+		return Compression::LZ4;
+	}
+
+	return Compression::NONE;
+}
+
+const char *
+Codec::suffix(Compression type)
+{
+	switch (type)
+	{
+	case Compression::GZIP:
+		return ".gz";
+	case Compression::ZSTD:
+		return ".zst";
+	case Compression::LZ4:
+		return ".lz4";
+	default:
+		return "";
+	}
+}
+
+bool
+Codec::compress(Compression type, int level, const char * data, size_t size, std::vector<char> & output)
+{
+	switch (type)
+	{
+#ifdef TAR_WITH_ZLIB
+	case Compression::GZIP:
+	{
+		z_stream zs;
+		std::memset(&zs, 0, sizeof(zs));
+
+		/* 15 + 16: gzip wrapper instead of zlib one */
+		if (deflateInit2(&zs, level == COMPRESS_DEFAULT_LEVEL ? Z_DEFAULT_COMPRESSION : level,
+			Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		{
+			return false;
+		}
+
+		output.resize(deflateBound(&zs, size));
+		zs.next_in = (Bytef*)data;
+		zs.avail_in = size;
+		zs.next_out = (Bytef*)output.data();
+		zs.avail_out = output.size();
+
+		int ret = deflate(&zs, Z_FINISH);
+		output.resize(zs.total_out);
+		deflateEnd(&zs);
+
+		return ret == Z_STREAM_END;
+	}
+#endif
+#ifdef TAR_WITH_ZSTD
+	case Compression::ZSTD:
+	{
+		output.resize(ZSTD_compressBound(size));
+		size_t ret = ZSTD_compress(output.data(), output.size(), data, size,
+			level == COMPRESS_DEFAULT_LEVEL ? ZSTD_CLEVEL_DEFAULT : level);
+		if (ZSTD_isError(ret))
+		{
+			return false;
+		}
+
+		output.resize(ret);
+		return true;
+	}
+#endif
+#ifdef TAR_WITH_LZ4
+	case Compression::LZ4:
+	{
+		LZ4F_preferences_t prefs;
+		std::memset(&prefs, 0, sizeof(prefs));
+		prefs.compressionLevel = level == COMPRESS_DEFAULT_LEVEL ? 0 : level;
+		prefs.frameInfo.contentSize = size;
+
+		output.resize(LZ4F_compressFrameBound(size, &prefs));
+		size_t ret = LZ4F_compressFrame(output.data(), output.size(), data, size, &prefs);
+		if (LZ4F_isError(ret))
+		{
+			return false;
+		}
+
+		output.resize(ret);
+		return true;
+	}
+#endif
+	default:
+		return false;
+	}
+}
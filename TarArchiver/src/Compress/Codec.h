@@ -0,0 +1,48 @@
+#pragma once
+
+#include "../TarCommon.h"
+
+/*
+	Codecs are built only when their library is there:
+	TAR_WITH_ZLIB (gzip), TAR_WITH_ZSTD (zstd), TAR_WITH_LZ4 (lz4).
+*/
+
+/* uncompressed bytes in one independently compressed piece */
+#define COMPRESS_CHUNK_SIZE (1024 * 1024)
+
+/* seekable output starts a new piece on a member boundary once the piece has this many bytes */
+#define FRAME_MIN_SIZE (256 * 1024)
+
+/* level chosen by library */
+#define COMPRESS_DEFAULT_LEVEL -1
+
+enum class Compression
+{
+	NONE = 0,
+	GZIP,
+	ZSTD,
+	LZ4
+};
+
+/* start of one independently compressed piece */
+struct FrameEntry
+{
+	uint64_t uncompressedOffset;	/* position in tar stream */
+	uint64_t compressedOffset;		/* position in compressed file */
+};
+
+class Codec
+{
+public:
+	static bool available(Compression type);
+
+	/* by magic bytes at the start of a stream, NONE if unknown */
+	static Compression detect(const uint8_t * magic, size_t length);
+
+	/* ".gz", ".zst", ".lz4" */
+	static const char * suffix(Compression type);
+
+	/* one gzip member, zstd frame or lz4 frame; a concatenation of them is a valid stream */
+	static bool compress(Compression type, int level, const char * data, size_t size,
+		std::vector<char> & output);
+};
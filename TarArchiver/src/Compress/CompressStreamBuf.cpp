@@ -0,0 +1,201 @@
+#include "CompressStreamBuf.h"
+
+CompressStreamBuf::CompressStreamBuf(std::ostream & output, Compression type, int level,
+	size_t threadCount, size_t chunkSize)
+	: output(output), type(type), level(level), chunkSize(chunkSize ? chunkSize : COMPRESS_CHUNK_SIZE)
+{
+	if (!threadCount)
+	{
+		threadCount = 1;
+	}
+	maxInFlight = 2 * threadCount;
+
+	for (size_t i = 0; i < threadCount; ++i)
+	{
+		workers.emplace_back(&CompressStreamBuf::work, this);
+	}
+
+	newChunk();
+}
+
+CompressStreamBuf::~CompressStreamBuf()
+{
+	finish();
+}
+
+void
+CompressStreamBuf::newChunk()
+{
+	current.reset(new CompressChunk());
+	current->input.resize(chunkSize);
+	setp(current->input.data(), current->input.data() + chunkSize);
+}
+
+bool
+CompressStreamBuf::submit()
+{
+	current->input.resize(pptr() - pbase());
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		pending.push_back(std::move(current));
+		changed.notify_all();
+	}
+
+	return drain(maxInFlight);
+}
+
+bool
+CompressStreamBuf::drain(size_t keep)
+{
+	std::unique_lock<std::mutex> guard(lock);
+	while (!pending.empty())
+	{
+		if (!pending.front()->done)
+		{
+			if (pending.size() <= keep)
+			{
+				break;
+			}
+			changed.wait(guard, [this] { return pending.front()->done; });
+		}
+
+		std::unique_ptr<CompressChunk> chunk = std::move(pending.front());
+		pending.pop_front();
+		guard.unlock();
+
+		if (chunk->failed)
+		{
+			failed = true;
+		}
+		else
+		{
+			output.write(chunk->output.data(), chunk->output.size());
+			failed = failed || !output;
+
+			frameTable.push_back({ uncompressedWritten, compressedWritten });
+			uncompressedWritten += chunk->input.size();
+			compressedWritten += chunk->output.size();
+		}
+
+		guard.lock();
+	}
+
+	return !failed;
+}
+
+void
+CompressStreamBuf::work()
+{
+	std::unique_lock<std::mutex> guard(lock);
+	for (;;)
+	{
+		CompressChunk * chunk = nullptr;
+		changed.wait(guard, [&] {
+			for (auto it = pending.begin(); it != pending.end(); ++it)
+			{
+				if (!(*it)->claimed)
+				{
+					chunk = it->get();
+					return true;
+				}
+			}
+			return stop;
+		});
+
+		if (!chunk)
+		{
+			return;
+		}
+
+		chunk->claimed = true;
+		guard.unlock();
+		bool compressed = Codec::compress(type, level, chunk->input.data(), chunk->input.size(), chunk->output);
+		guard.lock();
+
+		chunk->failed = !compressed;
+		chunk->done = true;
+		changed.notify_all();
+	}
+}
+
+CompressStreamBuf::int_type
+CompressStreamBuf::overflow(int_type c)
+{
+	if (finished || !submit())
+	{
+		return traits_type::eof();
+	}
+
+	newChunk();
+	if (!traits_type::eq_int_type(c, traits_type::eof()))
+	{
+		*pptr() = traits_type::to_char_type(c);
+		pbump(1);
+	}
+
+	return traits_type::not_eof(c);
+}
+
+std::streamsize
+CompressStreamBuf::xsputn(const char * s, std::streamsize n)
+{
+	std::streamsize written = 0;
+	while (written < n)
+	{
+		if (pptr() == epptr() && traits_type::eq_int_type(overflow(traits_type::eof()), traits_type::eof()))
+		{
+			break;
+		}
+
+		std::streamsize room = epptr() - pptr();
+		std::streamsize part = n - written < room ? n - written : room;
+		std::memcpy(pptr(), s + written, part);
+		pbump(part);
+		written += part;
+	}
+
+	return written;
+}
+
+void
+CompressStreamBuf::markBoundary()
+{
+	if (!finished && (size_t)(pptr() - pbase()) >= FRAME_MIN_SIZE)
+	{
+		submit();
+		newChunk();
+	}
+}
+
+bool
+CompressStreamBuf::finish()
+{
+	if (finished)
+	{
+		return !failed;
+	}
+
+	if (pptr() != pbase())
+	{
+		submit();
+	}
+	drain(0);
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stop = true;
+		changed.notify_all();
+	}
+
+	for (auto & worker : workers)
+	{
+		worker.join();
+	}
+
+	finished = true;
+	setp(nullptr, nullptr);
+	output.flush();
+
+	return !failed && output;
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <streambuf>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
+#include "Codec.h"
+
+struct CompressChunk
+{
+	std::vector<char> input;
+	std::vector<char> output;
+	bool claimed = false;
+	bool done = false;
+	bool failed = false;
+};
+
+/*
+	Output stream buffer which compresses into another stream.
+	Data is cut into chunks compressed independently by worker threads (like pigz
+	or zstd -T), results are written in order by the producing thread. Only a few
+	chunks per worker are in flight, so the producer keeps reading files while
+	workers compress. sync() keeps the partial chunk, finish() writes everything.
+*/
+class CompressStreamBuf : public std::streambuf
+{
+private:
+	std::ostream & output;
+	Compression type;
+	int level;
+	size_t chunkSize;
+	size_t maxInFlight;
+
+	std::unique_ptr<CompressChunk> current;
+	std::vector<std::thread> workers;
+	std::mutex lock;
+	std::condition_variable changed;
+	std::deque<std::unique_ptr<CompressChunk>> pending;
+	bool stop = false;
+	bool failed = false;
+	bool finished = false;
+
+	std::vector<FrameEntry> frameTable;
+	uint64_t uncompressedWritten = 0;
+	uint64_t compressedWritten = 0;
+
+	void newChunk();
+
+	/* queue full current chunk, write finished ones */
+	bool submit();
+
+	/* write finished chunks from the front, wait for more while over keep are pending */
+	bool drain(size_t keep);
+
+	void work();
+
+protected:
+	int_type overflow(int_type c) override;
+
+	std::streamsize xsputn(const char * s, std::streamsize n) override;
+
+public:
+	CompressStreamBuf(std::ostream & output, Compression type, int level = COMPRESS_DEFAULT_LEVEL,
+		size_t threadCount = 1, size_t chunkSize = COMPRESS_CHUNK_SIZE);
+	~CompressStreamBuf();
+
+	/* compress and write the rest, stop workers; false if anything failed */
+	bool finish();
+
+	/* next bytes start a member: cut the piece here if it is big enough */
+	void markBoundary();
+
+	/* pieces written so far */
+	const std::vector<FrameEntry> & frames() const { return frameTable; }
+
+	uint64_t compressedSize() const { return compressedWritten; }
+};
@@ -0,0 +1,205 @@
+#include "DecompressStreamBuf.h"
+
+#ifdef TAR_WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef TAR_WITH_ZSTD
+#include <zstd.h>
+#endif
+#ifdef TAR_WITH_LZ4
+#include <lz4frame.h>
+#endif
+
+DecompressStreamBuf::DecompressStreamBuf(std::istream & input, Compression type)
+	: input(input), type(type), inBuffer(DECOMPRESS_INPUT_SIZE), outBuffer(COMPRESS_CHUNK_SIZE)
+{
+	switch (type)
+	{
+#ifdef TAR_WITH_ZLIB
+	case Compression::GZIP:
+	{
+		z_stream * zs = new z_stream();
+		/* 15 + 32: gzip or zlib header detected */
+		if (inflateInit2(zs, 15 + 32) != Z_OK)
+		{
+			delete zs;
+			failed = true;
+			break;
+		}
+		context = zs;
+	}
+	break;
+#endif
+#ifdef TAR_WITH_ZSTD
+	case Compression::ZSTD:
+	{
+		context = ZSTD_createDStream();
+		failed = context == nullptr;
+	}
+	break;
+#endif
+#ifdef TAR_WITH_LZ4
+	case Compression::LZ4:
+	{
+		LZ4F_dctx * dctx = nullptr;
+		failed = LZ4F_isError(LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION));
+		context = dctx;
+	}
+	break;
+#endif
+	default:
+		failed = true;
+		break;
+	}
+
+	setg(outBuffer.data(), outBuffer.data(), outBuffer.data());
+}
+
+DecompressStreamBuf::~DecompressStreamBuf()
+{
+	if (!context)
+	{
+		return;
+	}
+
+	switch (type)
+	{
+#ifdef TAR_WITH_ZLIB
+	case Compression::GZIP:
+		inflateEnd((z_stream*)context);
+		delete (z_stream*)context;
+		break;
+#endif
+#ifdef TAR_WITH_ZSTD
+	case Compression::ZSTD:
+		ZSTD_freeDStream((ZSTD_DStream*)context);
+		break;
+#endif
+#ifdef TAR_WITH_LZ4
+	case Compression::LZ4:
+		LZ4F_freeDecompressionContext((LZ4F_dctx*)context);
+		break;
+#endif
+	default:
+		break;
+	}
+}
+
+bool
+DecompressStreamBuf::fill()
+{
+	if (inputDone)
+	{
+		return false;
+	}
+
+	input.read(inBuffer.data(), inBuffer.size());
+	inLength = input.gcount();
+	inPos = 0;
+
+	if (inLength < inBuffer.size())
+	{
+		inputDone = true;
+	}
+
+	return inLength > 0;
+}
+
+size_t
+DecompressStreamBuf::decode()
+{
+	size_t produced = 0;
+
+	/* step with what is buffered, read more only when nothing came out */
+	while (!failed)
+	{
+		switch (type)
+		{
+#ifdef TAR_WITH_ZLIB
+		case Compression::GZIP:
+		{
+			z_stream * zs = (z_stream*)context;
+			zs->next_in = (Bytef*)inBuffer.data() + inPos;
+			zs->avail_in = inLength - inPos;
+			zs->next_out = (Bytef*)outBuffer.data() + produced;
+			zs->avail_out = outBuffer.size() - produced;
+
+			int ret = inflate(zs, Z_NO_FLUSH);
+			inPos = inLength - zs->avail_in;
+			produced = outBuffer.size() - zs->avail_out;
+
+			if (ret == Z_STREAM_END)
+			{
+				/* next member may follow */
+				inflateReset(zs);
+			}
+			else if (ret != Z_OK && ret != Z_BUF_ERROR)
+			{
+				failed = true;
+			}
+		}
+		break;
+#endif
+#ifdef TAR_WITH_ZSTD
+		case Compression::ZSTD:
+		{
+			ZSTD_inBuffer in = { inBuffer.data() + inPos, inLength - inPos, 0 };
+			ZSTD_outBuffer out = { outBuffer.data() + produced, outBuffer.size() - produced, 0 };
+
+			size_t ret = ZSTD_decompressStream((ZSTD_DStream*)context, &out, &in);
+			inPos += in.pos;
+			produced += out.pos;
+			failed = ZSTD_isError(ret);
+		}
+		break;
+#endif
+#ifdef TAR_WITH_LZ4
+		case Compression::LZ4:
+		{
+			size_t dstSize = outBuffer.size() - produced;
+			size_t srcSize = inLength - inPos;
+
+			size_t ret = LZ4F_decompress((LZ4F_dctx*)context, outBuffer.data() + produced, &dstSize,
+				inBuffer.data() + inPos, &srcSize, nullptr);
+			inPos += srcSize;
+			produced += dstSize;
+			failed = LZ4F_isError(ret);
+		}
+		break;
+#endif
+		default:
+			failed = true;
+			break;
+		}
+
+		if (produced > 0 || failed)
+		{
+			break;
+		}
+
+		if (inPos == inLength && !fill())
+		{
+			break;
+		}
+	}
+
+	return produced;
+}
+
+DecompressStreamBuf::int_type
+DecompressStreamBuf::underflow()
+{
+	if (gptr() < egptr())
+	{
+		return traits_type::to_int_type(*gptr());
+	}
+
+	size_t produced = decode();
+	if (produced == 0)
+	{
+		return traits_type::eof();
+	}
+
+	setg(outBuffer.data(), outBuffer.data(), outBuffer.data() + produced);
+	return traits_type::to_int_type(*gptr());
+}
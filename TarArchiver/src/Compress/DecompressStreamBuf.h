@@ -0,0 +1,45 @@
+#pragma once
+#include <streambuf>
+
+#include "Codec.h"
+
+/* compressed bytes read from the source at once */
+#define DECOMPRESS_INPUT_SIZE (256 * 1024)
+
+/*
+	Input stream buffer which decompresses another stream.
+	Concatenated gzip members, zstd frames and lz4 frames are read as one stream,
+	so output of CompressStreamBuf and of the usual tools is accepted.
+	The stream is forward only, there is no seeking.
+*/
+class DecompressStreamBuf : public std::streambuf
+{
+private:
+	std::istream & input;
+	Compression type;
+	std::vector<char> inBuffer;
+	std::vector<char> outBuffer;
+	size_t inPos = 0;
+	size_t inLength = 0;
+	bool inputDone = false;
+	bool failed = false;
+	void * context = nullptr;	/* z_stream, ZSTD_DStream or LZ4F_dctx */
+
+	bool fill();
+
+	/* decompress into outBuffer, returns bytes produced */
+	size_t decode();
+
+protected:
+	int_type underflow() override;
+
+public:
+	DecompressStreamBuf(std::istream & input, Compression type);
+	~DecompressStreamBuf();
+
+	DecompressStreamBuf(const DecompressStreamBuf &) = delete;
+	DecompressStreamBuf & operator=(const DecompressStreamBuf &) = delete;
+
+	/* corrupt data or unknown codec */
+	bool bad() const { return failed; }
+};
@@ -0,0 +1,309 @@
+#include <sys/sendfile.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <linux/fs.h>
+#undef BLOCK_SIZE
+
+#include "CopyEngine.h"
+
+CopyEngine::CopyEngine(size_t chunkSize)
+{
+	setChunkSize(chunkSize);
+}
+
+void
+CopyEngine::setChunkSize(size_t size)
+{
+	if (size < BLOCK_SIZE)
+	{
+		size = BLOCK_SIZE;
+	}
+
+	chunkSize = alignToBlock(size);
+	/* one more block for padding when member content was started by copyKernel */
+	buffer.resize(chunkSize + BLOCK_SIZE);
+}
+
+template <typename Read>
+uint64_t
+CopyEngine::padFrom(Read read, std::ostream & output, uint64_t size, uint64_t padding)
+{
+	uint64_t left = size;
+	uint64_t total = 0;
+	bool complete = true;
+
+	while (left > 0)
+	{
+		size_t toRead = left < chunkSize ? left : chunkSize;
+		size_t got = 0;
+
+		if (complete)
+		{
+			got = read((char*)buffer.data(), toRead);
+		}
+
+		if (got < toRead)
+		{
+			/* file was truncated while packing */
+			complete = false;
+			std::memset(buffer.data() + got, 0, toRead - got);
+		}
+
+		/* last chunk: padding goes out with the data */
+		size_t toWrite = toRead;
+		if (toRead == left)
+		{
+			toWrite = toRead + padding;
+			std::memset(buffer.data() + toRead, 0, padding);
+		}
+
+		output.write((char*)buffer.data(), toWrite);
+		if (!output)
+		{
+			break;
+		}
+
+		left -= toRead;
+		total += got;
+	}
+
+	totalBytes += total;
+	return total;
+}
+
+/* padding after the member once written + size of it are out */
+static uint64_t
+paddingAfter(uint64_t size, uint64_t written)
+{
+	return CopyEngine::alignToBlock(written + size) - (written + size);
+}
+
+/* read of a descriptor at its current offset, retried until count or end */
+static size_t
+readFully(int inFd, char * data, size_t count)
+{
+	size_t got = 0;
+	while (got < count)
+	{
+		ssize_t n = read(inFd, data + got, count - got);
+		if (n <= 0)
+		{
+			break;
+		}
+		got += n;
+	}
+	return got;
+}
+
+uint64_t
+CopyEngine::copyPadded(std::istream & input, std::ostream & output, uint64_t size, uint64_t written)
+{
+	return padFrom([&input](char * data, size_t count) -> size_t {
+		input.read(data, count);
+		return input.gcount();
+	}, output, size, paddingAfter(size, written));
+}
+
+uint64_t
+CopyEngine::copyPadded(int inFd, std::ostream & output, uint64_t size, uint64_t written)
+{
+	return padFrom([inFd](char * data, size_t count) -> size_t {
+		return readFully(inFd, data, count);
+	}, output, size, paddingAfter(size, written));
+}
+
+uint64_t
+CopyEngine::copyPiece(int inFd, std::ostream & output, uint64_t size)
+{
+	return padFrom([inFd](char * data, size_t count) -> size_t {
+		return readFully(inFd, data, count);
+	}, output, size, 0);
+}
+
+template <typename Write>
+uint64_t
+CopyEngine::unpadTo(std::istream & input, Write write, uint64_t size, uint64_t padding)
+{
+	uint64_t left = size;
+
+	while (left > 0)
+	{
+		size_t toRead = left < chunkSize ? left : chunkSize;
+
+		input.read((char*)buffer.data(), toRead);
+		size_t got = input.gcount();
+
+		if (!write((const char*)buffer.data(), got) || got < toRead)
+		{
+			break;
+		}
+
+		left -= got;
+	}
+
+	input.ignore(padding);
+
+	totalBytes += size - left;
+	return size - left;
+}
+
+/* write to a descriptor at its current offset, false on error */
+static bool
+writeFully(int outFd, const char * data, size_t count)
+{
+	size_t done = 0;
+	while (done < count)
+	{
+		ssize_t n = write(outFd, data + done, count - done);
+		if (n <= 0)
+		{
+			return false;
+		}
+		done += n;
+	}
+	return true;
+}
+
+uint64_t
+CopyEngine::copyUnpadded(std::istream & input, std::ostream & output, uint64_t size, uint64_t written)
+{
+	return unpadTo(input, [&output](const char * data, size_t count) {
+		output.write(data, count);
+		return (bool)output;
+	}, size, paddingAfter(size, written));
+}
+
+uint64_t
+CopyEngine::copyUnpadded(std::istream & input, int outFd, uint64_t size, uint64_t written)
+{
+	return unpadTo(input, [outFd](const char * data, size_t count) {
+		return writeFully(outFd, data, count);
+	}, size, paddingAfter(size, written));
+}
+
+uint64_t
+CopyEngine::copyPiece(std::istream & input, int outFd, uint64_t size)
+{
+	return unpadTo(input, [outFd](const char * data, size_t count) {
+		return writeFully(outFd, data, count);
+	}, size, 0);
+}
+
+uint64_t
+CopyEngine::copyRange(int inFd, uint64_t inOffset, int outFd, uint64_t size)
+{
+	uint64_t left = size;
+
+	while (left > 0)
+	{
+		size_t toRead = left < chunkSize ? left : chunkSize;
+
+		ssize_t got = pread(inFd, buffer.data(), toRead, inOffset + (size - left));
+		if (got <= 0)
+		{
+			break;
+		}
+
+		ssize_t done = 0;
+		while (done < got)
+		{
+			ssize_t n = write(outFd, buffer.data() + done, got - done);
+			if (n <= 0)
+			{
+				totalBytes += size - left + done;
+				return size - left + done;
+			}
+			done += n;
+		}
+
+		left -= got;
+	}
+
+	totalBytes += size - left;
+	return size - left;
+}
+
+uint64_t
+CopyEngine::copyKernel(int inFd, uint64_t inOffset, int outFd, uint64_t outOffset, uint64_t size)
+{
+	loff_t inPos = inOffset;
+	loff_t outPos = outOffset;
+	uint64_t left = size;
+
+	while (left > 0)
+	{
+		ssize_t n = copy_file_range(inFd, &inPos, outFd, &outPos, left, 0);
+		if (n <= 0)
+		{
+			/* EXDEV, EINVAL, ENOSYS, EOPNOTSUPP: filesystem can't, try sendfile */
+			break;
+		}
+		left -= n;
+	}
+
+	if (left > 0 && lseek(outFd, outPos, SEEK_SET) == outPos)
+	{
+		off_t sendPos = inPos;
+		while (left > 0)
+		{
+			ssize_t n = sendfile(outFd, inFd, &sendPos, left);
+			if (n <= 0)
+			{
+				break;
+			}
+			left -= n;
+		}
+	}
+
+	totalBytes += size - left;
+	return size - left;
+}
+
+uint64_t
+CopyEngine::cloneRange(int inFd, uint64_t inOffset, int outFd, uint64_t outOffset, uint64_t size)
+{
+	uint64_t length = size / CLONE_BLOCK_SIZE * CLONE_BLOCK_SIZE;
+	if (!cloneable || !length || inOffset % CLONE_BLOCK_SIZE || outOffset % CLONE_BLOCK_SIZE)
+	{
+		return 0;
+	}
+
+	struct file_clone_range range;
+	range.src_fd = inFd;
+	range.src_offset = inOffset;
+	range.src_length = length;
+	range.dest_offset = outOffset;
+	if (ioctl(outFd, FICLONERANGE, &range))
+	{
+		/* EINVAL may be just this range, the rest means never on this filesystem */
+		if (errno != EINVAL)
+		{
+			cloneable = false;
+		}
+		return 0;
+	}
+
+	totalBytes += length;
+	return length;
+}
+
+bool
+CopyEngine::writePadding(std::ostream & output, uint64_t memberSize)
+{
+	static const ContentData zeros = { 0 };
+
+	uint64_t padding = alignToBlock(memberSize) - memberSize;
+	if (padding)
+	{
+		output.write((char*)&zeros, padding);
+	}
+
+	return (bool)output;
+}
+
+uint64_t
+CopyEngine::alignToBlock(uint64_t size)
+{
+	return (size + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+}
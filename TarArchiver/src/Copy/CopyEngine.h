@@ -0,0 +1,90 @@
+#pragma once
+
+#include "../TarCommon.h"
+
+/* clone unit of btrfs and xfs as they are usually made; with another block size */
+/* the clone is refused and the copy takes over */
+#define CLONE_BLOCK_SIZE 4096
+
+/* files from this size on are worth aligning in the archive for cloning */
+#define CLONE_MIN_SIZE (128 * 1024)
+
+/*
+	Moves member payloads between streams in large chunks.
+	Chunk size is always a multiple of BLOCK_SIZE, so the zero padding of the
+	last tar block is appended to the final chunk and written together with it.
+	Progress is tracked with a byte counter, the streams are never asked for tellg().
+
+	copyKernel() moves bytes between descriptors inside the kernel
+	(copy_file_range, then sendfile). It reports how far it got, so callers finish
+	the rest with the buffered path when the kernel or filesystem refuses.
+*/
+class CopyEngine
+{
+private:
+	std::vector<int8_t> buffer;
+	size_t chunkSize;
+	uint64_t totalBytes = 0;
+	bool cloneable = true;		/* false once the filesystem refused to clone */
+
+	/* read(buffer, count) -> bytes got; shared by the stream and descriptor variants */
+	template <typename Read>
+	uint64_t padFrom(Read read, std::ostream & output, uint64_t size, uint64_t padding);
+
+	/* write(buffer, count) -> false on error */
+	template <typename Write>
+	uint64_t unpadTo(std::istream & input, Write write, uint64_t size, uint64_t padding);
+
+public:
+	CopyEngine(size_t chunkSize = COPY_CHUNK_SIZE);
+
+	/* chunk size is rounded up to a multiple of BLOCK_SIZE */
+	void setChunkSize(size_t size);
+
+	size_t getChunkSize() const { return chunkSize; }
+
+	/* payload bytes moved by this engine since construction */
+	uint64_t getTotalBytes() const { return totalBytes; }
+
+	/* copy size bytes from input and pad output up to the block boundary */
+	/* written is count of member bytes already in output (by copyKernel), padding counts it too */
+	/* if input ends early the rest of the member is filled with zeros so the archive stays consistent */
+	/* returns count of bytes really read from input, output state must be checked by caller */
+	uint64_t copyPadded(std::istream & input, std::ostream & output, uint64_t size, uint64_t written = 0);
+
+	/* same from a descriptor at its current offset, no stream buffer per file */
+	uint64_t copyPadded(int inFd, std::ostream & output, uint64_t size, uint64_t written = 0);
+
+	/* copy size bytes and skip the padding of the last block in input */
+	/* written is count of member bytes already moved (by copyKernel) */
+	/* returns count of bytes written to output */
+	uint64_t copyUnpadded(std::istream & input, std::ostream & output, uint64_t size, uint64_t written = 0);
+
+	/* same into a descriptor at its current offset */
+	uint64_t copyUnpadded(std::istream & input, int outFd, uint64_t size, uint64_t written = 0);
+
+	/* piece of a member made of several pieces (sparse file data): nothing is padded or skipped, */
+	/* the caller pads after the last one; a descriptor which ends early gives zeros like copyPadded */
+	uint64_t copyPiece(int inFd, std::ostream & output, uint64_t size);
+
+	uint64_t copyPiece(std::istream & input, int outFd, uint64_t size);
+
+	/* buffered copy from inFd at inOffset to the current offset of outFd */
+	/* returns count of bytes written to outFd */
+	uint64_t copyRange(int inFd, uint64_t inOffset, int outFd, uint64_t size);
+
+	/* copy from inFd at inOffset to outFd at outOffset, file offset of inFd is not used */
+	/* and file offset of outFd is left undefined */
+	/* returns count of bytes moved, less than size when the kernel refuses */
+	uint64_t copyKernel(int inFd, uint64_t inOffset, int outFd, uint64_t outOffset, uint64_t size);
+
+	/* share the whole clone blocks of size bytes from inFd at inOffset with outFd at outOffset */
+	/* (FICLONERANGE), both offsets must be on a clone block; the tail is left to a copy */
+	/* returns count of bytes cloned, 0 when misaligned or the filesystem can't */
+	uint64_t cloneRange(int inFd, uint64_t inOffset, int outFd, uint64_t outOffset, uint64_t size);
+
+	/* zeros after a member of memberSize bytes */
+	static bool writePadding(std::ostream & output, uint64_t memberSize);
+
+	static uint64_t alignToBlock(uint64_t size);
+};
@@ -0,0 +1,259 @@
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+
+#include "ChunkStore.h"
+
+/* key, offset, size */
+#define RECORD_SIZE 28
+
+static void
+putNumber(std::vector<char> & output, uint64_t value, size_t bytes)
+{
+	for (size_t i = 0; i < bytes; ++i)
+	{
+		output.push_back((char)(value >> (8 * i)));
+	}
+}
+
+static uint64_t
+getNumber(const uint8_t * input, size_t bytes)
+{
+	uint64_t value = 0;
+	for (size_t i = 0; i < bytes; ++i)
+	{
+		value |= (uint64_t)input[i] << (8 * i);
+	}
+	return value;
+}
+
+static bool
+writeAll(int fd, const char * data, size_t size)
+{
+	while (size > 0)
+	{
+		ssize_t n = write(fd, data, size);
+		if (n <= 0)
+		{
+			if (n == -1 && errno == EINTR)
+			{
+				continue;
+			}
+			return false;
+		}
+		data += n;
+		size -= n;
+	}
+	return true;
+}
+
+ChunkStore::~ChunkStore()
+{
+	close();
+}
+
+bool
+ChunkStore::open(const std::string & path, bool writable)
+{
+	close();
+
+	this->path = path;
+	this->writable = writable;
+	failed = false;
+
+	if (writable)
+	{
+		mkdir(path.c_str(), 0777);
+	}
+
+	int flags = writable ? O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC : O_RDONLY | O_CLOEXEC;
+	indexFd = ::open((path + "/" DEDUP_STORE_INDEX).c_str(), flags, 0666);
+	dataFd = ::open((path + "/" DEDUP_STORE_DATA).c_str(), flags, 0666);
+	if (indexFd == -1 || dataFd == -1)
+	{
+		close();
+		return false;
+	}
+
+	if (flock(indexFd, writable ? LOCK_EX : LOCK_SH))
+	{
+		close();
+		return false;
+	}
+
+	if (!loadIndex())
+	{
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+bool
+ChunkStore::loadIndex()
+{
+	struct stat s;
+	if (fstat(dataFd, &s))
+	{
+		return false;
+	}
+	dataSize = flushedSize = s.st_size;
+
+	std::vector<uint8_t> records;
+	uint8_t buffer[64 * 1024];
+	uint64_t offset = 0;
+	for (;;)
+	{
+		ssize_t n = pread(indexFd, buffer, sizeof(buffer), offset);
+		if (n < 0)
+		{
+			return false;
+		}
+		if (n == 0)
+		{
+			break;
+		}
+		records.insert(records.end(), buffer, buffer + n);
+		offset += n;
+	}
+
+	if (records.empty())
+	{
+		/* new store */
+		if (!writable)
+		{
+			return false;
+		}
+		return writeAll(indexFd, DEDUP_STORE_MAGIC, DEDUP_STORE_MAGLEN);
+	}
+
+	if (records.size() < DEDUP_STORE_MAGLEN || std::memcmp(records.data(), DEDUP_STORE_MAGIC, DEDUP_STORE_MAGLEN))
+	{
+		printf("%s is not a chunk store.\n", path.c_str());
+		return false;
+	}
+
+	for (size_t pos = DEDUP_STORE_MAGLEN; pos + RECORD_SIZE <= records.size(); pos += RECORD_SIZE)
+	{
+		ChunkKey key;
+		key.low = getNumber(&records[pos], 8);
+		key.high = getNumber(&records[pos + 8], 8);
+
+		Location location;
+		location.offset = getNumber(&records[pos + 16], 8);
+		location.size = (uint32_t)getNumber(&records[pos + 24], 4);
+
+		if (location.offset + location.size > dataSize)
+		{
+			/* data never reached the disk */
+			continue;
+		}
+		chunks.emplace(key, location);
+	}
+
+	return true;
+}
+
+bool
+ChunkStore::close()
+{
+	bool result = flush();
+
+	if (dataFd != -1)
+	{
+		::close(dataFd);
+		dataFd = -1;
+	}
+	if (indexFd != -1)
+	{
+		/* lock goes with the descriptor */
+		::close(indexFd);
+		indexFd = -1;
+	}
+
+	chunks.clear();
+	dataSize = flushedSize = 0;
+	return result;
+}
+
+bool
+ChunkStore::flush()
+{
+	if (pendingData.empty() && pendingIndex.empty())
+	{
+		return !failed;
+	}
+
+	/* data first: a record never points to bytes which are not there */
+	if (!writeAll(dataFd, pendingData.data(), pendingData.size()) ||
+		!writeAll(indexFd, pendingIndex.data(), pendingIndex.size()))
+	{
+		failed = true;
+	}
+
+	flushedSize = dataSize;
+	pendingData.clear();
+	pendingIndex.clear();
+	return !failed;
+}
+
+bool
+ChunkStore::put(const ChunkKey & key, const char * data, size_t size)
+{
+	if (!writable || chunks.count(key))
+	{
+		return false;
+	}
+
+	Location location;
+	location.offset = dataSize;
+	location.size = (uint32_t)size;
+	chunks.emplace(key, location);
+
+	pendingData.insert(pendingData.end(), data, data + size);
+	putNumber(pendingIndex, key.low, 8);
+	putNumber(pendingIndex, key.high, 8);
+	putNumber(pendingIndex, location.offset, 8);
+	putNumber(pendingIndex, location.size, 4);
+	dataSize += size;
+
+	if (pendingData.size() >= DEDUP_WRITE_SIZE)
+	{
+		flush();
+	}
+
+	return true;
+}
+
+bool
+ChunkStore::get(const ChunkKey & key, std::vector<char> & data)
+{
+	auto it = chunks.find(key);
+	if (it == chunks.end())
+	{
+		return false;
+	}
+
+	const Location & location = it->second;
+	if (location.offset + location.size > flushedSize && !flush())
+	{
+		return false;
+	}
+
+	data.resize(location.size);
+	size_t got = 0;
+	while (got < location.size)
+	{
+		ssize_t n = pread(dataFd, data.data() + got, location.size - got, location.offset + got);
+		if (n <= 0)
+		{
+			return false;
+		}
+		got += n;
+	}
+
+	return true;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <unordered_map>
+
+#include "Chunker.h"
+
+/* files inside the store directory */
+#define DEDUP_STORE_DATA "chunks.dat"
+#define DEDUP_STORE_INDEX "chunks.idx"
+#define DEDUP_STORE_MAGIC "TARCHK1\n"
+#define DEDUP_STORE_MAGLEN 8
+
+/* new chunks are written when this much is pending */
+#define DEDUP_WRITE_SIZE (4 * 1024 * 1024)
+
+/*
+	Local content addressed chunk store: a directory with all chunk bytes
+	appended to chunks.dat and records of key (16 bytes), offset (8) and
+	size (4) appended to chunks.idx after the magic. Data goes to disk before
+	its index records, a record past the end of the data (crash in between) is
+	dropped on open. The whole index is kept in memory.
+	One writer at a time: it holds an exclusive flock, readers a shared one.
+*/
+class ChunkStore
+{
+private:
+	struct Location
+	{
+		uint64_t offset;
+		uint32_t size;
+	};
+
+	std::string path;
+	int dataFd = -1;
+	int indexFd = -1;
+	bool writable = false;
+	bool failed = false;
+	std::unordered_map<ChunkKey, Location, ChunkKeyHash> chunks;
+	uint64_t dataSize = 0;		/* chunks.dat with pendingData */
+	uint64_t flushedSize = 0;	/* chunks.dat on disk */
+	std::vector<char> pendingData;
+	std::vector<char> pendingIndex;
+
+	bool loadIndex();
+
+public:
+	ChunkStore() {};
+	~ChunkStore();
+
+	ChunkStore(const ChunkStore &) = delete;
+	ChunkStore & operator=(const ChunkStore &) = delete;
+
+	/* writable store directory is created when missing */
+	bool open(const std::string & path, bool writable);
+
+	/* write pending chunks, close files */
+	bool close();
+
+	/* write pending chunks and their records, false if any write failed */
+	bool flush();
+
+	/* store chunk unless its key is known, true if it was new */
+	bool put(const ChunkKey & key, const char * data, size_t size);
+
+	/* bytes of chunk, false if the key is unknown or reading failed */
+	bool get(const ChunkKey & key, std::vector<char> & data);
+
+	bool contains(const ChunkKey & key) const { return chunks.count(key) != 0; }
+
+	size_t count() const { return chunks.size(); }
+
+	uint64_t storedBytes() const { return dataSize; }
+};
@@ -0,0 +1,150 @@
+#include "Chunker.h"
+
+/* fastcdc masks for 8 KiB average, 15 and 11 bits spread over the upper half */
+#define MASK_SMALL 0x0000d9f003530000ULL
+#define MASK_LARGE 0x0000d90003530000ULL
+
+struct GearTable
+{
+	uint64_t values[256];
+
+	GearTable()
+	{
+		/* splitmix64 from a fixed seed */
+		uint64_t state = 0x2545f4914f6cdd1dULL;
+		for (int i = 0; i < 256; ++i)
+		{
+			state += 0x9e3779b97f4a7c15ULL;
+			uint64_t z = state;
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+			values[i] = z ^ (z >> 31);
+		}
+	}
+};
+
+static const GearTable gear;
+
+size_t
+Chunker::cut(const uint8_t * data, size_t size)
+{
+	if (size <= DEDUP_MIN_CHUNK)
+	{
+		return size;
+	}
+	if (size > DEDUP_MAX_CHUNK)
+	{
+		size = DEDUP_MAX_CHUNK;
+	}
+
+	size_t normal = size < DEDUP_AVG_CHUNK ? size : DEDUP_AVG_CHUNK;
+	uint64_t fingerprint = 0;
+	size_t i = DEDUP_MIN_CHUNK;
+
+	for (; i < normal; ++i)
+	{
+		fingerprint = (fingerprint << 1) + gear.values[data[i]];
+		if (!(fingerprint & MASK_SMALL))
+		{
+			return i + 1;
+		}
+	}
+
+	for (; i < size; ++i)
+	{
+		fingerprint = (fingerprint << 1) + gear.values[data[i]];
+		if (!(fingerprint & MASK_LARGE))
+		{
+			return i + 1;
+		}
+	}
+
+	return size;
+}
+
+static inline uint64_t
+rotl64(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t
+fmix64(uint64_t k)
+{
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdULL;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ULL;
+	k ^= k >> 33;
+	return k;
+}
+
+ChunkKey
+Chunker::hash(const void * data, size_t size)
+{
+	const uint8_t * bytes = (const uint8_t*)data;
+	const size_t blocks = size / 16;
+	const uint64_t c1 = 0x87c37b91114253d5ULL;
+	const uint64_t c2 = 0x4cf5ad432745937fULL;
+
+	uint64_t h1 = 0;
+	uint64_t h2 = 0;
+
+	for (size_t i = 0; i < blocks; ++i)
+	{
+		uint64_t k1, k2;
+		std::memcpy(&k1, bytes + i * 16, 8);
+		std::memcpy(&k2, bytes + i * 16 + 8, 8);
+
+		k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+		h1 = rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+
+		k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+		h2 = rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+	}
+
+	const uint8_t * tail = bytes + blocks * 16;
+	uint64_t k1 = 0;
+	uint64_t k2 = 0;
+
+	switch (size & 15)
+	{
+	case 15: k2 ^= (uint64_t)tail[14] << 48;	/* fall through */
+	case 14: k2 ^= (uint64_t)tail[13] << 40;	/* fall through */
+	case 13: k2 ^= (uint64_t)tail[12] << 32;	/* fall through */
+	case 12: k2 ^= (uint64_t)tail[11] << 24;	/* fall through */
+	case 11: k2 ^= (uint64_t)tail[10] << 16;	/* fall through */
+	case 10: k2 ^= (uint64_t)tail[9] << 8;		/* fall through */
+	case 9:
+		k2 ^= (uint64_t)tail[8];
+		k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+		/* fall through */
+	case 8: k1 ^= (uint64_t)tail[7] << 56;		/* fall through */
+	case 7: k1 ^= (uint64_t)tail[6] << 48;		/* fall through */
+	case 6: k1 ^= (uint64_t)tail[5] << 40;		/* fall through */
+	case 5: k1 ^= (uint64_t)tail[4] << 32;		/* fall through */
+	case 4: k1 ^= (uint64_t)tail[3] << 24;		/* fall through */
+	case 3: k1 ^= (uint64_t)tail[2] << 16;		/* fall through */
+	case 2: k1 ^= (uint64_t)tail[1] << 8;		/* fall through */
+	case 1:
+		k1 ^= (uint64_t)tail[0];
+		k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+		break;
+	default:
+		break;
+	}
+
+	h1 ^= size;
+	h2 ^= size;
+	h1 += h2;
+	h2 += h1;
+	h1 = fmix64(h1);
+	h2 = fmix64(h2);
+	h1 += h2;
+	h2 += h1;
+
+	ChunkKey key;
+	key.low = h1;
+	key.high = h2;
+	return key;
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include "../TarCommon.h"
+
+/* content defined chunk sizes, average is where the cut mask gets easier */
+#define DEDUP_MIN_CHUNK (2 * 1024)
+#define DEDUP_AVG_CHUNK (8 * 1024)
+#define DEDUP_MAX_CHUNK (64 * 1024)
+
+/* 128 bit content address of a chunk */
+struct ChunkKey
+{
+	uint64_t low = 0;
+	uint64_t high = 0;
+
+	bool operator==(const ChunkKey & other) const { return low == other.low && high == other.high; }
+};
+
+struct ChunkKeyHash
+{
+	size_t operator()(const ChunkKey & key) const { return (size_t)key.low; }
+};
+
+/*
+	FastCDC: gear rolling hash over the bytes, a cut where its top bits are zero.
+	Before the average size a mask with more bits makes cuts rarer, after it one
+	with fewer bits makes them likelier (normalized chunking), so sizes stay near
+	the average. Cuts depend only on the content around them: an insertion moves
+	the chunks after it, it does not change them.
+	Gear table and masks are part of the store format, they must never change.
+*/
+class Chunker
+{
+public:
+	/* length of the next chunk at data; size itself if no cut is found before it */
+	/* a stream has to give at least DEDUP_MAX_CHUNK bytes unless it ends there */
+	static size_t cut(const uint8_t * data, size_t size);
+
+	/* MurmurHash3 x64 128: fast, not cryptographic */
+	static ChunkKey hash(const void * data, size_t size);
+};
@@ -0,0 +1,225 @@
+#include "DedupStreamBuf.h"
+
+static void
+putNumber(std::ostream & output, uint64_t value, size_t bytes)
+{
+	char buf[8];
+	for (size_t i = 0; i < bytes; ++i)
+	{
+		buf[i] = (char)(value >> (8 * i));
+	}
+	output.write(buf, bytes);
+}
+
+static bool
+getNumber(std::istream & input, size_t bytes, uint64_t & value)
+{
+	uint8_t buf[8] = { 0 };
+	input.read((char*)buf, bytes);
+
+	value = 0;
+	for (size_t i = 0; i < bytes; ++i)
+	{
+		value |= (uint64_t)buf[i] << (8 * i);
+	}
+	return (size_t)input.gcount() == bytes;
+}
+
+DedupStreamBuf::DedupStreamBuf(std::ostream & output, ChunkStore & store)
+	: output(output), store(store), buffer(DEDUP_BUFFER_SIZE)
+{
+	output.write(DEDUP_MAGIC, DEDUP_MAGLEN);
+	setp(buffer.data(), buffer.data() + buffer.size());
+}
+
+void
+DedupStreamBuf::emit(const char * data, size_t size)
+{
+	streamBytes += size;
+
+	if (size < DEDUP_MIN_CHUNK)
+	{
+		output.put(DEDUP_LITERAL);
+		putNumber(output, size, 4);
+		output.write(data, size);
+		return;
+	}
+
+	ChunkKey key = Chunker::hash(data, size);
+	if (store.put(key, data, size))
+	{
+		newChunks++;
+		newBytes += size;
+	}
+	chunkCount++;
+
+	output.put(DEDUP_CHUNK);
+	putNumber(output, key.low, 8);
+	putNumber(output, key.high, 8);
+	putNumber(output, size, 4);
+}
+
+void
+DedupStreamBuf::cutBuffer(bool all)
+{
+	const char * data = pbase();
+	const size_t size = pptr() - pbase();
+	size_t pos = 0;
+
+	while (size - pos >= DEDUP_MAX_CHUNK || (all && pos < size))
+	{
+		size_t length = Chunker::cut((const uint8_t*)data + pos, size - pos);
+		emit(data + pos, length);
+		pos += length;
+	}
+
+	/* tail to the front, the chunker sees it again with more bytes */
+	size_t tail = size - pos;
+	std::memmove(buffer.data(), data + pos, tail);
+	setp(buffer.data(), buffer.data() + buffer.size());
+	pbump((int)tail);
+
+	if (!output)
+	{
+		failed = true;
+	}
+}
+
+DedupStreamBuf::int_type
+DedupStreamBuf::overflow(int_type c)
+{
+	if (failed || finished)
+	{
+		return traits_type::eof();
+	}
+
+	cutBuffer(false);
+
+	if (!traits_type::eq_int_type(c, traits_type::eof()))
+	{
+		*pptr() = traits_type::to_char_type(c);
+		pbump(1);
+	}
+
+	return failed ? traits_type::eof() : traits_type::not_eof(c);
+}
+
+void
+DedupStreamBuf::markBoundary()
+{
+	if (!failed && !finished)
+	{
+		cutBuffer(true);
+	}
+}
+
+bool
+DedupStreamBuf::finish()
+{
+	if (!finished)
+	{
+		markBoundary();
+		finished = true;
+
+		output.put(DEDUP_END);
+		putNumber(output, streamBytes, 8);
+		output.flush();
+
+		if (!store.flush() || !output)
+		{
+			failed = true;
+		}
+	}
+
+	return !failed;
+}
+
+RehydrateStreamBuf::RehydrateStreamBuf(std::istream & input, ChunkStore & store)
+	: input(input), store(store)
+{
+}
+
+RehydrateStreamBuf::int_type
+RehydrateStreamBuf::underflow()
+{
+	if (gptr() < egptr())
+	{
+		return traits_type::to_int_type(*gptr());
+	}
+
+	if (failed || ended)
+	{
+		return traits_type::eof();
+	}
+
+	if (!started)
+	{
+		char magic[DEDUP_MAGLEN];
+		input.read(magic, DEDUP_MAGLEN);
+		if (input.gcount() != DEDUP_MAGLEN || std::memcmp(magic, DEDUP_MAGIC, DEDUP_MAGLEN))
+		{
+			failed = true;
+			return traits_type::eof();
+		}
+		started = true;
+	}
+
+	int record = input.get();
+	uint64_t size = 0;
+	switch (record)
+	{
+	case DEDUP_LITERAL:
+	{
+		if (!getNumber(input, 4, size))
+		{
+			failed = true;
+			break;
+		}
+
+		buffer.resize(size);
+		input.read(buffer.data(), size);
+		failed = (uint64_t)input.gcount() != size;
+	}
+	break;
+
+	case DEDUP_CHUNK:
+	{
+		ChunkKey key;
+		if (!getNumber(input, 8, key.low) || !getNumber(input, 8, key.high) || !getNumber(input, 4, size))
+		{
+			failed = true;
+			break;
+		}
+
+		if (!store.get(key, buffer) || buffer.size() != size || !(Chunker::hash(buffer.data(), size) == key))
+		{
+			printf("Chunk %016llx%016llx is missing or damaged.\n",
+				(unsigned long long)key.high, (unsigned long long)key.low);
+			failed = true;
+		}
+	}
+	break;
+
+	case DEDUP_END:
+	{
+		failed = !getNumber(input, 8, size) || size != streamBytes;
+		ended = true;
+	}
+	break;
+
+	default:
+		failed = true;
+		break;
+	}
+
+	if (failed || ended)
+	{
+		return traits_type::eof();
+	}
+
+	streamBytes += buffer.size();
+	setg(buffer.data(), buffer.data(), buffer.data() + buffer.size());
+
+	/* empty literal: read on */
+	return buffer.empty() ? underflow() : traits_type::to_int_type(*gptr());
+}
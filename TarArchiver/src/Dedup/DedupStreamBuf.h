@@ -0,0 +1,94 @@
+#pragma once
+#include <streambuf>
+
+#include "ChunkStore.h"
+
+/* manifest written in place of archive: <name>.tar.dedup */
+#define DEDUP_SUFFIX ".dedup"
+#define DEDUP_MAGIC "TARDDP1\n"
+#define DEDUP_MAGLEN 8
+
+/* manifest records */
+#define DEDUP_LITERAL 'L'	/* length (4 bytes) and bytes, for pieces below DEDUP_MIN_CHUNK */
+#define DEDUP_CHUNK 'C'		/* key (16 bytes) and length (4 bytes) of a chunk in the store */
+#define DEDUP_END 'E'		/* length of the whole tar stream (8 bytes) */
+
+/* tar bytes held for the chunker, several chunks at least */
+#define DEDUP_BUFFER_SIZE (1024 * 1024)
+
+/*
+	Output stream buffer which turns a tar stream into a manifest.
+	Bytes are cut by Chunker, chunks go to the store once and the manifest
+	refers to them by key; pieces smaller than a chunk, like headers, stay in
+	the manifest as literals. markBoundary cuts at once, TarPacker calls it
+	around every header, so payloads are chunked from their own start and a
+	file dedups whatever precedes it in the archive.
+*/
+class DedupStreamBuf : public std::streambuf
+{
+private:
+	std::ostream & output;
+	ChunkStore & store;
+	std::vector<char> buffer;
+	bool failed = false;
+	bool finished = false;
+
+	uint64_t streamBytes = 0;
+	size_t chunkCount = 0;
+	size_t newChunks = 0;
+	uint64_t newBytes = 0;
+
+	/* write chunks from buffer, a tail shorter than the biggest chunk waits for more unless all */
+	void cutBuffer(bool all);
+
+	void emit(const char * data, size_t size);
+
+protected:
+	int_type overflow(int_type c) override;
+
+public:
+	DedupStreamBuf(std::ostream & output, ChunkStore & store);
+
+	/* chunk the rest, end the manifest; false if anything failed */
+	bool finish();
+
+	/* next bytes start a new piece */
+	void markBoundary();
+
+	uint64_t totalBytes() const { return streamBytes; }
+
+	size_t chunks() const { return chunkCount; }
+
+	size_t storedChunks() const { return newChunks; }
+
+	uint64_t storedBytes() const { return newBytes; }
+};
+
+/*
+	Input stream buffer which reads a manifest back as the tar stream,
+	chunks are taken from the store and checked against their keys.
+	Forward only like DecompressStreamBuf.
+*/
+class RehydrateStreamBuf : public std::streambuf
+{
+private:
+	std::istream & input;
+	ChunkStore & store;
+	std::vector<char> buffer;
+	bool started = false;
+	bool ended = false;
+	bool failed = false;
+	uint64_t streamBytes = 0;
+
+protected:
+	int_type underflow() override;
+
+public:
+	RehydrateStreamBuf(std::istream & input, ChunkStore & store);
+
+	/* broken manifest, missing or corrupt chunk */
+	bool bad() const { return failed; }
+
+	/* whole stream was read and its length matched */
+	bool complete() const { return ended && !failed; }
+};
@@ -0,0 +1,276 @@
+#include "HeaderCodec.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define HEADER_CODEC_X86
+#include <immintrin.h>
+#endif
+
+typedef uint64_t (*SumFunction)(const uint8_t * bytes);
+
+static uint64_t
+sumBytes(const uint8_t * bytes)
+{
+	uint64_t result = 0;
+	for (size_t i = 0; i < BLOCK_SIZE; ++i)
+	{
+		result += bytes[i];
+	}
+	return result;
+}
+
+#ifdef HEADER_CODEC_X86
+/* psadbw against zero adds 8 bytes into one 64 bit lane */
+__attribute__((target("sse2"))) static uint64_t
+sumSse2(const uint8_t * bytes)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i total = zero;
+	for (size_t i = 0; i < BLOCK_SIZE; i += 16)
+	{
+		__m128i data = _mm_loadu_si128((const __m128i*)(bytes + i));
+		total = _mm_add_epi64(total, _mm_sad_epu8(data, zero));
+	}
+
+	return (uint64_t)_mm_cvtsi128_si64(total) + (uint64_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(total, total));
+}
+
+__attribute__((target("avx2"))) static uint64_t
+sumAvx2(const uint8_t * bytes)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i total = zero;
+	for (size_t i = 0; i < BLOCK_SIZE; i += 32)
+	{
+		__m256i data = _mm256_loadu_si256((const __m256i*)(bytes + i));
+		total = _mm256_add_epi64(total, _mm256_sad_epu8(data, zero));
+	}
+
+	__m128i half = _mm_add_epi64(_mm256_castsi256_si128(total), _mm256_extracti128_si256(total, 1));
+	return (uint64_t)_mm_cvtsi128_si64(half) + (uint64_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(half, half));
+}
+#endif
+
+static SumFunction
+selectSum(const char ** name)
+{
+#ifdef HEADER_CODEC_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+	{
+		*name = "avx2";
+		return sumAvx2;
+	}
+	if (__builtin_cpu_supports("sse2"))
+	{
+		*name = "sse2";
+		return sumSse2;
+	}
+#endif
+	*name = "scalar";
+	return sumBytes;
+}
+
+static const char * sumFunctionName = nullptr;
+
+static SumFunction
+sumFunction()
+{
+	static const SumFunction function = selectSum(&sumFunctionName);
+	return function;
+}
+
+uint64_t
+HeaderCodec::sum(const void * block)
+{
+	return sumFunction()((const uint8_t*)block);
+}
+
+uint64_t
+HeaderCodec::sumScalar(const void * block)
+{
+	return sumBytes((const uint8_t*)block);
+}
+
+const char *
+HeaderCodec::sumName()
+{
+	sumFunction();
+	return sumFunctionName;
+}
+
+uint64_t
+HeaderCodec::checksum(const PosixHeader & header)
+{
+	uint64_t result = sum(&header) + 8 * ' ';
+
+	const uint8_t * field = reinterpret_cast<const uint8_t *>(header.chksum);
+	for (size_t i = 0; i < sizeof(header.chksum); ++i)
+	{
+		result -= field[i];
+	}
+
+	return result;
+}
+
+/* digits of one 8 byte word, first byte most significant; count gets number of leading digits */
+static uint64_t
+parseOctalWord(uint64_t word, size_t * count)
+{
+	/* high bit of every byte which is not '0'..'7' */
+	uint64_t other = (word & 0xf8f8f8f8f8f8f8f8ull) ^ 0x3030303030303030ull;
+	other = (other | ((other & 0x7f7f7f7f7f7f7f7full) + 0x7f7f7f7f7f7f7f7full)) & 0x8080808080808080ull;
+
+	size_t digits = other ? __builtin_ctzll(other) / 8 : 8;
+	*count = digits;
+	if (!digits)
+	{
+		return 0;
+	}
+
+	/* last digit goes to the top byte, then bytes, pairs and quads are merged */
+	uint64_t value = (word & 0x0707070707070707ull) << (8 * (8 - digits));
+	value = ((value & 0x00ff00ff00ff00ffull) << 3) + ((value >> 8) & 0x00ff00ff00ff00ffull);
+	value = ((value & 0x0000ffff0000ffffull) << 6) + ((value >> 16) & 0x0000ffff0000ffffull);
+	return ((value & 0xffffffffull) << 12) + (value >> 32);
+}
+
+uint64_t
+HeaderCodec::parseOctal(const int8_t * field, size_t length)
+{
+	const uint8_t * bytes = reinterpret_cast<const uint8_t *>(field);
+
+	if (bytes[0] & 0x80)
+	{
+		/* base-256, big endian, for values without room in octal */
+		if (bytes[0] & 0x40)
+		{
+			return HEADER_NUMBER_BAD;
+		}
+		uint64_t value = bytes[0] & 0x3f;
+		for (size_t i = 1; i < length; ++i)
+		{
+			if (value >> 55)
+			{
+				return HEADER_NUMBER_BAD;
+			}
+			value = (value << 8) | bytes[i];
+		}
+		return value;
+	}
+
+	/* old archives pad with leading spaces */
+	size_t i = 0;
+	while (i < length && bytes[i] == ' ')
+	{
+		++i;
+	}
+
+#if defined(__GNUC__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	/* 8 digits at a time, number ends at the first byte which is not a digit */
+	uint64_t value = 0;
+	while (i < length)
+	{
+		uint64_t word = 0;
+		size_t part = length - i < 8 ? length - i : 8;
+		std::memcpy(&word, bytes + i, part);
+
+		size_t digits;
+		uint64_t wordValue = parseOctalWord(word, &digits);
+		value = digits ? (value << (3 * digits)) | wordValue : value;
+
+		if (digits < 8)
+		{
+			break;
+		}
+		i += 8;
+	}
+	return value;
+#else
+	uint64_t value = 0;
+	for (; i < length && bytes[i] >= '0' && bytes[i] <= '7'; ++i)
+	{
+		value = value * 8 + (bytes[i] - '0');
+	}
+	return value;
+#endif
+}
+
+bool
+HeaderCodec::toOctal(uint64_t value, int8_t * field, size_t length)
+{
+	field[length - 1] = '\0';
+	for (size_t i = length - 1; i-- > 0;)
+	{
+		field[i] = (int8_t)('0' + (value & 7));
+		value >>= 3;
+	}
+
+	return value == 0;
+}
+
+void
+HeaderCodec::toBase256(uint64_t value, int8_t * field, size_t length)
+{
+	for (size_t i = length; i-- > 1;)
+	{
+		field[i] = (int8_t)(value & 0xff);
+		value >>= 8;
+	}
+	field[0] = (int8_t)0x80;
+}
+
+void
+HeaderCodec::decode(const PosixHeader & header, HeaderInfo & headerInfo)
+{
+	headerInfo.name = text(header.name, sizeof(header.name));
+	headerInfo.mode = parseOctal(header.mode, sizeof(header.mode));
+	headerInfo.uid = parseOctal(header.uid, sizeof(header.uid));
+	headerInfo.gid = parseOctal(header.gid, sizeof(header.gid));
+	headerInfo.size = parseOctal(header.size, sizeof(header.size));
+	headerInfo.mtime = parseOctal(header.mtime, sizeof(header.mtime));
+	headerInfo.checksum = parseOctal(header.chksum, sizeof(header.chksum));
+	headerInfo.typeflag = header.typeflag;
+	headerInfo.linkname = text(header.linkname, sizeof(header.linkname));
+	headerInfo.magic = text(header.magic, sizeof(header.magic));
+	headerInfo.version = text(header.version, sizeof(header.version));
+	headerInfo.uname = text(header.uname, sizeof(header.uname));
+	headerInfo.gname = text(header.gname, sizeof(header.gname));
+	headerInfo.devmajor = parseOctal(header.devmajor, sizeof(header.devmajor));
+	headerInfo.devminor = parseOctal(header.devminor, sizeof(header.devminor));
+	headerInfo.prefix = text(header.prefix, sizeof(header.prefix));
+
+	headerInfo.blockCount = headerInfo.size / BLOCK_SIZE;
+	headerInfo.reminderBytes = headerInfo.size % BLOCK_SIZE;
+	if (headerInfo.reminderBytes)
+	{
+		headerInfo.blockCount++;
+	}
+}
+
+bool
+HeaderCodec::dropRoot(std::string_view & name)
+{
+	size_t slashes = 0;
+	while (slashes < name.length() && name[slashes] == '/')
+	{
+		++slashes;
+	}
+
+	name.remove_prefix(slashes);
+	return slashes != 0;
+}
+
+bool
+HeaderCodec::joinPrefix(HeaderInfo & headerInfo, std::string & storage)
+{
+	if (headerInfo.prefix.empty() || headerInfo.magic != PAXMAGIC)
+	{
+		return false;
+	}
+
+	storage.assign(headerInfo.prefix);
+	storage += '/';
+	storage.append(headerInfo.name);
+	headerInfo.name = storage;
+	return true;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "../TarCommon.h"
+
+/* base-256 field which is negative or does not fit in 63 bits */
+#define HEADER_NUMBER_BAD UINT64_MAX
+
+/*
+	Numeric fields and checksum of a ustar header block.
+	Sum of the block uses AVX2 or SSE2 when the cpu has them (checked once at
+	first call), plain loop otherwise. Octal fields are fixed width: encoder
+	writes every digit without division, decoder takes 8 digits per step.
+*/
+class HeaderCodec
+{
+public:
+	/* unsigned sum of BLOCK_SIZE bytes */
+	static uint64_t sum(const void * block);
+
+	static uint64_t sumScalar(const void * block);
+
+	/* "avx2", "sse2" or "scalar" */
+	static const char * sumName();
+
+	/* header checksum, chksum field counted as 8 spaces */
+	static uint64_t checksum(const PosixHeader & header);
+
+	/* leading spaces are skipped, number ends at first other byte; base-256 (GNU) too, */
+	/* HEADER_NUMBER_BAD when it has no room in int64_t */
+	static uint64_t parseOctal(const int8_t * field, size_t length);
+
+	/* text field up to its NUL, a full field has none */
+	static std::string_view text(const int8_t * field, size_t length)
+	{
+		return std::string_view((const char*)field, strnlen((const char*)field, length));
+	}
+
+	/* length - 1 zero padded digits and NUL, false if value does not fit */
+	static bool toOctal(uint64_t value, int8_t * field, size_t length);
+
+	/* big endian with the high bit of the first byte set, as GNU tar writes what octal can't hold */
+	static void toBase256(uint64_t value, int8_t * field, size_t length);
+
+	/* fields of header, text ones view into it */
+	static void decode(const PosixHeader & header, HeaderInfo & headerInfo);
+
+	/* ustar name with its directories in prefix is put together in storage, */
+	/* false if there is no prefix (gnu headers use the field for other things) */
+	static bool joinPrefix(HeaderInfo & headerInfo, std::string & storage);
+
+	/* leading '/' of an absolute name is dropped, as by gnu tar; true if there was one */
+	static bool dropRoot(std::string_view & name);
+};
@@ -0,0 +1,293 @@
+#include <sys/stat.h>
+#include <algorithm>
+
+#include "ArchiveIndex.h"
+
+/* numbers are stored little endian */
+static void
+putNumber(std::ostream & output, uint64_t value, size_t bytes)
+{
+	char buf[8];
+	for (size_t i = 0; i < bytes; ++i)
+	{
+		buf[i] = (char)(value >> (8 * i));
+	}
+	output.write(buf, bytes);
+}
+
+static uint64_t
+getNumber(std::istream & input, size_t bytes)
+{
+	uint8_t buf[8] = { 0 };
+	input.read((char*)buf, bytes);
+
+	uint64_t value = 0;
+	for (size_t i = 0; i < bytes; ++i)
+	{
+		value |= (uint64_t)buf[i] << (8 * i);
+	}
+	return value;
+}
+
+void
+ArchiveIndex::insert(const std::string & name, const IndexEntry & entry)
+{
+	/* later copy of a member wins, as on extraction */
+	auto it = byName.find(name);
+	if (it != byName.end())
+	{
+		entries[it->second].second = entry;
+		return;
+	}
+
+	byName.emplace(name, entries.size());
+	entries.emplace_back(name, entry);
+}
+
+void
+ArchiveIndex::add(std::string_view name, int8_t typeflag, uint64_t size, int64_t mtime)
+{
+	IndexEntry entry;
+	entry.offset = memberOffset;
+	entry.extended = nextOffset - memberOffset;
+	entry.size = size;
+	entry.mtime = mtime;
+	entry.typeflag = typeflag;
+
+	insert(std::string(name), entry);
+	nextOffset += BLOCK_SIZE + (size + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+	memberOffset = nextOffset;
+}
+
+void
+ArchiveIndex::addExtended(uint64_t size)
+{
+	nextOffset += BLOCK_SIZE + (size + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+}
+
+const IndexEntry *
+ArchiveIndex::find(std::string_view name) const
+{
+	auto it = byName.find(name);
+	if (it == byName.end())
+	{
+		it = byName.find(std::string(name) + '/');
+	}
+
+	return it == byName.end() ? nullptr : &entries[it->second].second;
+}
+
+const FrameEntry *
+ArchiveIndex::frameAt(uint64_t offset) const
+{
+	auto it = std::upper_bound(frameTable.begin(), frameTable.end(), offset,
+		[](uint64_t value, const FrameEntry & frame) { return value < frame.uncompressedOffset; });
+
+	return it == frameTable.begin() ? nullptr : &*(it - 1);
+}
+
+void
+ArchiveIndex::clear()
+{
+	entries.clear();
+	byName.clear();
+	frameTable.clear();
+	nextOffset = 0;
+	memberOffset = 0;
+}
+
+bool
+ArchiveIndex::build(const ArchiveReader & reader)
+{
+	clear();
+
+	PaxHeader extended;
+	PaxHeader global;
+	std::string prefixedName;
+	for (const ArchiveEntry & member : reader)
+	{
+		const PosixHeader & header = *member.header;
+		nextOffset = member.next;
+
+		/* records go to the member after them, which is found at its first pax header */
+		if (PaxHeader::isPaxType(header.typeflag))
+		{
+			PaxHeader & records = header.typeflag == XGLTYPE ? global : extended;
+			records.data().assign((const char*)member.data, member.size);
+			records.parse(header.typeflag == XGLTYPE);
+			if (header.typeflag == XGLTYPE)
+			{
+				memberOffset = nextOffset;
+			}
+			continue;
+		}
+
+		/* names as the unpacker makes them, --member is looked up by those */
+		HeaderInfo headerInfo;
+		HeaderCodec::decode(header, headerInfo);
+		HeaderCodec::joinPrefix(headerInfo, prefixedName);
+		global.apply(headerInfo);
+		extended.apply(headerInfo);
+		HeaderCodec::dropRoot(headerInfo.name);
+
+		IndexEntry entry;
+		entry.offset = memberOffset;
+		entry.extended = member.offset - memberOffset;
+		entry.size = member.size;
+		entry.mtime = headerInfo.mtime;
+		entry.typeflag = header.typeflag;
+
+		insert(std::string(headerInfo.name), entry);
+		memberOffset = nextOffset;
+	}
+	memberOffset = nextOffset;
+
+	return reader.hasExpand();
+}
+
+/* what tells the archive the sidecar was made for from another one at the same path */
+static void
+putIdentity(std::ostream & output, const struct stat & archive)
+{
+	putNumber(output, archive.st_size, 8);
+	putNumber(output, archive.st_mtim.tv_sec, 8);
+	putNumber(output, archive.st_mtim.tv_nsec, 8);
+	putNumber(output, archive.st_ino, 8);
+}
+
+bool
+ArchiveIndex::save(const std::string & path, const struct stat & archive) const
+{
+	std::ofstream output(path, std::ios::binary);
+	if (!output.is_open())
+	{
+		return false;
+	}
+
+	output.write(INDEX_MAGIC, INDEX_MAGLEN);
+	putIdentity(output, archive);
+	putNumber(output, entries.size(), 8);
+
+	for (auto it = entries.begin(); it != entries.end(); ++it)
+	{
+		putNumber(output, it->second.offset, 8);
+		putNumber(output, it->second.size, 8);
+		putNumber(output, it->second.mtime, 8);
+		putNumber(output, (uint8_t)it->second.typeflag, 1);
+		putNumber(output, it->first.length(), 2);
+		output.write(it->first.c_str(), it->first.length());
+		putNumber(output, it->second.extended, 8);
+	}
+
+	putNumber(output, frameTable.size(), 8);
+	for (auto it = frameTable.begin(); it != frameTable.end(); ++it)
+	{
+		putNumber(output, it->uncompressedOffset, 8);
+		putNumber(output, it->compressedOffset, 8);
+	}
+
+	output.flush();
+	return (bool)output;
+}
+
+bool
+ArchiveIndex::load(const std::string & path, const struct stat & archive)
+{
+	clear();
+
+	std::ifstream input(path, std::ios::binary);
+	if (!input.is_open())
+	{
+		return false;
+	}
+
+	char magic[INDEX_MAGLEN];
+	input.read(magic, INDEX_MAGLEN);
+	if (!input || std::memcmp(magic, INDEX_MAGIC, INDEX_MAGLEN))
+	{
+		return false;
+	}
+
+	/* in putIdentity order */
+	if (getNumber(input, 8) != (uint64_t)archive.st_size ||
+		getNumber(input, 8) != (uint64_t)archive.st_mtim.tv_sec ||
+		getNumber(input, 8) != (uint64_t)archive.st_mtim.tv_nsec ||
+		getNumber(input, 8) != (uint64_t)archive.st_ino)
+	{
+		/* stale */
+		return false;
+	}
+
+	uint64_t count = getNumber(input, 8);
+	std::string name;
+	for (uint64_t i = 0; i < count && input; ++i)
+	{
+		IndexEntry entry;
+		entry.offset = getNumber(input, 8);
+		entry.size = getNumber(input, 8);
+		entry.mtime = (int64_t)getNumber(input, 8);
+		entry.typeflag = (int8_t)getNumber(input, 1);
+
+		name.resize(getNumber(input, 2));
+		input.read(&name[0], name.length());
+		entry.extended = getNumber(input, 8);
+
+		insert(name, entry);
+
+		uint64_t next = entry.offset + entry.extended + BLOCK_SIZE + (entry.size + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+		if (next > nextOffset)
+		{
+			nextOffset = next;
+		}
+	}
+	memberOffset = nextOffset;
+
+	uint64_t frameCount = getNumber(input, 8);
+	for (uint64_t i = 0; i < frameCount && input; ++i)
+	{
+		FrameEntry frame;
+		frame.uncompressedOffset = getNumber(input, 8);
+		frame.compressedOffset = getNumber(input, 8);
+		frameTable.push_back(frame);
+	}
+
+	if (!input)
+	{
+		clear();
+		return false;
+	}
+
+	return true;
+}
+
+bool
+ArchiveIndex::open(const std::string & archivePath)
+{
+	struct stat s;
+	if (stat(archivePath.c_str(), &s))
+	{
+		return false;
+	}
+
+	const std::string sidecar = sidecarPath(archivePath);
+	if (load(sidecar, s))
+	{
+		return true;
+	}
+
+	/* first full scan, cache it for next time */
+	ArchiveReader reader;
+	if (!reader.open(archivePath) || !build(reader))
+	{
+		return false;
+	}
+
+	save(sidecar, s);
+	return true;
+}
+
+std::string
+ArchiveIndex::sidecarPath(const std::string & archivePath)
+{
+	return archivePath + INDEX_SUFFIX;
+}
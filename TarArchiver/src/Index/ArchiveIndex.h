@@ -0,0 +1,95 @@
+#pragma once
+#include <unordered_map>
+
+#include "../TarCommon.h"
+#include "../Reader/ArchiveReader.h"
+#include "../Compress/Codec.h"
+#include "../Pax/PaxHeader.h"
+
+/* sidecar file next to archive: <archive>.idx */
+#define INDEX_SUFFIX ".idx"
+#define INDEX_MAGIC "TARIDX4\n"
+#define INDEX_MAGLEN 8
+
+/* std::string and std::string_view hash alike, so names are looked up without a copy */
+struct NameHash
+{
+	using is_transparent = void;
+
+	size_t operator()(std::string_view name) const { return std::hash<std::string_view>()(name); }
+};
+
+struct IndexEntry
+{
+	uint64_t offset;		/* header position in archive, of its pax header if it has one */
+	uint64_t extended = 0;	/* bytes of pax headers before the member header */
+	uint64_t size;			/* payload bytes */
+	int64_t mtime;
+	int8_t typeflag;
+};
+
+/*
+	Member name -> header offset, size, type and mtime.
+	Packer fills it with add() in write order, offsets follow from sizes,
+	so nothing has to ask the stream for its position.
+	Member with a pax header is indexed at the pax header, extraction reads both.
+	Saved as sidecar: magic, archive size, mtime seconds and nanoseconds and inode, count, then records of
+	offset, size, mtime (8 bytes each), typeflag, name length (2 bytes), name,
+	pax header bytes (8 bytes), then frame count and frames of a
+	seekable compressed archive. A sidecar of any other layout is rebuilt.
+	Archive size, mtime and inode are checked on load, an index of another archive
+	or of an older one at the same path is stale; for compressed archive the size
+	is the compressed file size, offsets stay in tar stream.
+*/
+class ArchiveIndex
+{
+private:
+	std::vector<std::pair<std::string, IndexEntry>> entries;
+	std::unordered_map<std::string, size_t, NameHash, std::equal_to<>> byName;
+	std::vector<FrameEntry> frameTable;
+	uint64_t nextOffset = 0;
+	uint64_t memberOffset = 0;	/* of the next member, before nextOffset after addExtended */
+
+	void insert(const std::string & name, const IndexEntry & entry);
+
+public:
+	/* member written right after previous one */
+	void add(std::string_view name, int8_t typeflag, uint64_t size, int64_t mtime);
+
+	/* pax header of size payload bytes written before the next member */
+	void addExtended(uint64_t size);
+
+	/* directories are found with or without trailing slash */
+	const IndexEntry * find(std::string_view name) const;
+
+	/* archive size after the last member and the 2 empty blocks, as TarPacker writes it */
+	uint64_t archiveSize() const { return nextOffset + 2 * BLOCK_SIZE; }
+
+	size_t size() const { return entries.size(); }
+
+	const std::vector<std::pair<std::string, IndexEntry>> & members() const { return entries; }
+
+	/* pieces of compressed archive, see CompressStreamBuf::frames */
+	void setFrames(const std::vector<FrameEntry> & frames) { frameTable = frames; }
+
+	const std::vector<FrameEntry> & frames() const { return frameTable; }
+
+	/* last piece starting at or before offset of tar stream, nullptr without frames */
+	const FrameEntry * frameAt(uint64_t offset) const;
+
+	void clear();
+
+	/* full scan of the archive */
+	bool build(const ArchiveReader & reader);
+
+	/* archive is the stat of the finished archive file */
+	bool save(const std::string & path, const struct stat & archive) const;
+
+	/* false if there is no sidecar or it does not belong to the archive of that stat */
+	bool load(const std::string & path, const struct stat & archive);
+
+	/* load sidecar of archive, build and save it when missing or stale */
+	bool open(const std::string & archivePath);
+
+	static std::string sidecarPath(const std::string & archivePath);
+};
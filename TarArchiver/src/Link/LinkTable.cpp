@@ -0,0 +1,20 @@
+#include "LinkTable.h"
+
+bool
+LinkTable::find(std::string_view name, const struct stat & s, std::string & target)
+{
+	Key key = { s.st_dev, s.st_ino };
+	auto it = links.find(key);
+	if (it == links.end())
+	{
+		links.emplace(key, Link{ std::string(name), s.st_nlink - 1 });
+		return false;
+	}
+
+	target = it->second.name;
+	if (--it->second.left == 0)
+	{
+		links.erase(it);
+	}
+	return true;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unordered_map>
+#include <deque>
+
+#include "../TarCommon.h"
+
+/*
+	First member name of every inode with more than one link, by device and
+	inode number. The next names of such an inode are packed as LNKTYPE
+	members pointing to the first one, so its data is stored once.
+	An inode is forgotten when all its links were met.
+*/
+class LinkTable
+{
+private:
+	struct Key
+	{
+		dev_t dev;
+		ino_t ino;
+
+		bool operator==(const Key & other) const { return dev == other.dev && ino == other.ino; }
+	};
+
+	struct KeyHash
+	{
+		size_t operator()(const Key & key) const
+		{
+			return std::hash<uint64_t>()((uint64_t)key.ino * 0x9e3779b97f4a7c15ULL ^ (uint64_t)key.dev);
+		}
+	};
+
+	struct Link
+	{
+		std::string name;
+		nlink_t left;		/* links not met yet */
+	};
+
+	std::unordered_map<Key, Link, KeyHash> links;
+
+public:
+	/* true if an earlier member has this inode, target gets its name; */
+	/* otherwise name is recorded as the first of the inode */
+	bool find(std::string_view name, const struct stat & s, std::string & target);
+
+	size_t size() const { return links.size(); }
+
+	void clear() { links.clear(); }
+};
@@ -0,0 +1,122 @@
+#include <pwd.h>
+#include <grp.h>
+#include <unistd.h>
+#include <cerrno>
+
+#include "OwnerCache.h"
+
+/* sysconf may not know, entries with many members need more */
+#define OWNER_BUFFER_SIZE 16384
+
+std::string_view
+OwnerCache::userName(uid_t uid)
+{
+	auto it = users.find(uid);
+	if (it != users.end())
+	{
+		return it->second;
+	}
+
+	if (buffer.empty())
+	{
+		buffer.resize(OWNER_BUFFER_SIZE);
+	}
+
+	struct passwd pw;
+	struct passwd * result = nullptr;
+	int error;
+	++lookups;
+	while ((error = getpwuid_r(uid, &pw, buffer.data(), buffer.size(), &result)) == ERANGE)
+	{
+		buffer.resize(buffer.size() * 2);
+	}
+
+	/* not found or lookup failed: remembered as empty */
+	return users.emplace(uid, result ? result->pw_name : "").first->second;
+}
+
+std::string_view
+OwnerCache::groupName(gid_t gid)
+{
+	auto it = groups.find(gid);
+	if (it != groups.end())
+	{
+		return it->second;
+	}
+
+	if (buffer.empty())
+	{
+		buffer.resize(OWNER_BUFFER_SIZE);
+	}
+
+	struct group gr;
+	struct group * result = nullptr;
+	int error;
+	++lookups;
+	while ((error = getgrgid_r(gid, &gr, buffer.data(), buffer.size(), &result)) == ERANGE)
+	{
+		buffer.resize(buffer.size() * 2);
+	}
+
+	return groups.emplace(gid, result ? result->gr_name : "").first->second;
+}
+
+void
+OwnerCache::clear()
+{
+	users.clear();
+	groups.clear();
+}
+
+bool
+OwnerCache::load(const std::string & path)
+{
+	std::ifstream input(path);
+	if (!input.is_open())
+	{
+		return false;
+	}
+
+	char kind;
+	unsigned long id;
+	std::string name;
+	while (input >> kind >> id)
+	{
+		/* name may be empty for an unknown id */
+		input.get();
+		std::getline(input, name);
+
+		if (kind == 'u')
+		{
+			users.emplace((uid_t)id, name);
+		}
+		else if (kind == 'g')
+		{
+			groups.emplace((gid_t)id, name);
+		}
+	}
+
+	return true;
+}
+
+bool
+OwnerCache::save(const std::string & path) const
+{
+	std::ofstream output(path);
+	if (!output.is_open())
+	{
+		return false;
+	}
+
+	for (auto it = users.begin(); it != users.end(); ++it)
+	{
+		output << "u " << it->first << ' ' << it->second << '\n';
+	}
+	for (auto it = groups.begin(); it != groups.end(); ++it)
+	{
+		output << "g " << it->first << ' ' << it->second << '\n';
+	}
+
+	output.flush();
+	return (bool)output;
+}
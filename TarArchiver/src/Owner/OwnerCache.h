@@ -0,0 +1,35 @@
+#pragma once
+#include <sys/types.h>
+#include <unordered_map>
+
+#include "../TarCommon.h"
+
+/*
+	uid -> user name and gid -> group name, each id is asked from NSS once.
+	Unknown ids are cached too, as empty name (tar leaves uname/gname empty then).
+	Names live in the maps, views returned by userName/groupName stay valid
+	while the cache does.
+	Can be kept in a file between runs: lines "u <id> <name>" and "g <id> <name>".
+*/
+class OwnerCache
+{
+private:
+	std::unordered_map<uid_t, std::string> users;
+	std::unordered_map<gid_t, std::string> groups;
+	std::vector<char> buffer;	/* for getpwuid_r/getgrgid_r */
+	size_t lookups = 0;
+
+public:
+	std::string_view userName(uid_t uid);
+
+	std::string_view groupName(gid_t gid);
+
+	/* NSS calls made so far */
+	size_t lookupCount() const { return lookups; }
+
+	void clear();
+
+	bool load(const std::string & path);
+
+	bool save(const std::string & path) const;
+};
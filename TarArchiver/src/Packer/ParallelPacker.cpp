@@ -0,0 +1,250 @@
+#include "ParallelPacker.h"
+
+ParallelPacker::ParallelPacker(TarPacker & packer, std::ostream & targetFile, const std::string & path,
+	size_t threadCount, size_t memoryBudget, WalkOrder order)
+	: packer(packer), targetFile(targetFile), path(path),
+	threadCount(threadCount ? threadCount : 1), memoryBudget(memoryBudget), order(order)
+{
+	loadLimit = memoryBudget / this->threadCount;
+}
+
+bool
+ParallelPacker::run(const std::string & name)
+{
+	std::thread walker(&ParallelPacker::walk, this, name);
+	std::vector<std::thread> workers;
+	for (size_t i = 0; i < threadCount; ++i)
+	{
+		workers.emplace_back(&ParallelPacker::work, this);
+	}
+
+	bool result = true;
+	std::unique_lock<std::mutex> guard(lock);
+	for (;;)
+	{
+		changed.wait(guard, [this] {
+			return (!jobs.empty() && jobs.front()->ready) || (jobs.empty() && walkDone);
+		});
+
+		if (jobs.empty())
+		{
+			break;
+		}
+
+		PackJob * job = jobs.front().get();
+		guard.unlock();
+		result = writeJob(*job);
+		guard.lock();
+
+		if (job->loaded)
+		{
+			buffered -= job->data.size();
+		}
+		if (job->dirFd >= 0)
+		{
+			close(job->dirFd);
+			openDirs--;
+		}
+		jobs.pop_front();
+		firstIndex++;
+		changed.notify_all();
+
+		if (!result)
+		{
+			break;
+		}
+	}
+
+	stop = true;
+	changed.notify_all();
+	guard.unlock();
+
+	walker.join();
+	for (auto & worker : workers)
+	{
+		worker.join();
+	}
+
+	/* left when packing was stopped */
+	for (auto & job : jobs)
+	{
+		if (job->dirFd >= 0)
+		{
+			close(job->dirFd);
+		}
+	}
+	jobs.clear();
+	openDirs = 0;
+
+	return result;
+}
+
+void
+ParallelPacker::walk(const std::string & name)
+{
+	TreeWalker walker(order);
+	bool walked = walker.walk(path, name, [this](const WalkEntry & entry) {
+		return pushJob(&entry);
+	});
+
+	if (!walked)
+	{
+		/* directory could not be listed: the writer stops there */
+		pushJob(nullptr);
+	}
+
+	std::lock_guard<std::mutex> guard(lock);
+	walkDone = true;
+	changed.notify_all();
+}
+
+bool
+ParallelPacker::pushJob(const WalkEntry * entry)
+{
+	std::unique_ptr<PackJob> job(new PackJob());
+	job->failed = entry == nullptr;
+	if (entry)
+	{
+		job->name = entry->name;
+		job->s = entry->s;
+
+		/* children are gone after the visit, the listing is made now */
+		if (entry->children && packer.incremental())
+		{
+			packer.listDumpDir(job->listing, entry->name, *entry->children);
+		}
+	}
+
+	/* directories are written from their stat, the rest is opened relative to the walker's descriptor */
+	bool needsDir = entry && !S_ISDIR(entry->s.st_mode) && entry->dirFd != AT_FDCWD;
+
+	std::unique_lock<std::mutex> guard(lock);
+	changed.wait(guard, [&] {
+		return stop || (jobs.size() < PACK_QUEUE_LIMIT && (!needsDir || openDirs < PACK_OPEN_LIMIT));
+	});
+	if (stop)
+	{
+		return false;
+	}
+
+	if (entry && !S_ISDIR(entry->s.st_mode))
+	{
+		job->leaf = entry->leaf;
+	}
+	if (needsDir)
+	{
+		job->dirFd = fcntl(entry->dirFd, F_DUPFD_CLOEXEC, 0);
+		job->failed = job->dirFd == -1;
+		openDirs += !job->failed;
+	}
+
+	jobs.push_back(std::move(job));
+	changed.notify_all();
+	return true;
+}
+
+void
+ParallelPacker::work()
+{
+	std::unique_lock<std::mutex> guard(lock);
+	for (;;)
+	{
+		changed.wait(guard, [this] {
+			return stop || walkDone || nextToClaim < firstIndex + jobs.size();
+		});
+
+		if (stop || nextToClaim == firstIndex + jobs.size())
+		{
+			/* walk is done and everything is claimed */
+			return;
+		}
+
+		size_t index = nextToClaim++;
+		PackJob * job = jobs[index - firstIndex].get();
+
+		guard.unlock();
+		loadJob(*job, index);
+		guard.lock();
+
+		job->ready = true;
+		changed.notify_all();
+	}
+}
+
+void
+ParallelPacker::loadJob(PackJob & job, size_t index)
+{
+	if (job.failed)
+	{
+		return;
+	}
+
+	if (!S_ISREG(job.s.st_mode) || (size_t)job.s.st_size > loadLimit || packer.unchanged(job.name, job.s) ||
+		packer.packedAlone(job.s))
+	{
+		/* writer handles it */
+		return;
+	}
+
+	size_t size = job.s.st_size;
+	{
+		/* the job the writer waits for never waits for memory */
+		std::unique_lock<std::mutex> guard(lock);
+		changed.wait(guard, [&] {
+			return stop || buffered + size <= memoryBudget || index == firstIndex;
+		});
+		buffered += size;
+	}
+
+	job.data.resize(size);
+	job.loaded = true;
+
+	int fd = openat(job.dirFd, job.leaf.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	if (fd == -1)
+	{
+		job.failed = true;
+		return;
+	}
+
+	size_t got = 0;
+	while (got < size)
+	{
+		ssize_t n = read(fd, job.data.data() + got, size - got);
+		if (n <= 0)
+		{
+			/* truncated while packing, the rest stays zero */
+			printf("File %s shrank while packing, padded with zeros.\n", job.name.c_str());
+			break;
+		}
+		got += n;
+	}
+
+	close(fd);
+}
+
+bool
+ParallelPacker::writeJob(PackJob & job)
+{
+	if (job.failed)
+	{
+		return false;
+	}
+
+	if (packer.skipUnchanged(job.name, job.s))
+	{
+		return true;
+	}
+
+	if (S_ISDIR(job.s.st_mode))
+	{
+		packer.packDirectory(targetFile, job.name, job.s, job.listing);
+		return true;
+	}
+
+	if (job.loaded)
+	{
+		return packer.packRegFileContent(targetFile, job.name, job.s, job.data.data(), job.data.size());
+	}
+
+	return packer.packEntry(targetFile, job.dirFd, job.leaf.c_str(), job.name, job.s);
+}
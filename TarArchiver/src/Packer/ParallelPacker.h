@@ -0,0 +1,76 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
+#include "TarPacker.h"
+
+/* memory for file content read ahead by all workers */
+#define PACK_MEMORY_BUDGET (256 * 1024 * 1024)
+
+/* how many entries the walker may list ahead of the writer */
+#define PACK_QUEUE_LIMIT 65536
+
+/* directory descriptors held by queued entries, far below the usual limit of 1024 */
+#define PACK_OPEN_LIMIT 256
+
+struct PackJob
+{
+	std::string name;
+	int dirFd = AT_FDCWD;	/* copy of the walker's directory, closed when the job is written */
+	std::string leaf;		/* entry in dirFd, a root which is no directory is a path */
+	bool ready = false;
+	bool failed = false;	/* can't list directory or open file, stops packing */
+	bool loaded = false;	/* content is in data */
+	struct stat s;
+	std::vector<int8_t> data;
+	std::string listing;	/* dumpdir of a directory in incremental archive */
+};
+
+/*
+	Parallel mode of TarPacker.
+	Walker thread lists and stats the tree with the same TreeWalker order as
+	TarPacker::packInternal, worker threads open and read files ahead into memory
+	limited by the budget, and the calling thread writes headers and content in walk order.
+	Files bigger than a worker share of the budget are streamed by the writer.
+*/
+class ParallelPacker
+{
+private:
+	TarPacker & packer;
+	std::ostream & targetFile;
+	std::string path;
+	size_t threadCount;
+	size_t memoryBudget;
+	size_t loadLimit;		/* biggest file read by a worker */
+	WalkOrder order;
+
+	std::mutex lock;
+	std::condition_variable changed;
+	std::deque<std::unique_ptr<PackJob>> jobs;
+	size_t firstIndex = 0;	/* index of jobs.front() */
+	size_t nextToClaim = 0;
+	bool walkDone = false;
+	bool stop = false;
+	size_t buffered = 0;
+	size_t openDirs = 0;	/* dirFd of queued jobs */
+
+	void walk(const std::string & name);
+
+	/* null entry is a failed job, it stops the writer */
+	bool pushJob(const WalkEntry * entry);
+
+	void work();
+
+	void loadJob(PackJob & job, size_t index);
+
+	bool writeJob(PackJob & job);
+
+public:
+	ParallelPacker(TarPacker & packer, std::ostream & targetFile, const std::string & path,
+		size_t threadCount, size_t memoryBudget, WalkOrder order);
+
+	/* pack entry name under path, false if packing was stopped */
+	bool run(const std::string & name);
+};
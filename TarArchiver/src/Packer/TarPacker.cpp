@@ -1,85 +1,590 @@
 #include "TarPacker.h"
+#include "ParallelPacker.h"
+#include "UringPacker.h"
 
-void 
+TarPacker::TarPacker()
+	: memoryBudget(PACK_MEMORY_BUDGET)
+{
+}
+
+bool
 TarPacker::pack(const std::string & targetPath)
 {
-	std::ofstream targetFile;
+	std::fstream targetFile;
 
-	std::string targetFilename = extractName(targetPath) + ".tar";
+	bool deduplicated = !dedupStorePath.empty();
+	std::string targetFilename = extractName(targetPath) + ".tar" +
+		(deduplicated ? std::string(DEDUP_SUFFIX) : Codec::suffix(compression));
 	std::string name = getDirFileName(targetPath);
 	std::string basePath = targetPath.substr(0, targetPath.length() - name.length());
 
-	targetFile.open(targetFilename, std::ios::binary);
-	if (!targetFile.is_open())
+	/* kernel copy and index offsets need plain tar in the file */
+	bool plain = compression == Compression::NONE && !deduplicated;
+
+	if (mode != PackMode::CREATE && !plain)
 	{
-		return;
+		printf("Only a plain archive can be appended to.\n");
+		return false;
 	}
 
-	if (!packInternal(targetFile, basePath, name))
+	/* missing archive is created, as by tar -r */
+	appending = mode != PackMode::CREATE && access(targetFilename.c_str(), F_OK) == 0;
+	if (appending)
 	{
-		targetFile.close();
-		//remove
+		if (!openAppend(targetFile, targetFilename))
+		{
+			appending = false;
+			return false;
+		}
 	}
 	else
 	{
-		/* eof */
+		targetFile.open(targetFilename, std::ios::binary | std::ios::out | std::ios::trunc);
+	}
+
+	if (!targetFile.is_open())
+	{
+		printf("Can't create %s.\n", targetFilename.c_str());
+		return false;
+	}
+	uint64_t appendOffset = appending ? (uint64_t)targetFile.tellp() : 0;
+
+	startRun();
+
+	if (zeroCopy && plain)
+	{
+		archiveFd = open(targetFilename.c_str(), O_WRONLY);
+	}
+
+	uint64_t archiveSize = 0;
+	bool packed = packEncoded(targetFile, basePath, name, archiveSize);
+
+	if (!packed && appending)
+	{
+		/* only the end blocks were overwritten, put them back */
+		targetFile.clear();
+		targetFile.seekp(appendOffset);
 		targetFile.write((char*)&emptyBuffer, BLOCK_SIZE);
 		targetFile.write((char*)&emptyBuffer, BLOCK_SIZE);
-
+		targetFile.close();
+		if (truncate(targetFilename.c_str(), appendOffset + 2 * BLOCK_SIZE))
+		{
+			printf("Can't restore end of archive %s.\n", targetFilename.c_str());
+		}
+	}
+	else if (!packed)
+	{
+		/* nothing of a broken archive is kept, nor the sidecar of the one it replaced */
+		targetFile.close();
+		unlink(targetFilename.c_str());
+		unlink(ArchiveIndex::sidecarPath(targetFilename).c_str());
+		printf("Packing %s stopped, %s is removed.\n", targetPath.c_str(), targetFilename.c_str());
+	}
+	else
+	{
 		targetFile.flush();
 		targetFile.close();
+
+		/* blocking of the old archive past its end blocks */
+		if (appending && truncate(targetFilename.c_str(), archiveSize))
+		{
+			printf("Can't truncate %s.\n", targetFilename.c_str());
+		}
+
+		/* offsets of compressed archive are only usable through frames */
+		const std::string sidecar = ArchiveIndex::sidecarPath(targetFilename);
+		struct stat archive;
+		if (indexed && (plain || seekable) && !stat(targetFilename.c_str(), &archive))
+		{
+			index.save(sidecar, archive);
+		}
+		else
+		{
+			/* sidecar of the archive this one replaced must not be taken for its index */
+			unlink(sidecar.c_str());
+		}
 	}
+
+	if (archiveFd != -1)
+	{
+		close(archiveFd);
+		archiveFd = -1;
+	}
+
+	finishRun(packed);
+
+	appending = false;
+	archived.clear();
+	return packed;
 }
 
 bool
-TarPacker::packInternal(std::ofstream & targetFile, const std::string & path, const std::string & name)
+TarPacker::packTo(OutputSink & sink, const std::string & path)
 {
-	struct stat s;
-	if (lstat((path + name).c_str(), &s))
+	if (mode != PackMode::CREATE)
 	{
-		switch (errno)
+		printf("Append and update need the archive file.\n");
+		return false;
+	}
+
+	std::string name = getDirFileName(path);
+	std::string basePath = path.substr(0, path.length() - name.length());
+
+	startRun();
+
+	std::ostream target(&sink);
+	uint64_t archiveSize = 0;
+	bool packed = packEncoded(target, basePath, name, archiveSize) && sink.flush();
+
+	finishRun(packed);
+	return packed;
+}
+
+void
+TarPacker::startRun()
+{
+	if (!ownerCachePath.empty())
+	{
+		owners.load(ownerCachePath);
+	}
+
+	if (incremental())
+	{
+		previous.clear();
+		current.clear();
+		previous.load(snapshotPath);
+	}
+
+	links.clear();
+}
+
+void
+TarPacker::finishRun(bool packed)
+{
+	/* next run is incremental to this one */
+	if (packed && incremental() && !current.save(snapshotPath))
+	{
+		printf("Can't write snapshot %s.\n", snapshotPath.c_str());
+	}
+
+	if (!ownerCachePath.empty())
+	{
+		owners.save(ownerCachePath);
+	}
+}
+
+bool
+TarPacker::packEncoded(std::ostream & target, const std::string & basePath, const std::string & name,
+	uint64_t & archiveSize)
+{
+	bool deduplicated = !dedupStorePath.empty();
+	bool plain = compression == Compression::NONE && !deduplicated;
+	bool packed;
+
+	aligning = alignPayloads && plain;
+	if (plain)
+	{
+		packed = packStream(target, basePath, name);
+		archiveSize = index.archiveSize();
+	}
+	else if (deduplicated)
+	{
+		ChunkStore store;
+		if (store.open(dedupStorePath, true))
 		{
-		case ENOENT:
-			printf("File %s not found.\n", path);
-			break;
-		case EINVAL:
-			printf("Invalid parameter to _stat.\n");
-			break;
-		default:
-			/* Should never be reached. */
-			printf("Unexpected error in _stat.\n");
-			break;
+			DedupStreamBuf dedup(target, store);
+			std::ostream manifest(&dedup);
+			dedupBuf = &dedup;
+			packed = packStream(manifest, basePath, name);
+			packed = dedup.finish() && packed;
+			dedupBuf = nullptr;
+			packed = store.close() && packed;
+
+			printf("%llu bytes in %zu chunks, %zu new chunks of %llu bytes stored.\n",
+				(unsigned long long)dedup.totalBytes(), dedup.chunks(),
+				dedup.storedChunks(), (unsigned long long)dedup.storedBytes());
+		}
+		else
+		{
+			printf("Can't open chunk store %s.\n", dedupStorePath.c_str());
+			packed = false;
 		}
 	}
+	else
+	{
+		CompressStreamBuf compressBuf(target, compression, compressionLevel, threadCount);
+		std::ostream compressed(&compressBuf);
+		frameBuf = seekable ? &compressBuf : nullptr;
+		packed = packStream(compressed, basePath, name);
+		packed = compressBuf.finish() && packed;
+		frameBuf = nullptr;
+
+		index.setFrames(compressBuf.frames());
+		archiveSize = compressBuf.compressedSize();
+	}
 
-	switch (s.st_mode & S_IFMT)
+	return packed;
+}
+
+bool
+TarPacker::openAppend(std::fstream & targetFile, const std::string & targetFilename)
+{
+	/* sidecar of the last run, or one pass over the headers only */
+	if (!archived.open(targetFilename))
 	{
-	case S_IFDIR:
+		printf("%s is not a plain archive ending with empty blocks.\n", targetFilename.c_str());
+		return false;
+	}
+
+	targetFile.open(targetFilename, std::ios::binary | std::ios::in | std::ios::out);
+	if (!targetFile.is_open())
 	{
-		VecStr files;
-		if (!getDirectoryFiles(path + name, files))
+		return false;
+	}
+
+	targetFile.seekp(archived.archiveSize() - 2 * BLOCK_SIZE);
+	return (bool)targetFile;
+}
+
+bool
+TarPacker::packStream(std::ostream & targetFile, const std::string & basePath, const std::string & name)
+{
+	/* appended members continue the index of the archive */
+	if (appending)
+	{
+		index = archived;
+		streamOffset = archived.archiveSize() - 2 * BLOCK_SIZE;
+	}
+	else
+	{
+		index.clear();
+		streamOffset = 0;
+	}
+
+	bool packed;
+	if (threadCount > 1)
+	{
+		ParallelPacker parallel(*this, targetFile, basePath, threadCount, memoryBudget, walkOrder);
+		packed = parallel.run(name);
+	}
+	else if (uring)
+	{
+		UringQueue ring;
+		if (ring.open())
 		{
-			return false;
+			UringPacker batched(*this, targetFile, basePath, walkOrder, ring);
+			packed = batched.run(name);
 		}
-		packDirectory(targetFile, name, s);
-		for (auto it = files.begin(); it != files.end(); ++it)
+		else
 		{
-			if (*it == ".." || *it == ".")
-			{
-				continue;
-			}
-
-			if (!packInternal(targetFile, path, name + '/' + (*it)))
-			{
-				return false;
-			}
+			printf("io_uring is not available, using synchronous I/O.\n");
+			packed = packInternal(targetFile, basePath, name);
 		}
 	}
-	break;
+	else
+	{
+		packed = packInternal(targetFile, basePath, name);
+	}
+
+	if (!packed)
+	{
+		return false;
+	}
+
+	/* eof */
+	targetFile.write((char*)&emptyBuffer, BLOCK_SIZE);
+	targetFile.write((char*)&emptyBuffer, BLOCK_SIZE);
+
+	return (bool)targetFile;
+}
+
+bool
+TarPacker::setCompression(Compression type, int level)
+{
+	if (!Codec::available(type))
+	{
+		return false;
+	}
+
+	compression = type;
+	compressionLevel = level;
+	return true;
+}
+
+void
+TarPacker::setSeekable(bool enable)
+{
+	seekable = enable;
+	indexed = indexed || enable;
+}
+
+void
+TarPacker::setOwnerCache(const std::string & path)
+{
+	ownerCachePath = path;
+}
+
+void
+TarPacker::setWalkOrder(WalkOrder order)
+{
+	walkOrder = order;
+}
+
+void
+TarPacker::setUring(bool enable)
+{
+	uring = enable;
+}
+
+void
+TarPacker::setMode(PackMode packMode)
+{
+	mode = packMode;
+	indexed = indexed || mode != PackMode::CREATE;
+}
+
+void
+TarPacker::setAlignPayloads(bool enable)
+{
+	alignPayloads = enable;
+}
+
+void
+TarPacker::setPreciseTimes(bool enable)
+{
+	preciseTimes = enable;
+}
 
+void
+TarPacker::setHardLinks(bool enable)
+{
+	hardLinks = enable;
+}
+
+void
+TarPacker::setSparse(bool enable)
+{
+	sparse = enable;
+}
+
+void
+TarPacker::setDedup(const std::string & storePath)
+{
+	dedupStorePath = storePath;
+}
+
+void
+TarPacker::setSnapshot(const std::string & path)
+{
+	snapshotPath = path;
+}
+
+bool
+TarPacker::unchanged(std::string_view name, const struct stat & s) const
+{
+	return (incremental() && previous.unchanged(name, s)) || archivedCurrent(name, s);
+}
+
+bool
+TarPacker::archivedCurrent(std::string_view name, const struct stat & s) const
+{
+	if (mode != PackMode::UPDATE || !appending)
+	{
+		return false;
+	}
+
+	const IndexEntry * entry = archived.find(name);
+	return entry && entry->mtime >= (int64_t)s.st_mtime;
+}
+
+bool
+TarPacker::skipUnchanged(std::string_view name, const struct stat & s)
+{
+	/* directories are always packed, they hold the dumpdirs */
+	if (incremental() && !S_ISDIR(s.st_mode))
+	{
+		current.record(name, s);
+		if (previous.unchanged(name, s))
+		{
+			return true;
+		}
+	}
+
+	return archivedCurrent(name, s);
+}
+
+void
+TarPacker::listDumpDir(std::string & listing, std::string_view name, const std::vector<WalkChild> & children) const
+{
+	listing.clear();
+
+	std::string path(name);
+	path += '/';
+	const size_t length = path.length();
+
+	for (const WalkChild & child : children)
+	{
+		char flag = 'D';
+		if (!S_ISDIR(child.s->st_mode))
+		{
+			path.resize(length);
+			path += child.leaf;
+			flag = previous.unchanged(path, *child.s) ? 'N' : 'Y';
+		}
+
+		listing += flag;
+		listing += child.leaf;
+		listing += '\0';
+	}
+
+	listing += '\0';
+}
+
+void
+TarPacker::setChunkSize(size_t size)
+{
+	copyEngine.setChunkSize(size);
+}
+
+void
+TarPacker::setZeroCopy(bool enable)
+{
+	zeroCopy = enable;
+}
+
+void
+TarPacker::setIndex(bool enable)
+{
+	indexed = enable;
+}
+
+void
+TarPacker::setThreadCount(size_t count)
+{
+	threadCount = count ? count : 1;
+}
+
+void
+TarPacker::setMemoryBudget(size_t bytes)
+{
+	memoryBudget = bytes;
+}
+
+bool
+TarPacker::packInternal(std::ostream & targetFile, const std::string & path, const std::string & name)
+{
+	TreeWalker walker(walkOrder);
+	return walker.walk(path, name, [&](const WalkEntry & entry) {
+		if (skipUnchanged(entry.name, entry.s))
+		{
+			return true;
+		}
+
+		if (S_ISDIR(entry.s.st_mode))
+		{
+			packDirectory(targetFile, entry);
+			return true;
+		}
+
+		return packEntry(targetFile, entry.dirFd, entry.leaf, entry.name, entry.s);
+	});
+}
+
+void
+TarPacker::writeHeader(std::ostream & targetFile, const HeaderInfo & headerInfo)
+{
+	if (frameBuf)
+	{
+		frameBuf->markBoundary();
+	}
+	if (dedupBuf)
+	{
+		dedupBuf->markBoundary();
+	}
+
+	bool align = aligning && headerInfo.typeflag == REGTYPE && headerInfo.size >= CLONE_MIN_SIZE;
+	if (!extendedRecords.empty() || (align && (streamOffset + BLOCK_SIZE) % CLONE_BLOCK_SIZE))
+	{
+		writeExtended(targetFile, headerInfo, align);
+	}
+
+	targetFile.write((char*)&header, BLOCK_SIZE);
+
+	/* header alone is a literal, payload is chunked from its start */
+	if (dedupBuf)
+	{
+		dedupBuf->markBoundary();
+	}
+
+	if (indexed)
+	{
+		index.add(headerInfo.name, headerInfo.typeflag, headerInfo.size, headerInfo.mtime);
+	}
+	streamOffset += BLOCK_SIZE + CopyEngine::alignToBlock(headerInfo.size);
+}
+
+void
+TarPacker::writeExtended(std::ostream & targetFile, const HeaderInfo & headerInfo, bool align)
+{
+	if (align)
+	{
+		/* member payload starts after both headers and this payload, which is padded */
+		/* up to the next clone block by one comment record */
+		uint64_t length = extendedRecords.length();
+		uint64_t target = (CLONE_BLOCK_SIZE - (streamOffset + 2 * BLOCK_SIZE) % CLONE_BLOCK_SIZE) % CLONE_BLOCK_SIZE;
+		while (target < length || (target > length && target - length < PAX_FILL_MIN))
+		{
+			target += CLONE_BLOCK_SIZE;
+		}
+		if (target > length)
+		{
+			PaxHeader::addFill(extendedRecords, target - length);
+		}
+	}
+
+	/* member header is built already, it is put back after this one */
+	PosixHeader memberHeader = header;
+
+	HeaderInfo extendedInfo = headerInfo;
+	SparseMap::memberName(extendedName, headerInfo.name, "PaxHeaders.0");
+	extendedInfo.name = extendedName;
+	extendedInfo.typeflag = XHDTYPE;
+	extendedInfo.linkname = std::string_view();
+	extendedInfo.magic = PAXMAGIC;
+	extendedInfo.version = PAXVERSION;
+	extendedInfo.size = extendedRecords.length();
+	convertHeader(extendedInfo);
+
+	targetFile.write((char*)&header, BLOCK_SIZE);
+	targetFile.write(extendedRecords.data(), extendedRecords.length());
+	CopyEngine::writePadding(targetFile, extendedRecords.length());
+
+	/* index finds the member at this header */
+	if (indexed)
+	{
+		index.addExtended(extendedRecords.length());
+	}
+	streamOffset += BLOCK_SIZE + CopyEngine::alignToBlock(extendedRecords.length());
+
+	extendedRecords.clear();
+	header = memberHeader;
+}
+
+bool
+TarPacker::packEntry(std::ostream & targetFile, int dirFd, const char * leaf, std::string_view name,
+	const struct stat & s)
+{
+	if (linkCandidate(s) && links.find(name, s, linkTarget))
+	{
+		packHardLink(targetFile, name, s, linkTarget);
+		return true;
+	}
+
+	switch (s.st_mode & S_IFMT)
+	{
 	case S_IFREG:
 	{
-		if (!packRegFile(targetFile, path, name, s))
+		if (!packRegFile(targetFile, dirFd, leaf, name, s))
 		{
 			return false;
 		}
@@ -88,7 +593,7 @@ TarPacker::packInternal(std::ofstream & targetFile, const std::string & path, co
 
 	case S_IFLNK:
 	{
-		packLink(targetFile, path, name, s);
+		packLink(targetFile, dirFd, leaf, name, s);
 	}
 	break;
 
@@ -100,7 +605,7 @@ TarPacker::packInternal(std::ofstream & targetFile, const std::string & path, co
 
 	case S_IFBLK:
 	{
-		if (!packBlockFile(targetFile, path, name, s))
+		if (!packBlockFile(targetFile, name, s))
 		{
 			return false;
 		}
@@ -109,7 +614,7 @@ TarPacker::packInternal(std::ofstream & targetFile, const std::string & path, co
 
 	case S_IFIFO:
 	{
-		packFifoFile(targetFile, path, name, s);
+		packFifoFile(targetFile, name, s);
 	}
 	break;
 
@@ -126,122 +631,234 @@ TarPacker::packInternal(std::ofstream & targetFile, const std::string & path, co
 	return true;
 }
 
+
+void
+TarPacker::packDirectory(std::ostream & targetFile, std::string_view name, const struct stat & s,
+	std::string_view listing)
+{
+	dirName.assign(name);
+	dirName += '/';
+
+	HeaderInfo headerInfo;
+	if (!incremental())
+	{
+		createHeader(headerInfo, dirName, DIRTYPE, s);
+		convertHeader(headerInfo);
+
+		writeHeader(targetFile, headerInfo);
+		return;
+	}
+
+	createHeader(headerInfo, dirName, GNUTYPE_DUMPDIR, s);
+	headerInfo.size = listing.length();
+	convertHeader(headerInfo);
+
+	writeHeader(targetFile, headerInfo);
+	targetFile.write(listing.data(), listing.length());
+	CopyEngine::writePadding(targetFile, listing.length());
+}
+
+void
+TarPacker::packDirectory(std::ostream & targetFile, const WalkEntry & entry)
+{
+	if (incremental())
+	{
+		listDumpDir(listing, entry.name, *entry.children);
+	}
+
+	packDirectory(targetFile, entry.name, entry.s, listing);
+}
+
+bool 
+TarPacker::packRegFile(std::ostream & targetFile, int dirFd, const char * leaf,
+	std::string_view name, const struct stat & s)
+{
+	int inputFd = openat(dirFd, leaf, O_RDONLY | O_CLOEXEC);
+	if (inputFd == -1)
+	{
+		return false;
+	}
+
+	if (sparseCandidate(s) && SparseMap::scan(inputFd, s.st_size, extents))
+	{
+		bool written = packSparseFile(targetFile, inputFd, name, s);
+		close(inputFd);
+		return written;
+	}
+
+	HeaderInfo headerInfo;
+	createHeader(headerInfo, name, REGTYPE, s);
+	convertHeader(headerInfo);
+
+	bool written;
+	if (archiveFd != -1)
+	{
+		written = packRegFileInKernel(targetFile, inputFd, headerInfo);
+	}
+	else
+	{
+		writeHeader(targetFile, headerInfo);
+		written = writeContentToTargetFile(headerInfo, inputFd, targetFile);
+	}
+	close(inputFd);
+
+	return written;
+}
+
 bool
-TarPacker::getDirectoryFiles(const std::string & directory, VecStr & files)
+TarPacker::packSparseFile(std::ostream & targetFile, int inputFd, std::string_view name, const struct stat & s)
 {
-	DIR* curDir = opendir(directory.c_str());
-	if (curDir)
+	SparseMap::encode(extents, sparseMap);
+	uint64_t size = sparseMap.length() + SparseMap::dataSize(extents);
+
+	PaxHeader::addRecord(extendedRecords, "GNU.sparse.major", "1");
+	PaxHeader::addRecord(extendedRecords, "GNU.sparse.minor", "0");
+	PaxHeader::addRecord(extendedRecords, "GNU.sparse.name", name);
+	PaxHeader::addRecord(extendedRecords, "GNU.sparse.realsize", std::to_string(s.st_size));
+
+	HeaderInfo headerInfo;
+	SparseMap::memberName(sparseName, name, "GNUSparseFile.0");
+	createHeader(headerInfo, sparseName, REGTYPE, s);
+	headerInfo.size = size;
+	headerInfo.sparse = true;
+	convertHeader(headerInfo);
+
+	/* pax header and index go by the real name */
+	headerInfo.name = name;
+	writeHeader(targetFile, headerInfo);
+	targetFile.write(sparseMap.data(), sparseMap.length());
+
+	bool complete = true;
+	for (const SparseExtent & extent : extents)
 	{
-		struct dirent* ent;
-		while ((ent = readdir(curDir)) != nullptr)
+		if (lseek(inputFd, extent.offset, SEEK_SET) != (off_t)extent.offset ||
+			copyEngine.copyPiece(inputFd, targetFile, extent.size) != extent.size)
 		{
-			files.emplace_back(ent->d_name);
+			complete = false;
 		}
-		closedir(curDir);
+	}
 
-		return true;
+	if (!complete)
+	{
+		printf("File %.*s shrank while packing, padded with zeros.\n", (int)name.length(), name.data());
 	}
 
-	return false;
+	return CopyEngine::writePadding(targetFile, size);
 }
 
-void
-TarPacker::packDirectory(std::ofstream & targetFile, const std::string & name, const struct stat & s)
+bool
+TarPacker::packRegFileContent(std::ostream & targetFile, std::string_view name,
+	const struct stat & s, const int8_t * content, size_t size)
 {
-	HeaderInfo * h = createHeader(name + '/', DIRTYPE, s);
-	std::unique_ptr<HeaderInfo> headerInfo(h);
-	convertHeader(*headerInfo);
+	HeaderInfo headerInfo;
+	createHeader(headerInfo, name, REGTYPE, s);
+	convertHeader(headerInfo);
 
-	targetFile.write((char*)&header, BLOCK_SIZE);
+	writeHeader(targetFile, headerInfo);
+	targetFile.write((const char*)content, size);
+
+	return CopyEngine::writePadding(targetFile, size);
 }
 
-bool 
-TarPacker::packRegFile(std::ofstream & targetFile, const std::string & path, 
-	const std::string & name, const struct stat & s)
+bool
+TarPacker::packRegFileInKernel(std::ostream & targetFile, int inputFd, const HeaderInfo & headerInfo)
 {
-	std::ifstream fileInput;
+	writeHeader(targetFile, headerInfo);
+	targetFile.flush();
 
-	HeaderInfo * h = createHeader(name, REGTYPE, s);
-	std::unique_ptr<HeaderInfo> headerInfo(h);
-	convertHeader(*headerInfo);
+	std::streampos pos = targetFile.tellp();
+	uint64_t copied = copyEngine.copyKernel(inputFd, 0, archiveFd, pos, headerInfo.size);
 
-	fileInput.open(path + name, std::ios::binary);
-	if (!fileInput.is_open())
+	targetFile.seekp(pos + (std::streamoff)copied);
+	if (copied == (uint64_t)headerInfo.size)
 	{
-		return false;
+		return CopyEngine::writePadding(targetFile, copied);
 	}
 
-	targetFile.write((char*)&header, BLOCK_SIZE);
-	writeContentToTargetFile(headerInfo, fileInput, targetFile);
-	fileInput.close();
+	/* kernel refused, the rest goes through the buffer */
+	return lseek(inputFd, copied, SEEK_SET) == (off_t)copied &&
+		writeContentToTargetFile(headerInfo, inputFd, targetFile, copied);
+}
 
-	return true;
+void
+TarPacker::packHardLink(std::ostream & targetFile, std::string_view name, const struct stat & s,
+	std::string_view target)
+{
+	HeaderInfo headerInfo;
+	createHeader(headerInfo, name, LNKTYPE, s, target);
+	convertHeader(headerInfo);
+
+	writeHeader(targetFile, headerInfo);
 }
 
 void 
-TarPacker::packLink(std::ofstream & targetFile, const std::string & path,
-	const std::string & name, const struct stat & s)
+TarPacker::packLink(std::ostream & targetFile, int dirFd, const char * leaf,
+	std::string_view name, const struct stat & s)
 {
-	char buf[100];
+	/* st_size of a link is the length of its target, some filesystems report 0 */
+	size_t capacity = s.st_size > 0 ? s.st_size + 1 : PATH_MAX;
 	ssize_t len;
-
-	if ((len = readlink((path + name).c_str(), buf, sizeof(buf) - 1)) != -1) {
-		buf[len] = '\0';
+	for (;;)
+	{
+		symlinkTarget.resize(capacity);
+		len = readlinkat(dirFd, leaf, &symlinkTarget[0], capacity);
+		if (len < (ssize_t)capacity)
+		{
+			break;
+		}
+		/* target grew since lstat */
+		capacity *= 2;
 	}
+	symlinkTarget.resize(len > 0 ? len : 0);
 
 	/* LNK or SYM ??? */
-	HeaderInfo * h = createHeader(name, SYMTYPE, s, std::string(buf));
-	std::unique_ptr<HeaderInfo> headerInfo(h);
-	convertHeader(*headerInfo);
+	HeaderInfo headerInfo;
+	createHeader(headerInfo, name, SYMTYPE, s, symlinkTarget);
+	convertHeader(headerInfo);
 
-	targetFile.write((char*)&header, BLOCK_SIZE);
+	writeHeader(targetFile, headerInfo);
 }
 
 bool 
-TarPacker::packBlockFile(std::ofstream & targetFile, const std::string & path,
-	const std::string & name, const struct stat & s)
+TarPacker::packBlockFile(std::ostream & targetFile, std::string_view name, const struct stat & s)
 {
-	HeaderInfo * h = createHeader(name, BLKTYPE, s);
-	std::unique_ptr<HeaderInfo> headerInfo(h);
-	convertHeader(*headerInfo);
+	HeaderInfo headerInfo;
+	createHeader(headerInfo, name, BLKTYPE, s);
+	convertHeader(headerInfo);
 
-	targetFile.write((char*)&header, BLOCK_SIZE);
+	writeHeader(targetFile, headerInfo);
 
 	return true;
 }
 
 void 
-TarPacker::packFifoFile(std::ofstream & targetFile, const std::string & path,
-	const std::string & name, const struct stat & s)
+TarPacker::packFifoFile(std::ostream & targetFile, std::string_view name, const struct stat & s)
 {
-	HeaderInfo * h = createHeader(name, FIFOTYPE, s);
-	std::unique_ptr<HeaderInfo> headerInfo(h);
-	convertHeader(*headerInfo);
+	HeaderInfo headerInfo;
+	createHeader(headerInfo, name, FIFOTYPE, s);
+	convertHeader(headerInfo);
 
-	targetFile.write((char*)&header, BLOCK_SIZE);
+	writeHeader(targetFile, headerInfo);
 }
 
 
-void 
-TarPacker::writeContentToTargetFile(const std::unique_ptr<HeaderInfo>& headerInfo,
-	std::ifstream & input, std::ofstream & output)
+bool
+TarPacker::writeContentToTargetFile(const HeaderInfo & headerInfo,
+	int inputFd, std::ostream & output, uint64_t written)
 {
-	/* clear buffer */
-	std::memset(&buffer, '\0', BLOCK_SIZE);
-
-	while (input.tellg() != headerInfo->size)
+	uint64_t read = written + copyEngine.copyPadded(inputFd, output, headerInfo.size - written, written);
+	if (!output)
 	{
-		if (headerInfo->size - input.tellg() >= BLOCK_SIZE)
-		{
-			input.read((char*)&buffer, BLOCK_SIZE);
-		}
-		else
-		{
-			input.read((char*)&buffer, headerInfo->size - input.tellg());
-		}
+		return false;
+	}
 
-		output.write((char*)&buffer, BLOCK_SIZE);
+	if (read != (uint64_t)headerInfo.size)
+	{
+		printf("File %.*s shrank while packing, padded with zeros.\n",
+			(int)headerInfo.name.length(), headerInfo.name.data());
 	}
+
+	return true;
 }
 
 std::string 
@@ -277,57 +894,44 @@ TarPacker::getDirFileName(const std::string & path)
 	return name;
 }
 
-HeaderInfo *
-TarPacker::createHeader(const std::string & name, int8_t typeflag, 
-	const struct stat & s, const std::string & linkname)
+void
+TarPacker::createHeader(HeaderInfo & headerInfo, std::string_view name, int8_t typeflag, 
+	const struct stat & s, std::string_view linkname)
 {
-	HeaderInfo * headerInfo = new HeaderInfo();
-	struct passwd *pw;
-	struct group *gr;
-
-	pw = getpwuid(s.st_uid);
-	gr = getgrgid(s.st_gid);
-
-	headerInfo->name = name;
+	headerInfo.name = name;
 	
-	headerInfo->mode = s.st_mode & RWX;
-	headerInfo->uid = s.st_uid;
-	headerInfo->gid = s.st_gid;
+	headerInfo.mode = s.st_mode & RWX;
+	headerInfo.uid = s.st_uid;
+	headerInfo.gid = s.st_gid;
 
-	headerInfo->mtime = s.st_mtime;
-	headerInfo->checksum = 0;
-	headerInfo->typeflag = typeflag;
+	headerInfo.size = 0;
+	headerInfo.mtime = s.st_mtime;
+	headerInfo.mtimeNsec = s.st_mtim.tv_nsec;
+	headerInfo.checksum = 0;
+	headerInfo.typeflag = typeflag;
 
-	headerInfo->linkname = linkname;
-	headerInfo->magic = TMAGIC;
-	headerInfo->version = TVERSION;
-	headerInfo->uname = pw->pw_name;
-	headerInfo->gname = gr->gr_name;
+	headerInfo.linkname = linkname;
+	headerInfo.magic = TMAGIC;
+	headerInfo.version = " ";		/* TVERSION */
+	headerInfo.uname = owners.userName(s.st_uid);
+	headerInfo.gname = owners.groupName(s.st_gid);
 
-	//headerInfo->prefix = ;
+	//headerInfo.prefix = ;
 
 	switch (typeflag)
 	{
 	case AREGTYPE:
 	case REGTYPE:
 	{
-		headerInfo->size = s.st_size;
+		headerInfo.size = s.st_size;
 	}
 	break;
 	
-	case SYMTYPE:
-	case LNKTYPE:
-	case DIRTYPE:
-	{
-		headerInfo->size = 0;
-	}
-	break;
-
 	case CHRTYPE:
 	case BLKTYPE:
 	{
-		headerInfo->devmajor = MAJOR(s.st_dev);
-		headerInfo->devminor = MINOR(s.st_dev);
+		headerInfo.devmajor = MAJOR(s.st_dev);
+		headerInfo.devminor = MINOR(s.st_dev);
 	}
 	break;
 
@@ -342,87 +946,102 @@ TarPacker::createHeader(const std::string & name, int8_t typeflag,
 		break;
 	}
 
-	return headerInfo;
 }
 
 
+/* longer text is cut, it must not run into the next field */
+static void
+copyText(int8_t * field, size_t length, std::string_view text)
+{
+	std::memcpy(field, text.data(), text.length() < length ? text.length() : length);
+}
+
 PosixHeader
 TarPacker::convertHeader(const HeaderInfo & headerInfo)
 {
-	int8_t res[12];
 	std::memset(&header, 0, BLOCK_SIZE);
 
-	std::memcpy(header.name, headerInfo.name.c_str(), headerInfo.name.length());
-	
-	toOctStr(headerInfo.mode, res, sizeof(header.mode));
-	std::memcpy(header.mode, res, sizeof(header.mode));
+	/* pax headers themselves just cut what does not fit */
+	const bool member = !PaxHeader::isPaxType(headerInfo.typeflag);
+	auto extend = [this, member](std::string_view keyword, std::string_view value) {
+		if (member)
+		{
+			PaxHeader::addRecord(extendedRecords, keyword, value);
+		}
+	};
 
-	toOctStr(headerInfo.uid, res, sizeof(header.uid));
-	std::memcpy(header.uid, res, sizeof(header.uid));
+	/* sparse member is named by its sparse records, the placeholder name is just cut */
+	copyText(header.name, sizeof(header.name), headerInfo.name);
+	if (headerInfo.name.length() > sizeof(header.name) && !headerInfo.sparse)
+	{
+		extend("path", headerInfo.name);
+	}
 	
-	toOctStr(headerInfo.gid, res, sizeof(header.gid));
-	std::memcpy(header.gid, res, sizeof(header.gid));
-
-	toOctStr(headerInfo.size, res, sizeof(header.size));
-	std::memcpy(header.size, res, sizeof(header.size));
+	HeaderCodec::toOctal(headerInfo.mode, header.mode, sizeof(header.mode));
+	if (!HeaderCodec::toOctal(headerInfo.uid, header.uid, sizeof(header.uid)))
+	{
+		HeaderCodec::toBase256(headerInfo.uid, header.uid, sizeof(header.uid));
+		extend("uid", std::to_string(headerInfo.uid));
+	}
+	if (!HeaderCodec::toOctal(headerInfo.gid, header.gid, sizeof(header.gid)))
+	{
+		HeaderCodec::toBase256(headerInfo.gid, header.gid, sizeof(header.gid));
+		extend("gid", std::to_string(headerInfo.gid));
+	}
+	if (!HeaderCodec::toOctal(headerInfo.size, header.size, sizeof(header.size)))
+	{
+		HeaderCodec::toBase256(headerInfo.size, header.size, sizeof(header.size));
+		extend("size", std::to_string(headerInfo.size));
+	}
 
-	toOctStr(headerInfo.mtime, res, sizeof(header.mtime));
-	std::memcpy(header.mtime, res, sizeof(header.mtime));
+	/* 11 digits run out in 2242 */
+	bool mtimeFits = headerInfo.mtime >= 0 &&
+		HeaderCodec::toOctal(headerInfo.mtime, header.mtime, sizeof(header.mtime));
+	if (!mtimeFits)
+	{
+		HeaderCodec::toOctal(0, header.mtime, sizeof(header.mtime));
+	}
+	if (!mtimeFits || (preciseTimes && headerInfo.mtimeNsec))
+	{
+		extend("mtime", PaxHeader::timeValue(headerInfo.mtime, preciseTimes ? headerInfo.mtimeNsec : 0));
+	}
 
-	std:memset(header.chksum, 0x20, sizeof(header.chksum));
+	std::memset(header.chksum, 0x20, sizeof(header.chksum));
 	
 	header.typeflag = headerInfo.typeflag;
-	std::memcpy(header.linkname, headerInfo.linkname.c_str(), headerInfo.linkname.length());
-	std::memcpy(header.magic, headerInfo.magic.c_str(), headerInfo.magic.length());
-	std::memcpy(header.version, headerInfo.version.c_str(), headerInfo.version.length());
-	std::memcpy(header.uname, headerInfo.uname.c_str(), headerInfo.uname.length());
-	std::memcpy(header.gname, headerInfo.gname.c_str(), headerInfo.gname.length());
-
-	if (headerInfo.typeflag == BLKTYPE || headerInfo.typeflag == CHRTYPE)
+	copyText(header.linkname, sizeof(header.linkname), headerInfo.linkname);
+	if (headerInfo.linkname.length() > sizeof(header.linkname))
 	{
-		toOctStr(headerInfo.devmajor, res, sizeof(header.devmajor));
-		std::memcpy(header.devmajor, res, sizeof(header.devmajor));
-		toOctStr(headerInfo.devminor, res, sizeof(header.devminor));
-		std::memcpy(header.devminor, res, sizeof(header.devminor));
+		extend("linkpath", headerInfo.linkname);
 	}
-
-	/* only at the end */
-	int64_t checkSum = calculateUnsignedCheckSum(header);
-	toOctStr(checkSum, res, 7);
-	std::memcpy(header.chksum, res, 6);
-
-	return header;
-}
-
-int64_t
-TarPacker::calculateUnsignedCheckSum(const PosixHeader & header) 
-{
-	int64_t checksum = 0;
-	const uint8_t * bytes = reinterpret_cast<const uint8_t *>(&header);
-	for (size_t i = 0; i < BLOCK_SIZE; ++i) {
-		checksum += bytes[i];
+	copyText(header.magic, sizeof(header.magic), headerInfo.magic);
+	copyText(header.version, sizeof(header.version), headerInfo.version);
+	copyText(header.uname, sizeof(header.uname), headerInfo.uname);
+	if (headerInfo.uname.length() > sizeof(header.uname))
+	{
+		extend("uname", headerInfo.uname);
+	}
+	copyText(header.gname, sizeof(header.gname), headerInfo.gname);
+	if (headerInfo.gname.length() > sizeof(header.gname))
+	{
+		extend("gname", headerInfo.gname);
 	}
-	return checksum;
-}
-
-void
-TarPacker::toOctStr(int64_t value, int8_t * res, int32_t n)
-{
-	uint32_t radix = 8;
 
-	int32_t i = n - 2;
-	while (value > 0)
+	/* gnu tar reads pax records only for a member with posix magic */
+	if (member && !extendedRecords.empty())
 	{
-		res[i] = (value % radix) + '0';
-		value /= radix;
-		i--;
+		std::memcpy(header.magic, PAXMAGIC, sizeof(header.magic));
+		std::memcpy(header.version, PAXVERSION, sizeof(header.version));
 	}
 
-	while (i >= 0)
+	if (headerInfo.typeflag == BLKTYPE || headerInfo.typeflag == CHRTYPE)
 	{
-		res[i] = '0';
-		i--;
+		HeaderCodec::toOctal(headerInfo.devmajor, header.devmajor, sizeof(header.devmajor));
+		HeaderCodec::toOctal(headerInfo.devminor, header.devminor, sizeof(header.devminor));
 	}
 
-	res[n - 1] = '\0';
+	/* only at the end: 6 digits, NUL, space */
+	HeaderCodec::toOctal(HeaderCodec::sum(&header), header.chksum, 7);
+
+	return header;
 }
@@ -2,58 +2,244 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/sysmacros.h>
+#include <fcntl.h>
 #include <linux/kdev_t.h>
 #include <unistd.h>
 #include <dirent.h>
-#include <pwd.h>
-#include <grp.h>
 #include <sstream>
 
 #include "../TarCommon.h"
-
-typedef std::vector<std::string> VecStr;
+#include "../Copy/CopyEngine.h"
+#include "../Header/HeaderCodec.h"
+#include "../Index/ArchiveIndex.h"
+#include "../Compress/CompressStreamBuf.h"
+#include "../Owner/OwnerCache.h"
+#include "../Walk/TreeWalker.h"
+#include "../Snapshot/Snapshot.h"
+#include "../Dedup/DedupStreamBuf.h"
+#include "../Pax/PaxHeader.h"
+#include "../Sparse/SparseMap.h"
+#include "../Link/LinkTable.h"
+#include "../Sink/OutputSink.h"
+
+enum class PackMode
+{
+	CREATE = 0,		/* new archive */
+	APPEND,			/* members go over the end blocks of an existing plain archive */
+	UPDATE			/* append, but only entries newer than their last copy in the archive */
+};
 
 class TarPacker
 {
 private:
 	PosixHeader header;
 	ContentData emptyBuffer = { 0 }; /* eof */
-	ContentData buffer; 
+	CopyEngine copyEngine;
+	bool zeroCopy = false;
+	int archiveFd = -1;		/* second descriptor of target file for kernel copy */
+	size_t threadCount = 1;
+	size_t memoryBudget;
+	bool indexed = false;
+	ArchiveIndex index;
+	Compression compression = Compression::NONE;
+	int compressionLevel = COMPRESS_DEFAULT_LEVEL;
+	bool seekable = false;
+	CompressStreamBuf * frameBuf = nullptr;	/* cut compressed pieces at members while packing */
+	OwnerCache owners;
+	std::string ownerCachePath;
+	WalkOrder walkOrder = WalkOrder::NAME;
+	std::string dirName;	/* directory member name with its slash */
+	bool uring = false;
+	std::string snapshotPath;
+	Snapshot previous;		/* state after the last run, empty for a full dump */
+	Snapshot current;
+
+	std::string listing;	/* dumpdir of the directory being packed */
+	std::string dedupStorePath;
+	DedupStreamBuf * dedupBuf = nullptr;	/* cut chunks at headers while packing */
+	PackMode mode = PackMode::CREATE;
+	bool appending = false;
+	ArchiveIndex archived;	/* members of the archive appended to, read only while packing */
+	bool sparse = false;
+	std::vector<SparseExtent> extents;	/* of the sparse file being packed */
+	std::string sparseMap;
+	std::string extendedRecords;	/* pax records of the member being packed, usually none */
+	std::string extendedName;
+	std::string sparseName;
+	bool preciseTimes = false;
+	bool hardLinks = true;
+	bool alignPayloads = false;
+	bool aligning = false;		/* alignPayloads and the archive is written as it is */
+	uint64_t streamOffset = 0;	/* of the next header in the tar stream */
+	LinkTable links;
+	std::string linkTarget;
+	std::string symlinkTarget;
+
+	bool packInternal(std::ostream & targetFile, const std::string & path, const std::string & name);
+
+	/* owner cache, snapshot and link table before a run, saved after it */
+	void startRun();
+	void finishRun(bool packed);
+
+	/* compressed, deduplicated or plain archive into target; archiveSize as written there */
+	bool packEncoded(std::ostream & target, const std::string & basePath, const std::string & name,
+		uint64_t & archiveSize);
 
+public:
+	TarPacker();
 
-	bool packInternal(std::ofstream & targetFile, const std::string & path, const std::string & name);
+	/* false if path or the archive could not be packed, a new archive is removed then */
+	bool pack(const std::string & path);
 
-public:
-	void pack(const std::string & path);
+	/* archive of path with the same compression, dedup and walk options, bytes go to sink */
+	/* as they are made; no index, kernel copy or append, which need the archive file */
+	bool packTo(OutputSink & sink, const std::string & path);
+
+	/* whole archive with end blocks into any stream */
+	bool packStream(std::ostream & targetFile, const std::string & basePath, const std::string & name);
+
+	/* compress archive on thread count workers, false if codec is not built in */
+	bool setCompression(Compression type, int level = COMPRESS_DEFAULT_LEVEL);
+
+	/* compressed pieces start at member boundaries, frame table goes to <archive>.idx */
+	void setSeekable(bool enable);
+
+	/* keep uid/gid names in this file between runs */
+	void setOwnerCache(const std::string & path);
+
+	/* member order inside a directory, see TreeWalker */
+	void setWalkOrder(WalkOrder order);
+
+	/* stat, open and read small files in io_uring batches, see UringPacker */
+	/* falls back to synchronous calls where io_uring is not available */
+	void setUring(bool enable);
+
+	/* append or update keep the archive and write only new members at its end, */
+	/* the <archive>.idx sidecar is written too so the next run does not scan the archive */
+	void setMode(PackMode packMode);
+
+	/* plain archive of targetFilename positioned over its end blocks, members go to archived */
+	bool openAppend(std::fstream & targetFile, const std::string & targetFilename);
+
+	/* update mode: archive already holds entry with the same or newer mtime */
+	bool archivedCurrent(std::string_view name, const struct stat & s) const;
+
+	/* mtimes keep their nanoseconds in pax records, which costs a pax header per member; */
+	/* without it they do only where the header can't hold the seconds */
+	void setPreciseTimes(bool enable);
+
+	/* files with holes are packed as their data extents in GNU sparse format 1.0, */
+	/* holes are found with SEEK_DATA/SEEK_HOLE and never read */
+	void setSparse(bool enable);
+
+	/* file may have holes and goes through packRegFile, not through a batch or read ahead */
+	bool sparseCandidate(const struct stat & s) const { return sparse && SparseMap::candidate(s); }
+
+	/* second and later names of an inode become LNKTYPE members pointing to the first one; */
+	/* on by default, off packs every name with its data */
+	void setHardLinks(bool enable);
+
+	/* file has more links and goes through packEntry, which knows if it was met */
+	bool linkCandidate(const struct stat & s) const { return hardLinks && s.st_nlink > 1 && !S_ISDIR(s.st_mode); }
+
+	/* file must not be read ahead or batched, packEntry decides what it becomes */
+	bool packedAlone(const struct stat & s) const { return sparseCandidate(s) || linkCandidate(s); }
+
+	/* write manifest <name>.tar.dedup instead of archive, unique chunks go to the store */
+	/* directory; the manifest is not compressed */
+	void setDedup(const std::string & storePath);
 
-	bool getDirectoryFiles(const std::string & directory, VecStr & files);
+	/* incremental archive against the snapshot file, which is rewritten after the run: */
+	/* files unchanged since it are left out and directories get dumpdirs for deletions */
+	void setSnapshot(const std::string & path);
 
-	void addExpand(std::ofstream & output);
+	bool incremental() const { return !snapshotPath.empty(); }
 
-	void packDirectory(std::ofstream & targetFile, const std::string & path, const struct stat & s);
+	/* entry is the same as in the previous snapshot, safe to call from any thread */
+	bool unchanged(std::string_view name, const struct stat & s) const;
 
-	bool packRegFile(std::ofstream & targetFile, const std::string & path, const std::string & name, const struct stat & s);
+	/* every entry goes here in archive order before it is packed, true if it is left out */
+	bool skipUnchanged(std::string_view name, const struct stat & s);
 
-	void packLink(std::ofstream & targetFile, const std::string & path, 
-		const std::string & name, const struct stat & s);
+	/* dumpdir payload of directory name from its children, safe to call from any thread */
+	void listDumpDir(std::string & listing, std::string_view name, const std::vector<WalkChild> & children) const;
 
-	bool packBlockFile(std::ofstream & targetFile, const std::string & path, const std::string & name, const struct stat & s);
+	/* size of one read/write while copying file content */
+	void setChunkSize(size_t size);
 
-	void packFifoFile(std::ofstream & targetFile, const std::string & path,
-		const std::string & name, const struct stat & s);
+	/* move file content with copy_file_range/sendfile, falls back to buffered copy */
+	void setZeroCopy(bool enable);
 
-	void writeContentToTargetFile(const std::unique_ptr<HeaderInfo> & headerInfo,
-		std::ifstream & input, std::ofstream & output);
+	/* write <archive>.idx sidecar with offsets of all members */
+	void setIndex(bool enable);
+
+	/* more than one thread reads files ahead in parallel, see ParallelPacker */
+	void setThreadCount(size_t count);
+
+	/* memory for file content read ahead in parallel mode */
+	void setMemoryBudget(size_t bytes);
+
+	/* payloads of files from CLONE_MIN_SIZE on start at a clone block of a plain archive, */
+	/* a pax header with a comment record fills the gap; see TarUnpacker::setReflink */
+	void setAlignPayloads(bool enable);
+
+	/* header built by convertHeader, with its pax header if it needs one; member is added to index */
+	void writeHeader(std::ostream & targetFile, const HeaderInfo & headerInfo);
+
+	/* pax header of the records collected for headerInfo, align moves the payload */
+	/* of the member to a clone block by a comment record */
+	void writeExtended(std::ostream & targetFile, const HeaderInfo & headerInfo, bool align);
+
+	/* any entry except directory, leaf is its path relative to dirFd (or AT_FDCWD) */
+	bool packEntry(std::ostream & targetFile, int dirFd, const char * leaf, std::string_view name,
+		const struct stat & s);
+
+	void addExpand(std::ostream & output);
+
+	/* incremental archive has dumpdir with listing in place of the directory */
+	void packDirectory(std::ostream & targetFile, std::string_view name, const struct stat & s,
+		std::string_view listing = std::string_view());
+
+	/* directory met by the walk, its listing is made here */
+	void packDirectory(std::ostream & targetFile, const WalkEntry & entry);
+
+	bool packRegFile(std::ostream & targetFile, int dirFd, const char * leaf,
+		std::string_view name, const struct stat & s);
+
+	/* member of map and extents from inputFd, the sparse records go to its pax header */
+	bool packSparseFile(std::ostream & targetFile, int inputFd, std::string_view name, const struct stat & s);
+
+	/* regular file which content is already in memory */
+	bool packRegFileContent(std::ostream & targetFile, std::string_view name,
+		const struct stat & s, const int8_t * content, size_t size);
+
+	bool packRegFileInKernel(std::ostream & targetFile, int inputFd, const HeaderInfo & headerInfo);
+
+	void packLink(std::ostream & targetFile, int dirFd, const char * leaf,
+		std::string_view name, const struct stat & s);
+
+	/* LNKTYPE member of name pointing to target */
+	void packHardLink(std::ostream & targetFile, std::string_view name, const struct stat & s,
+		std::string_view target);
+
+	bool packBlockFile(std::ostream & targetFile, std::string_view name, const struct stat & s);
+
+	void packFifoFile(std::ostream & targetFile, std::string_view name, const struct stat & s);
+
+	/* content from inputFd at its current offset */
+	bool writeContentToTargetFile(const HeaderInfo & headerInfo,
+		int inputFd, std::ostream & output, uint64_t written = 0);
 
 	std::string extractName(const std::string & path);
 
 	std::string getDirFileName(const std::string & path);
 
-	HeaderInfo * createHeader(const std::string & path, int8_t typeflag, const struct stat & s, const std::string & linkname = "");
+	/* name and linkname are viewed, not copied: keep them alive until the header is written */
+	void createHeader(HeaderInfo & headerInfo, std::string_view name, int8_t typeflag, const struct stat & s,
+		std::string_view linkname = std::string_view());
 
+	/* what the header block can't hold (long names, sizes from 8 GiB, big ids, times before */
+	/* 1970 or with nanoseconds) is cut or written base-256 and also added to extendedRecords */
 	PosixHeader convertHeader(const HeaderInfo & headerInfo);
 
-	int64_t calculateUnsignedCheckSum(const PosixHeader & header);
-
-	void toOctStr(int64_t value, int8_t* res, int32_t n);
 };
\ No newline at end of file
@@ -0,0 +1,167 @@
+#include "UringPacker.h"
+
+UringPacker::UringPacker(TarPacker & packer, std::ostream & targetFile, const std::string & path,
+	WalkOrder order, UringQueue & ring)
+	: packer(packer), targetFile(targetFile), path(path), order(order), ring(ring)
+{
+}
+
+bool
+UringPacker::run(const std::string & name)
+{
+	TreeWalker walker(order, &ring);
+	bool walked = walker.walk(path, name, [this](const WalkEntry & entry) {
+		if (S_ISREG(entry.s.st_mode) && entry.s.st_size <= URING_SMALL_FILE && !packer.packedAlone(entry.s))
+		{
+			return packer.skipUnchanged(entry.name, entry.s) || add(entry);
+		}
+
+		/* order of members is kept: everything before goes out first */
+		if (!flush())
+		{
+			return false;
+		}
+
+		if (packer.skipUnchanged(entry.name, entry.s))
+		{
+			return true;
+		}
+
+		if (S_ISDIR(entry.s.st_mode))
+		{
+			packer.packDirectory(targetFile, entry);
+			return true;
+		}
+
+		return packer.packEntry(targetFile, entry.dirFd, entry.leaf, entry.name, entry.s);
+	}, [this]() {
+		/* descriptor of the directory is closed after this */
+		return flush();
+	});
+
+	/* root itself may be a small file */
+	return flush() && walked;
+}
+
+bool
+UringPacker::add(const WalkEntry & entry)
+{
+	size_t size = entry.s.st_size;
+	if (batch.size() == ring.depth() || (dataUsed + size > URING_BATCH_BYTES && !batch.empty()))
+	{
+		if (!flush())
+		{
+			return false;
+		}
+	}
+
+	Pending pending;
+	pending.nameOffset = names.size();
+	pending.nameLength = entry.name.length();
+	names.insert(names.end(), entry.name.begin(), entry.name.end());
+	pending.leafOffset = names.size();
+	names.insert(names.end(), entry.leaf, entry.leaf + strlen(entry.leaf) + 1);
+	pending.dirFd = entry.dirFd;
+	pending.fd = -1;
+	pending.dataOffset = dataUsed;
+	pending.got = 0;
+	pending.s = entry.s;
+	batch.push_back(pending);
+
+	dataUsed += size;
+	if (data.size() < dataUsed)
+	{
+		data.resize(dataUsed);
+	}
+
+	return true;
+}
+
+bool
+UringPacker::flush()
+{
+	if (batch.empty())
+	{
+		return true;
+	}
+
+	/* names don't move any more, leaves can be given to the kernel */
+	for (size_t i = 0; i < batch.size(); ++i)
+	{
+		ring.openat(batch[i].dirFd, names.data() + batch[i].leafOffset, O_RDONLY | O_CLOEXEC, 0, i);
+	}
+	bool completed = ring.complete([this](uint64_t i, int32_t result) {
+		batch[i].fd = result >= 0 ? result : -1;
+	});
+
+	size_t reads = 0;
+	for (size_t i = 0; completed && i < batch.size(); ++i)
+	{
+		if (batch[i].fd != -1 && batch[i].s.st_size > 0)
+		{
+			ring.read(batch[i].fd, data.data() + batch[i].dataOffset, batch[i].s.st_size, 0, i);
+			reads++;
+		}
+	}
+	if (completed && reads)
+	{
+		completed = ring.complete([this](uint64_t i, int32_t result) {
+			batch[i].got = result > 0 ? result : 0;
+		});
+	}
+
+	bool result = completed;
+	for (size_t i = 0; result && i < batch.size(); ++i)
+	{
+		Pending & pending = batch[i];
+		std::string_view name(names.data() + pending.nameOffset, pending.nameLength);
+		if (pending.fd == -1)
+		{
+			/* can't open file */
+			result = false;
+			break;
+		}
+
+		int8_t * content = data.data() + pending.dataOffset;
+		size_t size = pending.s.st_size;
+		while (pending.got < size)
+		{
+			/* short read, finish it synchronously */
+			ssize_t n = pread(pending.fd, content + pending.got, size - pending.got, pending.got);
+			if (n <= 0)
+			{
+				/* truncated while packing, the rest goes as zeros */
+				printf("File %.*s shrank while packing, padded with zeros.\n", (int)name.length(), name.data());
+				std::memset(content + pending.got, 0, size - pending.got);
+				break;
+			}
+			pending.got += n;
+		}
+
+		result = packer.packRegFileContent(targetFile, name, pending.s, content, size);
+	}
+
+	size_t closes = 0;
+	for (size_t i = 0; i < batch.size(); ++i)
+	{
+		if (batch[i].fd != -1)
+		{
+			if (!completed || !ring.close(batch[i].fd, i))
+			{
+				close(batch[i].fd);
+				continue;
+			}
+			closes++;
+		}
+	}
+	if (closes)
+	{
+		ring.complete([](uint64_t, int32_t) {});
+	}
+
+	batch.clear();
+	names.clear();
+	dataUsed = 0;
+
+	return result;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include "TarPacker.h"
+#include "../Uring/UringQueue.h"
+
+/*
+	io_uring mode of TarPacker.
+	The walk stats through the ring, small regular files it meets are collected
+	into a batch which is opened, read and closed with one submission per step
+	for the whole batch. Headers and content go out in walk order when the batch
+	is written. Directories, links, big files and anything else write the batch
+	first and take the synchronous path of TarPacker, so the archive is the same
+	as without the ring.
+*/
+class UringPacker
+{
+private:
+	struct Pending
+	{
+		size_t nameOffset;
+		size_t nameLength;
+		size_t leafOffset;
+		int dirFd;
+		int fd;
+		size_t dataOffset;
+		size_t got;
+		struct stat s;
+	};
+
+	TarPacker & packer;
+	std::ostream & targetFile;
+	std::string path;
+	WalkOrder order;
+	UringQueue & ring;
+
+	std::vector<Pending> batch;
+	std::vector<char> names;	/* member names and leaves of the batch */
+	std::vector<int8_t> data;
+	size_t dataUsed = 0;
+
+	/* small regular file, false if the batch could not be written to make room */
+	bool add(const WalkEntry & entry);
+
+	/* read and write all pending files, false stops packing like TarPacker::packRegFile */
+	bool flush();
+
+public:
+	UringPacker(TarPacker & packer, std::ostream & targetFile, const std::string & path,
+		WalkOrder order, UringQueue & ring);
+
+	/* pack entry name under path, false if packing was stopped */
+	bool run(const std::string & name);
+};
@@ -0,0 +1,258 @@
+#include <charconv>
+
+#include "PaxHeader.h"
+
+void
+PaxHeader::addRecord(std::string & payload, std::string_view keyword, std::string_view value)
+{
+	/* " keyword=value\n" and the digits of the length, which may add a digit itself */
+	size_t body = 1 + keyword.length() + 1 + value.length() + 1;
+	size_t length = body + 1;
+	while (length != body + std::to_string(length).length())
+	{
+		length = body + std::to_string(length).length();
+	}
+
+	payload += std::to_string(length);
+	payload += ' ';
+	payload.append(keyword);
+	payload += '=';
+	payload.append(value);
+	payload += '\n';
+}
+
+void
+PaxHeader::addFill(std::string & payload, size_t length)
+{
+	/* length is known, no search for its digits: near 10^n two lengths fit one body */
+	const std::string digits = std::to_string(length);
+	payload += digits;
+	payload += " comment=";
+	payload.append(length - digits.length() - strlen(" comment=\n"), ' ');
+	payload += '\n';
+}
+
+std::string
+PaxHeader::timeValue(int64_t seconds, uint32_t nanoseconds)
+{
+	if (nanoseconds == 0)
+	{
+		return std::to_string(seconds);
+	}
+
+	/* before 1970 the fraction counts back from the second after */
+	std::string value = std::to_string(seconds < 0 ? -(seconds + 1) : seconds);
+	if (seconds < 0)
+	{
+		value.insert(0, 1, '-');
+	}
+	std::string fraction = std::to_string(seconds < 0 ? 1000000000 - nanoseconds : nanoseconds);
+	fraction.insert(0, 9 - fraction.length(), '0');
+	fraction.erase(fraction.find_last_not_of('0') + 1);
+
+	return value + '.' + fraction;
+}
+
+/* decimal value of a record, false leaves number alone */
+template <typename Number>
+static bool
+parseNumber(std::string_view value, Number & number)
+{
+	auto result = std::from_chars(value.data(), value.data() + value.length(), number);
+	return result.ec == std::errc() && result.ptr == value.data() + value.length();
+}
+
+/* "<seconds>[.<fraction>]", seconds may be negative */
+static bool
+parseTime(std::string_view value, int64_t & seconds, uint32_t & nanoseconds)
+{
+	size_t dot = value.find('.');
+	if (!parseNumber(value.substr(0, dot), seconds))
+	{
+		return false;
+	}
+
+	nanoseconds = 0;
+	if (dot == std::string_view::npos)
+	{
+		return true;
+	}
+
+	/* digits past nanoseconds are dropped */
+	std::string_view fraction = value.substr(dot + 1);
+	for (size_t i = 0; i < 9; ++i)
+	{
+		char digit = i < fraction.length() ? fraction[i] : '0';
+		if (digit < '0' || digit > '9')
+		{
+			return false;
+		}
+		nanoseconds = nanoseconds * 10 + (digit - '0');
+	}
+
+	if (value[0] == '-' && nanoseconds)
+	{
+		seconds -= 1;
+		nanoseconds = 1000000000 - nanoseconds;
+	}
+	return true;
+}
+
+bool
+PaxHeader::parse(bool globalHeader)
+{
+	clear();
+	pending = true;
+	global = globalHeader;
+
+	std::string_view data = payload;
+	size_t pos = 0;
+	while (pos < data.length() && data[pos] != '\0')
+	{
+		size_t length = 0;
+		auto result = std::from_chars(data.data() + pos, data.data() + data.length(), length);
+		if (result.ec != std::errc() || *result.ptr != ' ' || length == 0 ||
+			length > data.length() - pos || data[pos + length - 1] != '\n')
+		{
+			return false;
+		}
+
+		std::string_view record = data.substr(pos, length - 1);
+		record.remove_prefix(result.ptr - (data.data() + pos) + 1);
+		pos += length;
+
+		size_t equal = record.find('=');
+		if (equal == std::string_view::npos)
+		{
+			return false;
+		}
+		std::string_view keyword = record.substr(0, equal);
+		std::string_view value = record.substr(equal + 1);
+
+		if (keyword == "path")
+		{
+			path = value;
+		}
+		else if (keyword == "linkpath")
+		{
+			linkpath = value;
+		}
+		else if (keyword == "size")
+		{
+			hasSize = parseNumber(value, size);
+		}
+		else if (keyword == "mtime")
+		{
+			hasMtime = parseTime(value, mtime, mtimeNsec);
+		}
+		else if (keyword == "uid")
+		{
+			hasUid = parseNumber(value, uid);
+		}
+		else if (keyword == "gid")
+		{
+			hasGid = parseNumber(value, gid);
+		}
+		else if (keyword == "uname")
+		{
+			uname = value;
+		}
+		else if (keyword == "gname")
+		{
+			gname = value;
+		}
+		else if (keyword == "GNU.sparse.name")
+		{
+			sparseName = value;
+		}
+		else if (keyword == "GNU.sparse.realsize")
+		{
+			parseNumber(value, sparseRealSize);
+		}
+		else if (keyword == "GNU.sparse.major")
+		{
+			parseNumber(value, sparseMajor);
+		}
+	}
+
+	return true;
+}
+
+bool
+PaxHeader::apply(HeaderInfo & headerInfo)
+{
+	if (!pending)
+	{
+		return false;
+	}
+
+	if (!global)
+	{
+		pending = false;
+
+		if (!path.empty())
+		{
+			headerInfo.name = path;
+		}
+		if (!linkpath.empty())
+		{
+			headerInfo.linkname = linkpath;
+		}
+		if (hasSize)
+		{
+			headerInfo.size = size;
+			headerInfo.blockCount = (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+			headerInfo.reminderBytes = size % BLOCK_SIZE;
+		}
+	}
+
+	if (hasMtime)
+	{
+		headerInfo.mtime = mtime;
+		headerInfo.mtimeNsec = mtimeNsec;
+	}
+	if (hasUid)
+	{
+		headerInfo.uid = uid;
+	}
+	if (hasGid)
+	{
+		headerInfo.gid = gid;
+	}
+	if (!uname.empty())
+	{
+		headerInfo.uname = uname;
+	}
+	if (!gname.empty())
+	{
+		headerInfo.gname = gname;
+	}
+
+	/* only format 1.0 keeps the map in the payload, 0.x put it into the records */
+	if (!global && sparseMajor == 1 && !sparseName.empty())
+	{
+		headerInfo.name = sparseName;
+		headerInfo.sparse = true;
+		headerInfo.realSize = sparseRealSize;
+	}
+
+	return true;
+}
+
+void
+PaxHeader::clear()
+{
+	pending = false;
+	global = false;
+	path = std::string_view();
+	linkpath = std::string_view();
+	uname = std::string_view();
+	gname = std::string_view();
+	hasSize = false;
+	hasMtime = false;
+	hasUid = false;
+	hasGid = false;
+	sparseName = std::string_view();
+	sparseRealSize = 0;
+	sparseMajor = -1;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "../TarCommon.h"
+
+/* shortest comment record, "12 comment=\n" */
+#define PAX_FILL_MIN 12
+
+/*
+	Records of a pax extended header (typeflag 'x') or global header ('g'):
+	"<length> <keyword>=<value>\n", length counts the whole record with its own digits.
+	Unpacker parses the header into this object and applies it to the member
+	which follows, a global header to every member after it; values are views
+	into the payload kept here, valid until the next parse. Keywords which are
+	not known are ignored, so are path, linkpath and size of a global header.
+*/
+class PaxHeader
+{
+private:
+	std::string payload;
+	bool pending = false;
+	bool global = false;
+
+	std::string_view path;
+	std::string_view linkpath;
+	std::string_view uname;
+	std::string_view gname;
+	uint64_t size = 0;
+	bool hasSize = false;
+	int64_t mtime = 0;
+	uint32_t mtimeNsec = 0;
+	bool hasMtime = false;
+	uint64_t uid = 0;
+	bool hasUid = false;
+	uint64_t gid = 0;
+	bool hasGid = false;
+
+	std::string_view sparseName;
+	uint64_t sparseRealSize = 0;
+	int sparseMajor = -1;
+
+public:
+	/* append one record */
+	static void addRecord(std::string & payload, std::string_view keyword, std::string_view value);
+
+	/* append a comment record of exactly length bytes, from PAX_FILL_MIN on */
+	static void addFill(std::string & payload, size_t length);
+
+	/* seconds, and nanoseconds without trailing zeros when there are any */
+	static std::string timeValue(int64_t seconds, uint32_t nanoseconds);
+
+	/* typeflag of a header whose payload is records */
+	static bool isPaxType(int8_t typeflag) { return typeflag == XHDTYPE || typeflag == XGLTYPE; }
+
+	/* payload is read in here before parse */
+	std::string & data() { return payload; }
+
+	/* records of data() for the next member, or for all of them if globalHeader; */
+	/* false if a record is malformed */
+	bool parse(bool globalHeader = false);
+
+	/* member name given by the records, empty if none */
+	std::string_view name() const { return sparseName.empty() ? path : sparseName; }
+
+	/* member after the extended header takes its attributes, once; a global header */
+	/* keeps giving them; true if anything was applied */
+	bool apply(HeaderInfo & headerInfo);
+
+	void clear();
+};
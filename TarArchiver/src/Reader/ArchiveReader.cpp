@@ -0,0 +1,158 @@
+#include "ArchiveReader.h"
+
+ArchiveReader::~ArchiveReader()
+{
+	close();
+}
+
+bool
+ArchiveReader::open(const std::string & path)
+{
+	close();
+
+	fd = ::open(path.c_str(), O_RDONLY);
+	if (fd == -1)
+	{
+		return false;
+	}
+
+	struct stat s;
+	if (fstat(fd, &s) || s.st_size == 0)
+	{
+		close();
+		return false;
+	}
+
+	void * mapping = mmap(nullptr, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (mapping == MAP_FAILED)
+	{
+		close();
+		return false;
+	}
+
+	/* headers are walked front to back */
+	madvise(mapping, s.st_size, MADV_SEQUENTIAL);
+
+	base = (const int8_t*)mapping;
+	length = s.st_size;
+	return true;
+}
+
+bool
+ArchiveReader::open(const void * data, uint64_t size)
+{
+	close();
+
+	base = (const int8_t*)data;
+	length = size;
+	return base != nullptr;
+}
+
+void
+ArchiveReader::close()
+{
+	/* only a file is mapped here */
+	if (base && fd != -1)
+	{
+		munmap((void*)base, length);
+	}
+	base = nullptr;
+	length = 0;
+
+	if (fd != -1)
+	{
+		::close(fd);
+		fd = -1;
+	}
+}
+
+bool
+ArchiveReader::entryAt(uint64_t offset, ArchiveEntry & entry) const
+{
+	if (offset % BLOCK_SIZE || offset + BLOCK_SIZE > length || isEmptyBlock(base + offset))
+	{
+		return false;
+	}
+
+	const PosixHeader * header = (const PosixHeader*)(base + offset);
+	if (!checkSum(*header))
+	{
+		return false;
+	}
+
+	/* offset + BLOCK_SIZE <= length, room can't wrap and a huge size can't make next wrap around */
+	uint64_t room = length - offset - BLOCK_SIZE;
+	uint64_t size = parseOctal(header->size, sizeof(header->size));
+	if (size > room || (size + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE > room)
+	{
+		/* truncated archive */
+		return false;
+	}
+	uint64_t blocks = (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+	entry.header = header;
+	entry.data = base + offset + BLOCK_SIZE;
+	entry.size = size;
+	entry.offset = offset;
+	entry.next = offset + BLOCK_SIZE + blocks * BLOCK_SIZE;
+	return true;
+}
+
+bool
+ArchiveReader::hasExpand() const
+{
+	return length >= 2 * BLOCK_SIZE &&
+		isEmptyBlock(base + length - 2 * BLOCK_SIZE) &&
+		isEmptyBlock(base + length - BLOCK_SIZE);
+}
+
+bool
+ArchiveReader::complete() const
+{
+	uint64_t offset = 0;
+	for (auto it = begin(); it != end(); ++it)
+	{
+		offset = it->next;
+	}
+
+	return offset + BLOCK_SIZE <= length && isEmptyBlock(base + offset);
+}
+
+bool
+ArchiveReader::isEmptyBlock(const int8_t * block)
+{
+	static const ContentData emptyBuffer = { 0 };
+	return std::memcmp(block, &emptyBuffer, BLOCK_SIZE) == 0;
+}
+
+bool
+ArchiveReader::checkSum(const PosixHeader & header)
+{
+	return HeaderCodec::checksum(header) == parseOctal(header.chksum, sizeof(header.chksum));
+}
+
+uint64_t
+ArchiveReader::parseOctal(const int8_t * field, size_t length)
+{
+	return HeaderCodec::parseOctal(field, length);
+}
+
+ArchiveReader::Iterator::Iterator(const ArchiveReader * reader, uint64_t offset)
+	: reader(reader)
+{
+	if (reader && !reader->entryAt(offset, entry))
+	{
+		this->reader = nullptr;
+	}
+}
+
+ArchiveReader::Iterator &
+ArchiveReader::Iterator::operator++()
+{
+	if (reader && !reader->entryAt(entry.next, entry))
+	{
+		reader = nullptr;
+	}
+
+	return *this;
+}
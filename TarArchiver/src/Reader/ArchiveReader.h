@@ -0,0 +1,87 @@
+#pragma once
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../TarCommon.h"
+#include "../Header/HeaderCodec.h"
+
+/* one member as it lies in the mapping, nothing is copied */
+struct ArchiveEntry
+{
+	const PosixHeader * header = nullptr;
+	const int8_t * data = nullptr;		/* payload */
+	uint64_t size = 0;					/* payload bytes, without padding */
+	uint64_t offset = 0;				/* header position in archive */
+	uint64_t next = 0;					/* position of the next header */
+};
+
+/*
+	Read only mapping of a whole archive, or an archive already in memory.
+	Entries are walked with an iterator or taken by header offset in O(1),
+	headers and payloads are pointers into the mapping.
+	Iteration stops on the end of archive block, on a header with wrong checksum
+	or on a member which runs past the end of file; complete() tells which one it was.
+*/
+class ArchiveReader
+{
+private:
+	int fd = -1;
+	const int8_t * base = nullptr;
+	uint64_t length = 0;
+
+public:
+	class Iterator
+	{
+	private:
+		const ArchiveReader * reader;
+		ArchiveEntry entry;
+
+	public:
+		Iterator(const ArchiveReader * reader, uint64_t offset);
+
+		const ArchiveEntry & operator*() const { return entry; }
+		const ArchiveEntry * operator->() const { return &entry; }
+
+		Iterator & operator++();
+
+		bool operator!=(const Iterator & other) const { return reader != other.reader; }
+	};
+
+	ArchiveReader() {}
+	~ArchiveReader();
+
+	ArchiveReader(const ArchiveReader &) = delete;
+	ArchiveReader & operator=(const ArchiveReader &) = delete;
+
+	bool open(const std::string & path);
+
+	/* archive in memory, not owned: it stays valid and unchanged while the reader is used */
+	bool open(const void * data, uint64_t size);
+
+	void close();
+
+	/* iteration from the first header, end() is reached on end of archive or on error */
+	Iterator begin() const { return Iterator(this, 0); }
+	Iterator end() const { return Iterator(nullptr, 0); }
+
+	/* entry with header at offset, false if there is no valid header */
+	bool entryAt(uint64_t offset, ArchiveEntry & entry) const;
+
+	/* archive ends with 2 empty blocks, same check as TarUnpacker::checkExpand */
+	bool hasExpand() const;
+
+	/* whole archive can be walked up to the end of archive block */
+	bool complete() const;
+
+	const int8_t * data() const { return base; }
+	uint64_t size() const { return length; }
+
+	static bool isEmptyBlock(const int8_t * block);
+
+	static bool checkSum(const PosixHeader & header);
+
+	static uint64_t parseOctal(const int8_t * field, size_t length);
+};
@@ -0,0 +1,57 @@
+#include "MemberReader.h"
+
+bool
+MemberReader::next()
+{
+	ArchiveEntry entry;
+	uint64_t first = offset;
+
+	for (;;)
+	{
+		if (!reader.entryAt(offset, entry))
+		{
+			/* end block, or a header which is cut or wrong */
+			damaged = offset + BLOCK_SIZE > reader.size() || !ArchiveReader::isEmptyBlock(reader.data() + offset);
+			return false;
+		}
+		offset = entry.next;
+
+		if (!PaxHeader::isPaxType(entry.header->typeflag))
+		{
+			break;
+		}
+
+		bool globalHeader = entry.header->typeflag == XGLTYPE;
+		PaxHeader & records = globalHeader ? global : extended;
+		records.data().assign((const char*)entry.data, entry.size);
+		if (!records.parse(globalHeader))
+		{
+			damaged = true;
+			return false;
+		}
+		if (globalHeader)
+		{
+			first = offset;
+		}
+	}
+
+	member.info = HeaderInfo();
+	HeaderCodec::decode(*entry.header, member.info);
+	HeaderCodec::joinPrefix(member.info, prefixedName);
+	global.apply(member.info);
+	extended.apply(member.info);
+
+	member.data = entry.data;
+	member.size = entry.size;
+	member.offset = first;
+	return true;
+}
+
+void
+MemberReader::rewind()
+{
+	offset = 0;
+	damaged = false;
+	extended.clear();
+	global.clear();
+}
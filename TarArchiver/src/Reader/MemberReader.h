@@ -0,0 +1,46 @@
+#pragma once
+
+#include "ArchiveReader.h"
+#include "../Pax/PaxHeader.h"
+
+/* member with what its pax headers say, payload is a view into the archive */
+struct ArchiveMember
+{
+	HeaderInfo info;				/* text fields view into the archive or its pax records */
+	const int8_t * data = nullptr;	/* payload: content, or map and extents of a sparse member */
+	uint64_t size = 0;				/* payload bytes */
+	uint64_t offset = 0;			/* first header of the member, its pax header if it has one */
+};
+
+/*
+	Members of an archive held by an ArchiveReader, mapped file or memory,
+	front to back. Pax extended and global headers are applied to the member
+	they belong to and not returned, a ustar prefix is joined to the name.
+	Only pax records and joined names are copied; views of current() are
+	valid until the next call of next().
+*/
+class MemberReader
+{
+private:
+	const ArchiveReader & reader;
+	uint64_t offset = 0;		/* of the next header */
+	bool damaged = false;
+	PaxHeader extended;
+	PaxHeader global;
+	std::string prefixedName;
+	ArchiveMember member;
+
+public:
+	explicit MemberReader(const ArchiveReader & reader) : reader(reader) {}
+
+	/* false at the end of archive, or on a header or pax record which is damaged */
+	bool next();
+
+	const ArchiveMember & current() const { return member; }
+
+	/* next() stopped before the end of archive */
+	bool bad() const { return damaged; }
+
+	/* walk again from the first member */
+	void rewind();
+};
@@ -0,0 +1,134 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+
+#include "OutputSink.h"
+
+OutputSink::OutputSink(size_t bufferSize)
+	: buffer(bufferSize)
+{
+	setp(buffer.data(), buffer.data() + buffer.size());
+}
+
+bool
+OutputSink::drain()
+{
+	size_t size = pptr() - pbase();
+	if (size && !failed)
+	{
+		failed = !consume(pbase(), size);
+	}
+	setp(buffer.data(), buffer.data() + buffer.size());
+	return !failed;
+}
+
+OutputSink::int_type
+OutputSink::overflow(int_type c)
+{
+	if (!drain())
+	{
+		return traits_type::eof();
+	}
+	if (traits_type::eq_int_type(c, traits_type::eof()))
+	{
+		return traits_type::not_eof(c);
+	}
+
+	char byte = traits_type::to_char_type(c);
+	if (buffer.empty())
+	{
+		failed = !consume(&byte, 1);
+		return failed ? traits_type::eof() : c;
+	}
+
+	*pptr() = byte;
+	pbump(1);
+	return c;
+}
+
+std::streamsize
+OutputSink::xsputn(const char * data, std::streamsize count)
+{
+	if (failed)
+	{
+		return 0;
+	}
+
+	/* fits: gathered */
+	if (count < epptr() - pptr())
+	{
+		std::memcpy(pptr(), data, count);
+		pbump((int)count);
+		return count;
+	}
+
+	if (!drain())
+	{
+		return 0;
+	}
+
+	/* goes through as it is, after what was gathered before it */
+	if (count >= (std::streamsize)buffer.size())
+	{
+		failed = !consume(data, count);
+		return failed ? 0 : count;
+	}
+
+	std::memcpy(pptr(), data, count);
+	pbump((int)count);
+	return count;
+}
+
+int
+OutputSink::sync()
+{
+	return drain() ? 0 : -1;
+}
+
+bool
+OutputSink::flush()
+{
+	return drain();
+}
+
+bool
+FdSink::consume(const char * data, size_t size)
+{
+	size_t done = 0;
+	while (done < size)
+	{
+		ssize_t n = write(fd, data + done, size - done);
+		if (n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (n <= 0)
+		{
+			return false;
+		}
+		done += n;
+	}
+	return true;
+}
+
+FileSink::FileSink(const std::string & path, size_t bufferSize)
+	: FdSink(open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666), bufferSize)
+{
+}
+
+FileSink::~FileSink()
+{
+	if (fd != -1)
+	{
+		flush();
+		close(fd);
+		fd = -1;
+	}
+}
+
+bool
+MemorySink::consume(const char * data, size_t size)
+{
+	bytes.append(data, size);
+	return true;
+}
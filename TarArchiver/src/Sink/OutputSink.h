@@ -0,0 +1,111 @@
+#pragma once
+#include <streambuf>
+#include <functional>
+
+#include "../TarCommon.h"
+
+/* bytes gathered before a buffered sink gets them */
+#define SINK_BUFFER_SIZE (1024 * 1024)
+
+/*
+	Output stream buffer which hands archive bytes, in order, to a backend.
+	Small writes (headers, padding) are gathered in a buffer, writes as big as
+	the buffer go to the backend without a copy; a sink without a buffer gets
+	every write as it is. Backend returning false stops packing: the stream
+	goes bad and TarPacker gives up. Sinks never seek, so a packer writing to
+	one has no kernel copy and no append.
+*/
+class OutputSink : public std::streambuf
+{
+private:
+	std::vector<char> buffer;
+	bool failed = false;
+
+	bool drain();
+
+protected:
+	/* next bytes of the archive, false on error */
+	virtual bool consume(const char * data, size_t size) = 0;
+
+	int_type overflow(int_type c) override;
+
+	std::streamsize xsputn(const char * data, std::streamsize count) override;
+
+	int sync() override;
+
+public:
+	explicit OutputSink(size_t bufferSize = SINK_BUFFER_SIZE);
+	virtual ~OutputSink() {}
+
+	OutputSink(const OutputSink &) = delete;
+	OutputSink & operator=(const OutputSink &) = delete;
+
+	/* buffered bytes go to the backend, false if it failed now or before */
+	bool flush();
+
+	bool bad() const { return failed; }
+};
+
+/* descriptor which is not owned: stdout, pipe, socket */
+class FdSink : public OutputSink
+{
+protected:
+	int fd;
+
+	bool consume(const char * data, size_t size) override;
+
+public:
+	explicit FdSink(int fd, size_t bufferSize = SINK_BUFFER_SIZE) : OutputSink(bufferSize), fd(fd) {}
+	~FdSink() { flush(); }
+};
+
+/* file created or truncated at path */
+class FileSink : public FdSink
+{
+public:
+	explicit FileSink(const std::string & path, size_t bufferSize = SINK_BUFFER_SIZE);
+	~FileSink();
+
+	bool isOpen() const { return fd != -1; }
+};
+
+/* whole archive in memory, written through without a buffer */
+class MemorySink : public OutputSink
+{
+private:
+	std::string bytes;
+
+protected:
+	bool consume(const char * data, size_t size) override;
+
+public:
+	MemorySink() : OutputSink(0) {}
+
+	const std::string & data() const { return bytes; }
+
+	/* archive moves out, sink is empty after it */
+	std::string take() { return std::move(bytes); }
+
+	/* next archive goes over this one, capacity stays */
+	void clear() { bytes.clear(); }
+
+	void reserve(size_t size) { bytes.reserve(size); }
+};
+
+/* user code gets the bytes: compressor, socket, multipart upload */
+class CallbackSink : public OutputSink
+{
+public:
+	typedef std::function<bool(const char * data, size_t size)> Callback;
+
+private:
+	Callback callback;
+
+protected:
+	bool consume(const char * data, size_t size) override { return callback(data, size); }
+
+public:
+	explicit CallbackSink(const Callback & callback, size_t bufferSize = SINK_BUFFER_SIZE)
+		: OutputSink(bufferSize), callback(callback) {}
+	~CallbackSink() { flush(); }
+};
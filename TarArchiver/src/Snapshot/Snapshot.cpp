@@ -0,0 +1,120 @@
+#include <cstdio>
+#include <iomanip>
+
+#include "Snapshot.h"
+
+static bool
+sameTime(const struct timespec & a, const struct timespec & b)
+{
+	return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+}
+
+void
+Snapshot::record(std::string_view name, const struct stat & s)
+{
+	SnapshotEntry entry;
+	entry.dev = s.st_dev;
+	entry.ino = s.st_ino;
+	entry.size = s.st_size;
+	entry.mtime = s.st_mtim;
+	entry.ctime = s.st_ctim;
+
+	auto it = entries.find(name);
+	if (it != entries.end())
+	{
+		it->second = entry;
+		return;
+	}
+
+	names.emplace_back(name);
+	entries.emplace(names.back(), entry);
+}
+
+bool
+Snapshot::unchanged(std::string_view name, const struct stat & s) const
+{
+	auto it = entries.find(name);
+	if (it == entries.end())
+	{
+		return false;
+	}
+
+	const SnapshotEntry & entry = it->second;
+	return entry.dev == s.st_dev && entry.ino == s.st_ino && entry.size == s.st_size &&
+		sameTime(entry.mtime, s.st_mtim) && sameTime(entry.ctime, s.st_ctim);
+}
+
+void
+Snapshot::clear()
+{
+	entries.clear();
+	names.clear();
+}
+
+bool
+Snapshot::load(const std::string & path)
+{
+	std::ifstream input(path);
+	if (!input.is_open())
+	{
+		return false;
+	}
+
+	unsigned long long dev, ino;
+	long long size;
+	struct timespec mtime, ctime;
+	char dot;
+	std::string name;
+	struct stat s;
+	std::memset(&s, 0, sizeof(s));
+
+	while (input >> dev >> ino >> size >> mtime.tv_sec >> dot >> mtime.tv_nsec >> ctime.tv_sec >> dot >> ctime.tv_nsec)
+	{
+		input.get();
+		std::getline(input, name);
+
+		s.st_dev = dev;
+		s.st_ino = ino;
+		s.st_size = size;
+		s.st_mtim = mtime;
+		s.st_ctim = ctime;
+		record(name, s);
+	}
+
+	return true;
+}
+
+bool
+Snapshot::save(const std::string & path) const
+{
+	const std::string temporary = path + ".tmp";
+	std::ofstream output(temporary);
+	if (!output.is_open())
+	{
+		return false;
+	}
+
+	for (auto it = entries.begin(); it != entries.end(); ++it)
+	{
+		if (it->first.find('\n') != std::string_view::npos)
+		{
+			continue;
+		}
+
+		const SnapshotEntry & entry = it->second;
+		output << (unsigned long long)entry.dev << ' ' << (unsigned long long)entry.ino << ' '
+			<< (long long)entry.size << ' '
+			<< entry.mtime.tv_sec << '.' << std::setw(9) << std::setfill('0') << entry.mtime.tv_nsec << ' '
+			<< entry.ctime.tv_sec << '.' << std::setw(9) << std::setfill('0') << entry.ctime.tv_nsec << ' '
+			<< it->first << '\n';
+	}
+
+	output.close();
+	if (!output)
+	{
+		std::remove(temporary.c_str());
+		return false;
+	}
+
+	return std::rename(temporary.c_str(), path.c_str()) == 0;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unordered_map>
+#include <deque>
+
+#include "../TarCommon.h"
+
+/* what a file was like when it was packed */
+struct SnapshotEntry
+{
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	struct timespec mtime;
+	struct timespec ctime;
+};
+
+/*
+	State of a packed tree for incremental archives, like GNU tar --listed-incremental.
+	Every file is recorded by member name with device, inode, size, mtime and ctime;
+	the next run packs a file again only if it is new or any of them differs.
+	Kept in a file as lines "<dev> <ino> <size> <mtime> <ctime> <name>",
+	times as <sec>.<nsec>. Names with a newline are not saved, such files
+	are packed by every run.
+*/
+class Snapshot
+{
+private:
+	std::deque<std::string> names;		/* keys view into these, deque never moves them */
+	std::unordered_map<std::string_view, SnapshotEntry> entries;
+
+public:
+	void record(std::string_view name, const struct stat & s);
+
+	/* false for a name not recorded */
+	bool unchanged(std::string_view name, const struct stat & s) const;
+
+	size_t size() const { return entries.size(); }
+
+	void clear();
+
+	/* missing file is an empty snapshot, the run is a full dump */
+	bool load(const std::string & path);
+
+	/* through a temporary file, a failed run never leaves half a snapshot */
+	bool save(const std::string & path) const;
+};
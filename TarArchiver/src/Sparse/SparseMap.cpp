@@ -0,0 +1,145 @@
+#include <cerrno>
+#include <unistd.h>
+#include <charconv>
+
+#include "SparseMap.h"
+
+bool
+SparseMap::candidate(const struct stat & s)
+{
+	return S_ISREG(s.st_mode) && (uint64_t)s.st_blocks * 512 < (uint64_t)s.st_size;
+}
+
+bool
+SparseMap::scan(int fd, uint64_t size, std::vector<SparseExtent> & extents)
+{
+	extents.clear();
+
+	uint64_t pos = 0;
+	while (pos < size)
+	{
+		off_t data = lseek(fd, pos, SEEK_DATA);
+		if (data == -1)
+		{
+			if (errno == ENXIO)
+			{
+				/* hole up to the end */
+				break;
+			}
+			return false;
+		}
+
+		off_t hole = lseek(fd, data, SEEK_HOLE);
+		if (hole == -1)
+		{
+			return false;
+		}
+		if ((uint64_t)hole > size)
+		{
+			/* file grew meanwhile, the header has the old size */
+			hole = size;
+		}
+
+		extents.push_back({ (uint64_t)data, (uint64_t)(hole - data) });
+		pos = hole;
+	}
+
+	if (extents.size() == 1 && extents[0].offset == 0 && extents[0].size == size)
+	{
+		return false;
+	}
+
+	if (extents.empty() || extents.back().offset + extents.back().size < size)
+	{
+		extents.push_back({ size, 0 });
+	}
+
+	return true;
+}
+
+void
+SparseMap::encode(const std::vector<SparseExtent> & extents, std::string & map)
+{
+	map = std::to_string(extents.size());
+	map += '\n';
+	for (const SparseExtent & extent : extents)
+	{
+		map += std::to_string(extent.offset);
+		map += '\n';
+		map += std::to_string(extent.size);
+		map += '\n';
+	}
+
+	map.resize((map.length() + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE, '\0');
+}
+
+/* one decimal line at pos, false if it is not all in data */
+static bool
+readNumber(std::string_view data, size_t & pos, uint64_t & value)
+{
+	size_t end = data.find('\n', pos);
+	if (end == std::string_view::npos)
+	{
+		return false;
+	}
+
+	auto result = std::from_chars(data.data() + pos, data.data() + end, value);
+	if (result.ec != std::errc() || result.ptr != data.data() + end)
+	{
+		return false;
+	}
+
+	pos = end + 1;
+	return true;
+}
+
+bool
+SparseMap::decode(std::string_view data, std::vector<SparseExtent> & extents, size_t & mapSize)
+{
+	extents.clear();
+
+	size_t pos = 0;
+	uint64_t count;
+	if (!readNumber(data, pos, count))
+	{
+		return false;
+	}
+
+	for (uint64_t i = 0; i < count; ++i)
+	{
+		SparseExtent extent;
+		if (!readNumber(data, pos, extent.offset) || !readNumber(data, pos, extent.size))
+		{
+			return false;
+		}
+		extents.push_back(extent);
+	}
+
+	mapSize = (pos + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+	return true;
+}
+
+uint64_t
+SparseMap::dataSize(const std::vector<SparseExtent> & extents)
+{
+	uint64_t size = 0;
+	for (const SparseExtent & extent : extents)
+	{
+		size += extent.size;
+	}
+	return size;
+}
+
+void
+SparseMap::memberName(std::string & result, std::string_view name, const char * folder)
+{
+	size_t slash = name.rfind('/');
+	result.clear();
+	if (slash != std::string_view::npos)
+	{
+		result.append(name.substr(0, slash + 1));
+	}
+	result += folder;
+	result += '/';
+	result.append(slash != std::string_view::npos ? name.substr(slash + 1) : name);
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "../TarCommon.h"
+
+/* bytes of a sparse file which hold data, the rest is a hole */
+struct SparseExtent
+{
+	uint64_t offset;
+	uint64_t size;
+};
+
+/*
+	Data extents of sparse files and their map in GNU sparse format 1.0 (pax):
+	the member payload starts with the map as decimal lines - count of extents,
+	then offset and size of each - zero padded to a block, followed by the
+	data of all extents back to back. Real name and size of the file are in
+	the pax records GNU.sparse.name and GNU.sparse.realsize, see PaxHeader.
+	A file ending with a hole gets an empty extent at its size, as GNU tar writes it.
+*/
+class SparseMap
+{
+public:
+	/* file has fewer blocks than its size needs, so it may have holes */
+	static bool candidate(const struct stat & s);
+
+	/* data extents of fd by SEEK_DATA/SEEK_HOLE, false if there is no hole or the filesystem can't tell */
+	static bool scan(int fd, uint64_t size, std::vector<SparseExtent> & extents);
+
+	/* map padded to a block */
+	static void encode(const std::vector<SparseExtent> & extents, std::string & map);
+
+	/* false until data holds the whole map; mapSize is its length with padding */
+	static bool decode(std::string_view data, std::vector<SparseExtent> & extents, size_t & mapSize);
+
+	static uint64_t dataSize(const std::vector<SparseExtent> & extents);
+
+	/* <dir>/<folder>/<leaf> as GNU tar names the members of a sparse file */
+	static void memberName(std::string & result, std::string_view name, const char * folder);
+};
@@ -0,0 +1,101 @@
+#include <unistd.h>
+#include <cerrno>
+
+#include "FdStreamBuf.h"
+
+FdStreamBuf::FdStreamBuf(int fd, size_t bufferSize)
+	: fd(fd), buffer(bufferSize < BLOCK_SIZE ? BLOCK_SIZE : bufferSize)
+{
+	setg(buffer.data(), buffer.data(), buffer.data());
+}
+
+ssize_t
+FdStreamBuf::readSome(char * data, size_t count)
+{
+	for (;;)
+	{
+		ssize_t n = read(fd, data, count);
+		if (n >= 0 || errno != EINTR)
+		{
+			failed = failed || n < 0;
+			return n;
+		}
+	}
+}
+
+bool
+FdStreamBuf::fill()
+{
+	size_t left = egptr() - gptr();
+	if (left == buffer.size())
+	{
+		return false;
+	}
+
+	std::memmove(buffer.data(), gptr(), left);
+	ssize_t n = readSome(buffer.data() + left, buffer.size() - left);
+	setg(buffer.data(), buffer.data(), buffer.data() + left + (n > 0 ? n : 0));
+
+	return n > 0;
+}
+
+FdStreamBuf::int_type
+FdStreamBuf::underflow()
+{
+	if (gptr() < egptr() || fill())
+	{
+		return traits_type::to_int_type(*gptr());
+	}
+
+	return traits_type::eof();
+}
+
+std::streamsize
+FdStreamBuf::xsgetn(char * data, std::streamsize count)
+{
+	std::streamsize done = 0;
+	while (done < count)
+	{
+		std::streamsize buffered = egptr() - gptr();
+		if (buffered > 0)
+		{
+			std::streamsize part = buffered < count - done ? buffered : count - done;
+			std::memcpy(data + done, gptr(), part);
+			gbump((int)part);
+			done += part;
+			continue;
+		}
+
+		/* pipe gives what it has, a short read is not the end */
+		ssize_t n;
+		if (count - done >= (std::streamsize)buffer.size())
+		{
+			n = readSome(data + done, count - done);
+			done += n > 0 ? n : 0;
+		}
+		else
+		{
+			n = fill() ? 1 : 0;
+		}
+
+		if (n <= 0)
+		{
+			break;
+		}
+	}
+
+	return done;
+}
+
+size_t
+FdStreamBuf::peek(void * data, size_t count)
+{
+	while ((size_t)(egptr() - gptr()) < count && fill())
+	{
+	}
+
+	size_t available = egptr() - gptr();
+	size_t part = available < count ? available : count;
+	std::memcpy(data, gptr(), part);
+	return part;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <streambuf>
+
+#include "../TarCommon.h"
+
+/* bytes asked from the descriptor at once */
+#define FD_STREAM_BUFFER_SIZE (1024 * 1024)
+
+/*
+	Input stream buffer over a descriptor which is read forward only: pipe,
+	socket, terminal or anything else that can't seek. Nothing is seeked,
+	so extraction starts on the first bytes while the writer on the other end
+	is still producing. Reads as big as the caller asks for go straight into
+	its memory, the buffer holds only what smaller reads leave over.
+	First bytes can be looked at before they are consumed, for format detection.
+*/
+class FdStreamBuf : public std::streambuf
+{
+private:
+	int fd;
+	std::vector<char> buffer;
+	bool failed = false;
+
+	/* one read, retried on signals; 0 on end, -1 on error */
+	ssize_t readSome(char * data, size_t count);
+
+	/* more bytes behind the unread ones, false on end or error */
+	bool fill();
+
+protected:
+	int_type underflow() override;
+
+	std::streamsize xsgetn(char * data, std::streamsize count) override;
+
+public:
+	/* fd is not owned */
+	FdStreamBuf(int fd, size_t bufferSize = FD_STREAM_BUFFER_SIZE);
+
+	FdStreamBuf(const FdStreamBuf &) = delete;
+	FdStreamBuf & operator=(const FdStreamBuf &) = delete;
+
+	/* up to count next bytes, they stay unread */
+	size_t peek(void * data, size_t count);
+
+	/* read error, end of input is not one */
+	bool bad() const { return failed; }
+};
@@ -5,14 +5,23 @@
 #include <vector>
 #include <memory>
 #include <iostream>
+#include <string>
+#include <string_view>
 
 #define BLOCK_SIZE 512
 
+/* default size of one read/write while copying member content, multiple of BLOCK_SIZE */
+#define COPY_CHUNK_SIZE (4 * 1024 * 1024)
+
 #define TMAGIC   "ustar "        /* ustar and a null */
 #define TMAGLEN  6
 #define TVERSION ' ' + '\0'           /* 00 and no null */
 #define TVERSLEN 2
 
+/* posix magic: gnu tar reads pax records only for members which have it */
+#define PAXMAGIC   "ustar"      /* and a null */
+#define PAXVERSION "00"
+
 /* Values used in typeflag field.  */
 #define REGTYPE  '0'            /* regular file */
 #define AREGTYPE '\0'           /* regular file */
@@ -28,6 +37,11 @@
 								   next file in the archive */
 #define XGLTYPE  'g'            /* Global extended header */
 
+/* GNU extension: directory with the names of its entries as payload,
+   each name is flag ('Y' in this archive, 'N' unchanged, 'D' directory) + name + null,
+   list ends with one more null; incremental extraction removes entries not listed */
+#define GNUTYPE_DUMPDIR 'D'
+
 /* Bits used in the mode field, values in octal.  */
 #define TSUID    04000          /* set UID on execution */
 #define TSGID    02000          /* set GID on execution */
@@ -73,31 +87,35 @@ struct ContentData
 	int8_t buffer[BLOCK_SIZE];
 };
 
+/*
+	Decoded header, lives on the stack. Text fields are views into the header
+	block or into strings of the caller, so they are valid only while those are.
+*/
 struct HeaderInfo
 {
-	std::string name;
-	uint16_t mode;
-	int16_t uid;
-	int16_t gid;
-	int32_t size;
-	time_t mtime;
-	size_t checksum;
-	int8_t typeflag;
-	std::string linkname;	/* for UNIX link and symlink */
-	std::string magic;
-	std::string version;
-	std::string uname;
-	std::string gname;
-	size_t devmajor;		/* for blk files (only for UNIX?) */
-	size_t devminor;		/* for blk files (only for UNIX?) */
-	std::string prefix;
-
-	size_t blockCount;
-	size_t reminderBytes;
-
-	HeaderInfo() {}
-	HeaderInfo(HeaderInfo &&) = delete;
-	HeaderInfo(const HeaderInfo &) = delete;
+	std::string_view name;
+	uint16_t mode = 0;
+	uint32_t uid = 0;
+	uint32_t gid = 0;
+	uint64_t size = 0;
+	time_t mtime = 0;
+	uint32_t mtimeNsec = 0;		/* sub-second part, kept only by pax records */
+	size_t checksum = 0;
+	int8_t typeflag = 0;
+	std::string_view linkname;	/* for UNIX link and symlink */
+	std::string_view magic;
+	std::string_view version;
+	std::string_view uname;
+	std::string_view gname;
+	size_t devmajor = 0;		/* for blk files (only for UNIX?) */
+	size_t devminor = 0;		/* for blk files (only for UNIX?) */
+	std::string_view prefix;
+
+	size_t blockCount = 0;
+	size_t reminderBytes = 0;
+
+	bool sparse = false;		/* payload is a sparse map and the data extents, see SparseMap */
+	uint64_t realSize = 0;		/* of a sparse file */
 };
 
 enum class Error
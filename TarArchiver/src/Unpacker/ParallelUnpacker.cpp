@@ -0,0 +1,312 @@
+#include <sys/stat.h>
+
+#include "ParallelUnpacker.h"
+
+ParallelUnpacker::ParallelUnpacker(TarUnpacker & unpacker, int archiveFd, const std::string & basePath,
+	size_t threadCount, size_t chunkSize, bool zeroCopy, bool reflink)
+	: unpacker(unpacker), basePath(basePath), archiveFd(archiveFd),
+	threadCount(threadCount ? threadCount : 1), chunkSize(chunkSize), zeroCopy(zeroCopy), reflink(reflink),
+	jobs(UNPACK_QUEUE_LIMIT)
+{
+}
+
+bool
+ParallelUnpacker::run(std::ifstream & input, std::streampos sizeOfContent)
+{
+	std::vector<std::thread> workers;
+	for (size_t i = 0; i < threadCount; ++i)
+	{
+		workers.emplace_back(&ParallelUnpacker::work, this);
+	}
+
+	bool result = true;
+	PosixHeader header;
+	while (result && input.tellg() != sizeOfContent)
+	{
+		/* get header */
+		input.read((char*)&header, BLOCK_SIZE);
+		if (!input)
+		{
+			/* a member ran past the end, the block would be the last one again */
+			result = false;
+			break;
+		}
+		if (ArchiveReader::isEmptyBlock((const int8_t*)&header))
+		{
+			/* end of archive, writers may pad it with more than 2 empty blocks */
+			break;
+		}
+		HeaderInfo headerInfo;
+		TarUnpacker::convertHeader(header, headerInfo);
+
+		if (!unpacker.checkHeader(headerInfo, header))
+		{
+			/* stop reading */
+			result = false;
+			break;
+		}
+
+		if (PaxHeader::isPaxType(headerInfo.typeflag))
+		{
+			result = unpacker.readExtended(headerInfo, input);
+			continue;
+		}
+		bool moved = unpacker.applyExtended(headerInfo);
+		if (unpacker.escapes(headerInfo))
+		{
+			result = false;
+			break;
+		}
+
+		if (!unpacker.matches(headerInfo.name))
+		{
+			/* skip content without reading it */
+			input.seekg(headerInfo.blockCount * BLOCK_SIZE, std::ios::cur);
+			continue;
+		}
+
+		if (unpacker.filtered() && !unpacker.createParentDirs(basePath, headerInfo.name))
+		{
+			result = false;
+			break;
+		}
+
+		/* member of the same path still queued: it is written first, not raced by this one */
+		size_t pathHash = std::hash<std::string_view>()(unpacker.memberPath(basePath, headerInfo.name));
+		if (queuedPaths.count(pathHash) && !drain())
+		{
+			result = false;
+			break;
+		}
+
+		switch (headerInfo.typeflag)
+		{
+		case DIRTYPE:
+		{
+			result = createDir(headerInfo);
+		}
+		break;
+
+		case REGTYPE:
+		case AREGTYPE:
+		{
+			if (headerInfo.sparse)
+			{
+				/* rare, written here from the stream */
+				result = unpacker.createFileType(headerInfo, input, basePath);
+				break;
+			}
+
+			uint64_t offset = input.tellg();
+			uint64_t size = headerInfo.size;
+			if (size > (uint64_t)sizeOfContent - offset)
+			{
+				/* truncated archive */
+				result = false;
+				break;
+			}
+
+			unpacker.supersedeLink(unpacker.memberPath(basePath, headerInfo.name));
+
+			queuedPaths.insert(pathHash);
+			result = pushJob(header, offset, size, moved ? headerInfo.name : std::string_view());
+			input.seekg(offset + CopyEngine::alignToBlock(size));
+		}
+		break;
+
+		case GNUTYPE_DUMPDIR:
+		{
+			/* listing is for incremental extraction, which is serial; gnu puts no DIRTYPE before it */
+			struct stat s;
+			const std::string path = basePath + '/' + std::string(headerInfo.name);
+			if (stat(path.c_str(), &s))
+			{
+				result = createDir(headerInfo);
+			}
+			input.seekg(headerInfo.blockCount * BLOCK_SIZE, std::ios::cur);
+		}
+		break;
+
+		case LNKTYPE:
+		{
+			/* target may still be in the queue, it has to exist first */
+			result = unpacker.createEntry(headerInfo, basePath) ||
+				(drain() && unpacker.createEntry(headerInfo, basePath));
+		}
+		break;
+
+		default:
+		{
+			/* links and special files are cheap, payload of other types is skipped */
+			result = unpacker.createEntry(headerInfo, basePath);
+			input.seekg(headerInfo.blockCount * BLOCK_SIZE, std::ios::cur);
+		}
+		break;
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		readDone = true;
+		changed.notify_all();
+	}
+
+	for (auto & worker : workers)
+	{
+		worker.join();
+	}
+
+	finishDirs();
+
+	return result && !failed;
+}
+
+bool
+ParallelUnpacker::createDir(const HeaderInfo & headerInfo)
+{
+	const std::string path = basePath + '/' + std::string(headerInfo.name);
+
+	/* real mode is set by finishDirs, workers must be able to write here */
+	struct stat s;
+	if (mkdir(path.c_str(), S_IRWXU))
+	{
+		if (errno != EEXIST || lstat(path.c_str(), &s) || !S_ISDIR(s.st_mode))
+		{
+			return false;
+		}
+
+		/* directory again, appended by -u or -r: the last header gives mode and mtime */
+		auto known = dirIndex.find(path);
+		if (known != dirIndex.end())
+		{
+			dirs[known->second] = { path, headerInfo.mode, headerInfo.mtime, headerInfo.mtimeNsec };
+			return true;
+		}
+	}
+
+	dirIndex[path] = dirs.size();
+	dirs.push_back({ path, headerInfo.mode, headerInfo.mtime, headerInfo.mtimeNsec });
+	return true;
+}
+
+bool
+ParallelUnpacker::pushJob(const PosixHeader & header, uint64_t offset, uint64_t size, std::string_view name)
+{
+	std::unique_lock<std::mutex> guard(lock);
+	changed.wait(guard, [this] { return failed || jobCount < jobs.size(); });
+	if (failed)
+	{
+		return false;
+	}
+
+	UnpackJob & job = jobs[(jobHead + jobCount) % jobs.size()];
+	job.header = header;
+	job.offset = offset;
+	job.size = size;
+	job.name.assign(name);
+	++jobCount;
+	changed.notify_all();
+	return true;
+}
+
+bool
+ParallelUnpacker::drain()
+{
+	std::unique_lock<std::mutex> guard(lock);
+	changed.wait(guard, [this] { return failed || (jobCount == 0 && busy == 0); });
+	queuedPaths.clear();
+	return !failed;
+}
+
+void
+ParallelUnpacker::work()
+{
+	CopyEngine engine(chunkSize);
+	std::string path;
+
+	std::unique_lock<std::mutex> guard(lock);
+	for (;;)
+	{
+		changed.wait(guard, [this] { return failed || readDone || jobCount; });
+		if (failed || !jobCount)
+		{
+			return;
+		}
+
+		UnpackJob job = std::move(jobs[jobHead]);
+		jobHead = (jobHead + 1) % jobs.size();
+		--jobCount;
+		++busy;
+		changed.notify_all();
+
+		guard.unlock();
+		bool extracted = extractFile(job, engine, path);
+		guard.lock();
+
+		--busy;
+		changed.notify_all();
+
+		if (!extracted)
+		{
+			failed = true;
+			changed.notify_all();
+		}
+	}
+}
+
+bool
+ParallelUnpacker::extractFile(const UnpackJob & job, CopyEngine & engine, std::string & path)
+{
+	HeaderInfo headerInfo;
+	TarUnpacker::convertHeader(job.header, headerInfo);
+
+	path.assign(basePath);
+	path += '/';
+	path.append(job.name.empty() ? headerInfo.name : job.name);
+	const uint64_t size = job.size;
+
+	int targetFd = TarUnpacker::openTarget(path.c_str(), 0666);
+	if (targetFd == -1)
+	{
+		return false;
+	}
+
+	uint64_t copied = 0;
+	if (reflink)
+	{
+		copied = engine.cloneRange(archiveFd, job.offset, targetFd, 0, size);
+	}
+
+	if (zeroCopy && copied < size)
+	{
+		copied += engine.copyKernel(archiveFd, job.offset + copied, targetFd, copied, size - copied);
+	}
+
+	if (copied < size)
+	{
+		lseek(targetFd, copied, SEEK_SET);
+		copied += engine.copyRange(archiveFd, job.offset + copied, targetFd, size - copied);
+	}
+
+	fchmod(targetFd, headerInfo.mode);
+	close(targetFd);
+
+	return copied == size;
+}
+
+void
+ParallelUnpacker::finishDirs()
+{
+	/* children first, so setting a mode can't lock us out of the rest */
+	for (auto it = dirs.rbegin(); it != dirs.rend(); ++it)
+	{
+		struct timespec times[2];
+		times[0].tv_sec = 0;
+		times[0].tv_nsec = UTIME_OMIT;
+		times[1].tv_sec = it->mtime;
+		times[1].tv_nsec = it->mtimeNsec;
+
+		utimensat(AT_FDCWD, it->path.c_str(), times, 0);
+		chmod(it->path.c_str(), it->mode);
+	}
+}
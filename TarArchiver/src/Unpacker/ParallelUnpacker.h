@@ -0,0 +1,83 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "TarUnpacker.h"
+
+/* how many files the reader may queue ahead of the workers */
+#define UNPACK_QUEUE_LIMIT 4096
+
+/* raw header block, decoded by the worker: no allocation per file */
+struct UnpackJob
+{
+	PosixHeader header;
+	uint64_t offset;		/* payload position in archive */
+	uint64_t size;			/* payload bytes, a pax header may give more than the block holds */
+	std::string name;		/* from a pax header or ustar prefix, empty when the block holds it */
+};
+
+struct DirEntry
+{
+	std::string path;
+	uint16_t mode;
+	time_t mtime;
+	uint32_t mtimeNsec;
+};
+
+/*
+	Parallel mode of TarUnpacker.
+	The calling thread reads headers, creates directories at once (owner rwx
+	only, so workers can fill them) and queues regular files as header and
+	payload offset. Workers create files and copy payloads with pread from a
+	shared archive descriptor. Directory modes and mtimes are applied in a final
+	pass, deepest first, after all files are written.
+*/
+class ParallelUnpacker
+{
+private:
+	TarUnpacker & unpacker;
+	std::string basePath;
+	int archiveFd;
+	size_t threadCount;
+	size_t chunkSize;
+	bool zeroCopy;
+	bool reflink;
+
+	std::mutex lock;
+	std::condition_variable changed;
+	std::vector<UnpackJob> jobs;		/* ring of UNPACK_QUEUE_LIMIT */
+	size_t jobHead = 0;
+	size_t jobCount = 0;
+	size_t busy = 0;		/* jobs taken by workers and not done */
+	bool readDone = false;
+	bool failed = false;
+
+	std::vector<DirEntry> dirs;
+	std::unordered_map<std::string, size_t> dirIndex;	/* position in dirs by path */
+
+	/* hashes of paths pushed since the last drain, reader only; a collision costs a drain */
+	std::unordered_set<size_t> queuedPaths;
+
+	bool createDir(const HeaderInfo & headerInfo);
+
+	/* name is copied only when it is not the one in header */
+	bool pushJob(const PosixHeader & header, uint64_t offset, uint64_t size, std::string_view name);
+
+	/* wait until every queued file is written, false if a worker failed; reader only */
+	bool drain();
+
+	void work();
+
+	/* path is a buffer of the worker */
+	bool extractFile(const UnpackJob & job, CopyEngine & engine, std::string & path);
+
+	void finishDirs();
+
+public:
+	ParallelUnpacker(TarUnpacker & unpacker, int archiveFd, const std::string & basePath,
+		size_t threadCount, size_t chunkSize, bool zeroCopy, bool reflink);
+
+	/* extract members from input up to sizeOfContent, false if extraction was stopped */
+	bool run(std::ifstream & input, std::streampos sizeOfContent);
+};
@@ -1,283 +1,1613 @@
 #include "TarUnpacker.h"
+#include "ParallelUnpacker.h"
+#include "UringUnpacker.h"
 
-void 
+#include <ftw.h>
+#include <dirent.h>
+
+bool
 TarUnpacker::unpack(const std::string & path)
+{
+	bool unpacked = unpackArchive(path);
+	return createDelayedLinks() && unpacked;
+}
+
+bool
+TarUnpacker::unpackArchive(const std::string & path)
 {
 	std::ifstream inputFile;
 	std::ofstream targetFile;
 	std::streampos sizeOfContent;
 	
-	std::string name = getDirFileName(path);
-	std::string basePath = path.substr(0, path.length() - name.length());
+	if (path == "-")
+	{
+		return unpackDescriptor(STDIN_FILENO, ".");
+	}
+
+	std::string basePath = getBasePath(path);
+
+	/* no end to seek to, nothing to map or copy from */
+	struct stat s;
+	if (stat(path.c_str(), &s) == 0 && !S_ISREG(s.st_mode))
+	{
+		int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd == -1)
+		{
+			return false;
+		}
+		bool unpacked = unpackDescriptor(fd, basePath);
+		close(fd);
+		return unpacked;
+	}
 
 	inputFile.open(path, std::ios::binary);
 	if (!inputFile.is_open())
 	{
-		return;
+		return false;
+	}
+
+	uint8_t magic[DEDUP_MAGLEN] = { 0 };
+	inputFile.read((char*)magic, sizeof(magic));
+	size_t magicLength = inputFile.gcount();
+	Compression compression = Codec::detect(magic, magicLength);
+	bool deduplicated = magicLength == DEDUP_MAGLEN && memcmp(magic, DEDUP_MAGIC, DEDUP_MAGLEN) == 0;
+	inputFile.clear();
+	inputFile.seekg(0, std::ios::beg);
+
+	if (deduplicated)
+	{
+		return unpackDeduplicated(inputFile, basePath);
+	}
+
+	if (compression != Compression::NONE)
+	{
+		return unpackCompressed(inputFile, basePath, compression);
+	}
+
+	/* cloning needs the archive descriptor */
+	if (mapped && !incremental && !reflink)
+	{
+		inputFile.close();
+		return unpackMapped(path, basePath);
 	}
 
 	/* check for correct tar eof */
 	if (!checkExpand(inputFile, sizeOfContent))
 	{
-		inputFile.close();
-		return;
+		printf("Archive has no end blocks.\n");
+		return false;
 	}
 
-	while (inputFile.tellg() != sizeOfContent)
+	if (zeroCopy || reflink || threadCount > 1)
 	{
-		/* get header */
-		inputFile.read((char*)&header, BLOCK_SIZE);
-		HeaderInfo * h = convertHeader(header);
-		std::unique_ptr<HeaderInfo> headerInfo(h);
+		archiveFd = open(path.c_str(), O_RDONLY);
+	}
 
-		if (!checkHeader(*headerInfo, header))
-		{
-			/* stop reading */
-			break;
-		}
+	bool unpacked = true;
 
-		if (!createFileType(*headerInfo, inputFile, basePath))
-		{
-			/* can't create file */
-			/* stop */
-			break;
-		}
+	if (threadCount > 1 && archiveFd != -1 && !incremental)
+	{
+		ParallelUnpacker parallel(*this, archiveFd, basePath, threadCount,
+			copyEngine.getChunkSize(), zeroCopy, reflink);
+		unpacked = parallel.run(inputFile, sizeOfContent);
+	}
+	else if (uring && !incremental)
+	{
+		/* batches end at the empty blocks, not at sizeOfContent */
+		unpacked = unpackStream(inputFile, basePath);
 	}
+	else
+	{
+		while (unpacked && inputFile.tellg() != sizeOfContent)
+		{
+			/* get header */
+			inputFile.read((char*)&header, BLOCK_SIZE);
+			if (std::memcmp(&header, &emptyBuffer, BLOCK_SIZE) == 0)
+			{
+				/* end of archive, writers may pad it with more than 2 empty blocks */
+				break;
+			}
+			HeaderInfo headerInfo;
+			convertHeader(header, headerInfo);
 
-	std::cout << inputFile.tellg() << std::endl;
+			if (!checkHeader(headerInfo, header))
+			{
+				/* stop reading */
+				unpacked = false;
+				break;
+			}
 
+			if (PaxHeader::isPaxType(headerInfo.typeflag))
+			{
+				unpacked = readExtended(headerInfo, inputFile);
+				continue;
+			}
+			applyExtended(headerInfo);
+			if (escapes(headerInfo))
+			{
+				unpacked = false;
+				break;
+			}
 
-	inputFile.close();
-}
+			if (!matches(headerInfo.name))
+			{
+				/* skip content without reading it */
+				inputFile.seekg(headerInfo.blockCount * BLOCK_SIZE, std::ios::cur);
+				continue;
+			}
 
-std::string
-TarUnpacker::extractName(const std::string & path)
-{
-	std::string name = std::string(path);
-	const size_t last_slash_idx = name.find_last_of("\\/");
-	if (std::string::npos != last_slash_idx)
-	{
-		name.erase(0, last_slash_idx + 1);
+			if (filtered() && !createParentDirs(basePath, headerInfo.name))
+			{
+				unpacked = false;
+				break;
+			}
+
+			/* can't create file: stop */
+			unpacked = createFileType(headerInfo, inputFile, basePath);
+		}
 	}
 
-	/* remove extension */
-	const size_t period_idx = name.rfind('.');
-	if (std::string::npos != period_idx)
+	inputFile.close();
+
+	if (archiveFd != -1)
 	{
-		name.erase(period_idx);
+		close(archiveFd);
+		archiveFd = -1;
 	}
 
-	return name;
+	return unpacked;
 }
 
-std::string
-TarUnpacker::getDirFileName(const std::string & path)
+bool
+TarUnpacker::unpackDescriptor(int fd, const std::string & basePath)
 {
-	std::string name = std::string(path);
-	const size_t last_slash_idx = name.find_last_of("\\/");
-	if (std::string::npos != last_slash_idx)
+	FdStreamBuf streamBuf(fd, copyEngine.getChunkSize());
+	std::istream input(&streamBuf);
+
+	uint8_t magic[DEDUP_MAGLEN] = { 0 };
+	size_t magicLength = streamBuf.peek(magic, sizeof(magic));
+	Compression compression = Codec::detect(magic, magicLength);
+
+	bool unpacked;
+	if (magicLength == DEDUP_MAGLEN && memcmp(magic, DEDUP_MAGIC, DEDUP_MAGLEN) == 0)
 	{
-		name.erase(0, last_slash_idx + 1);
+		unpacked = unpackDeduplicated(input, basePath);
+	}
+	else if (compression != Compression::NONE)
+	{
+		unpacked = unpackCompressed(input, basePath, compression);
+	}
+	else
+	{
+		unpacked = unpackStream(input, basePath);
 	}
 
-	return name;
+	if (streamBuf.bad())
+	{
+		printf("Read error in the middle of the archive.\n");
+		return false;
+	}
+	if (!unpacked)
+	{
+		printf("Archive ended or broke before its end blocks.\n");
+	}
+	return unpacked;
 }
 
 bool
-TarUnpacker::checkExpand(std::ifstream & finput, std::streampos & sizeOfContent)
+TarUnpacker::unpackDeduplicated(std::istream & input, const std::string & basePath)
 {
-	finput.seekg(-2 * BLOCK_SIZE, std::ios::end);
-	sizeOfContent = finput.tellg();
-
-	finput.read((char*)&workBuffer, BLOCK_SIZE);
-	finput.read((char*)&additionalBuffer, BLOCK_SIZE);
-
-	finput.seekg(0, std::ios::beg);
+	if (dedupStorePath.empty())
+	{
+		printf("Archive is a dedup manifest, its chunk store is needed: --dedup <store>.\n");
+		return false;
+	}
 
-	if (std::memcmp(&workBuffer, &emptyBuffer, BLOCK_SIZE) == 0 &&
-		std::memcmp(&additionalBuffer, &emptyBuffer, BLOCK_SIZE) == 0)
+	ChunkStore store;
+	if (!store.open(dedupStorePath, false))
 	{
-		return true;
+		printf("Can't open chunk store %s.\n", dedupStorePath.c_str());
+		return false;
 	}
 
-	return false;
+	RehydrateStreamBuf rehydrated(input, store);
+	std::istream tar(&rehydrated);
+	bool unpacked = unpackStream(tar, basePath);
+	if (rehydrated.bad())
+	{
+		printf("Manifest or chunk store is damaged.\n");
+		return false;
+	}
+	return unpacked;
 }
 
-HeaderInfo *
-TarUnpacker::convertHeader(const PosixHeader & header)
+bool
+TarUnpacker::rehydrate(const std::string & path)
 {
-	HeaderInfo * headerInfo = new HeaderInfo();
+	std::string targetPath = path;
+	size_t suffixLength = strlen(DEDUP_SUFFIX);
+	if (targetPath.size() > suffixLength &&
+		targetPath.compare(targetPath.size() - suffixLength, suffixLength, DEDUP_SUFFIX) == 0)
+	{
+		targetPath.resize(targetPath.size() - suffixLength);
+	}
+	else
+	{
+		targetPath += ".tar";
+	}
+
+	ChunkStore store;
+	if (!store.open(dedupStorePath, false))
+	{
+		printf("Can't open chunk store %s.\n", dedupStorePath.c_str());
+		return false;
+	}
 
-	headerInfo->name = (char*)header.name;
-	headerInfo->mode = strtol((char*)header.mode, nullptr, 8);
-	headerInfo->uid = strtol((char*)header.uid, nullptr, 8);
-	headerInfo->gid = strtol((char*)header.gid, nullptr, 8);
-	headerInfo->size = strtol((char*)header.size, nullptr, 8);
-	headerInfo->mtime = strtoll((char*)header.mtime, nullptr, 8);
-	headerInfo->checksum = strtoll((char*)header.chksum, nullptr, 8);
-	headerInfo->typeflag = header.typeflag;
-	headerInfo->linkname = (char*)header.linkname;
-	headerInfo->magic = (char*)header.magic;
-	headerInfo->version = (char*)header.version;
-	headerInfo->uname = (char*)header.uname;
-	headerInfo->gname = (char*)header.gname;
-	headerInfo->devmajor = strtol((char*)header.devmajor, nullptr, 8);
-	headerInfo->devminor = strtol((char*)header.devminor, nullptr, 8);
-	headerInfo->prefix = (char*)header.prefix;
+	std::ifstream input(path, std::ios::binary);
+	std::ofstream output(targetPath, std::ios::binary | std::ios::trunc);
+	if (!input.is_open() || !output.is_open())
+	{
+		printf("Can't rehydrate %s into %s.\n", path.c_str(), targetPath.c_str());
+		return false;
+	}
 
-	headerInfo->blockCount = headerInfo->size / BLOCK_SIZE;
-	headerInfo->reminderBytes = headerInfo->size % BLOCK_SIZE;
-	if (headerInfo->reminderBytes)
+	RehydrateStreamBuf rehydrated(input, store);
+	std::istream tar(&rehydrated);
+	std::vector<char> buffer(copyEngine.getChunkSize());
+	while (tar.read(buffer.data(), buffer.size()) || tar.gcount() > 0)
 	{
-		headerInfo->blockCount++;
+		output.write(buffer.data(), tar.gcount());
 	}
+	output.close();
 
-	return headerInfo;
+	if (!rehydrated.complete() || !output)
+	{
+		printf("Manifest or chunk store is damaged, %s is incomplete.\n", targetPath.c_str());
+		return false;
+	}
+	return true;
 }
 
-int64_t
-TarUnpacker::calculateUnsignedCheckSum(PosixHeader & header) const
+void
+TarUnpacker::setDedup(const std::string & storePath)
 {
-	std::memset(header.chksum, 32, 7);
-	int64_t checksum = 0;
-	const uint8_t * bytes = reinterpret_cast<const uint8_t *>(&header);
-	for (size_t i = 0; i < BLOCK_SIZE; ++i) {
-		checksum += bytes[i];
-	}
-	return checksum;
+	dedupStorePath = storePath;
 }
 
 bool
-TarUnpacker::checkHeader(const HeaderInfo & headerInfo, PosixHeader & header)
+TarUnpacker::unpackCompressed(std::istream & input, const std::string & basePath, Compression type)
 {
-	if (headerInfo.magic != TMAGIC &&
-		headerInfo.checksum != calculateUnsignedCheckSum(header))
+	if (!Codec::available(type))
 	{
+		printf("Archive is compressed by codec which is not built in.\n");
 		return false;
 	}
-	return true;
+
+	DecompressStreamBuf decompressBuf(input, type);
+	std::istream decompressed(&decompressBuf);
+
+	return unpackStream(decompressed, basePath) && !decompressBuf.bad();
 }
 
 bool
-TarUnpacker::createFileType(const HeaderInfo & header, std::ifstream & finput, const std::string & basePath)
+TarUnpacker::unpackStream(std::istream & input, const std::string & basePath)
 {
-	/* in windows label () is regular file which contains all info from base file */
-	switch (header.typeflag)
-	{
-	case DIRTYPE:	/* directory */
+	bool unpacked = unpackMembers(input, basePath);
+	return createDelayedLinks() && unpacked;
+}
+
+bool
+TarUnpacker::unpackMembers(std::istream & input, const std::string & basePath)
+{
+	if (uring && !incremental && !listing)
 	{
-		/* create dir */
-		Error errorType;
-		const int32_t dir_err = mkdir((basePath + '/' + header.name).c_str(), 0);
-		if (dir_err)
+		UringQueue ring;
+		if (ring.open())
 		{
-			/* error creating file */
-			switch (errno)
-			{
-			case EACCES:
-				errorType = Error::NO_ACCESS;
-				break;
-			case ENOENT:
-				errorType = Error::BAD_PATH;
-				break;
-			default:
-				errorType = Error::UNKNOWN_ERROR;
-			}
+			UringUnpacker batched(*this, basePath, ring);
+			return batched.run(input);
+		}
+
+		printf("io_uring is not available, using synchronous I/O.\n");
+	}
 
+	for (;;)
+	{
+		input.read((char*)&header, BLOCK_SIZE);
+		if (input.gcount() != BLOCK_SIZE)
+		{
+			/* truncated */
 			return false;
 		}
 
-		chmod((basePath + '/' + header.name).c_str(), header.mode);
-		errorType = Error::SUCCESS;
+		if (std::memcmp(&header, &emptyBuffer, BLOCK_SIZE) == 0)
+		{
+			/* end of archive */
+			return true;
+		}
 
-		if (errorType != Error::SUCCESS)
+		HeaderInfo headerInfo;
+		convertHeader(header, headerInfo);
+
+		if (!checkHeader(headerInfo, header))
 		{
 			return false;
 		}
-	}
-	break;
-	case REGTYPE:	/* regular file */
-	case AREGTYPE:	/* regular file */
-	{
-		std::ofstream targetFile(header.name, std::ios::binary);
-		if (!targetFile.is_open())
+
+		if (PaxHeader::isPaxType(headerInfo.typeflag))
+		{
+			if (!readExtended(headerInfo, input))
+			{
+				return false;
+			}
+			continue;
+		}
+		applyExtended(headerInfo);
+		if (listing)
+		{
+			if (matches(headerInfo.name))
+			{
+				listMember(headerInfo, *listing);
+			}
+			input.ignore(headerInfo.blockCount * BLOCK_SIZE);
+			continue;
+		}
+		if (escapes(headerInfo))
 		{
 			return false;
 		}
 
-		writeContentToTargetFile(header, finput, targetFile);
+		if (!matches(headerInfo.name))
+		{
+			/* no seeking here, content is read through */
+			input.ignore(headerInfo.blockCount * BLOCK_SIZE);
+			continue;
+		}
 
-		targetFile.flush();
-		targetFile.close();
+		if (filtered() && !createParentDirs(basePath, headerInfo.name))
+		{
+			return false;
+		}
 
-		chmod((basePath + '/' + header.name).c_str(), header.mode);
-	}
-	break;
-	case LNKTYPE:	/* link */
-	{
-		/* i don't find file with type '1' */
-	}
-	break;
-	case SYMTYPE:	/* reserved */
-	{
-		if (symlink((basePath + '/' + header.linkname).c_str(), 
-			(basePath + '/' + header.name).c_str()))
+		if (!createFileType(headerInfo, input, basePath))
 		{
 			return false;
 		}
 	}
-	break;
-	case CHRTYPE:	/* character special */
-	{
+}
 
-	}
-	break;
-	case BLKTYPE:	/* block special */
+bool
+TarUnpacker::list(const std::string & path, std::ostream & output)
+{
+	int fd = path == "-" ? STDIN_FILENO : open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
 	{
+		return false;
+	}
 
+	/* plain archive in a file is listed by offsets, everything else is read through */
+	struct stat s;
+	uint8_t magic[DEDUP_MAGLEN] = { 0 };
+	ssize_t magicLength = 0;
+	bool seekable = fd != STDIN_FILENO && fstat(fd, &s) == 0 && S_ISREG(s.st_mode);
+	if (seekable)
+	{
+		magicLength = pread(fd, magic, sizeof(magic), 0);
 	}
-	break;
-	case FIFOTYPE:	/* FIFO special */
+	bool plain = seekable && magicLength >= 0 && Codec::detect(magic, magicLength) == Compression::NONE &&
+		!(magicLength == DEDUP_MAGLEN && memcmp(magic, DEDUP_MAGIC, DEDUP_MAGLEN) == 0);
+
+	bool listed;
+	if (plain)
 	{
-		if (mkfifo((basePath + '/' + header.name).c_str(), header.mode))
-		{
-			return false;
-		}
+		listed = listPlain(fd, output);
 	}
-	break;
-	case CONTTYPE:	/* reserved */
+	else
 	{
-
+		listing = &output;
+		listed = unpackDescriptor(fd, ".");
+		listing = nullptr;
 	}
-	break;
-	default:
+
+	if (fd != STDIN_FILENO)
 	{
-		/* something wrong */
+		close(fd);
 	}
-	break;
+	return listed;
+}
+
+bool
+TarUnpacker::listPlain(int fd, std::ostream & output)
+{
+	bool result = false;
+	uint64_t offset = 0;
+	while (pread(fd, &header, BLOCK_SIZE, offset) == BLOCK_SIZE)
+	{
+		if (std::memcmp(&header, &emptyBuffer, BLOCK_SIZE) == 0)
+		{
+			/* end of archive */
+			result = true;
+			break;
+		}
+
+		HeaderInfo headerInfo;
+		convertHeader(header, headerInfo);
+		if (!checkHeader(headerInfo, header))
+		{
+			break;
+		}
+
+		if (PaxHeader::isPaxType(headerInfo.typeflag))
+		{
+			if (!readExtended(headerInfo, fd, offset + BLOCK_SIZE))
+			{
+				break;
+			}
+		}
+		else
+		{
+			applyExtended(headerInfo);
+			if (matches(headerInfo.name))
+			{
+				listMember(headerInfo, output);
+			}
+		}
+
+		/* content is never read */
+		offset += BLOCK_SIZE + headerInfo.blockCount * BLOCK_SIZE;
 	}
 
-	return true;
+	return result;
 }
 
-void 
-TarUnpacker::writeContentToTargetFile(const HeaderInfo & header, std::ifstream & input, std::ofstream & target)
+bool
+TarUnpacker::extractMember(const std::string & path, const std::string & member)
 {
-	/* read/write content */
-	for (size_t i = 0; i < header.blockCount - 1; ++i)
+	std::string basePath = getBasePath(path);
+
+	ArchiveIndex index;
+	if (!index.open(path))
 	{
-		input.read((char*)&workBuffer, BLOCK_SIZE);
-		target.write((char*)&workBuffer, BLOCK_SIZE);
+		return false;
 	}
 
-	/* last block */
-	input.read((char*)&workBuffer, BLOCK_SIZE);
-	if (header.reminderBytes)
+	const IndexEntry * entry = index.find(member);
+	if (!entry)
 	{
-		target.write((char*)&workBuffer, header.reminderBytes);
+		return false;
 	}
-	else
+
+	std::ifstream inputFile(path, std::ios::binary);
+	if (!inputFile.is_open())
 	{
-		target.write((char*)&workBuffer, BLOCK_SIZE);
+		return false;
+	}
+
+	uint8_t magic[4] = { 0 };
+	inputFile.read((char*)magic, sizeof(magic));
+	Compression compression = Codec::detect(magic, inputFile.gcount());
+	inputFile.clear();
+
+	if (compression != Compression::NONE)
+	{
+		return extractCompressedMember(inputFile, index, *entry, member, basePath, compression);
+	}
+
+	inputFile.seekg(entry->offset);
+
+	HeaderInfo headerInfo;
+	if (!readMemberHeader(inputFile, headerInfo) || !indexedMember(headerInfo, member) ||
+		!createParentDirs(basePath, headerInfo.name))
+	{
+		return false;
+	}
+
+	bool created = createFileType(headerInfo, inputFile, basePath);
+	return createDelayedLinks() && created;
+}
+
+bool
+TarUnpacker::extractCompressedMember(std::istream & input, const ArchiveIndex & index,
+	const IndexEntry & entry, const std::string & member, const std::string & basePath, Compression type)
+{
+	const FrameEntry * frame = index.frameAt(entry.offset);
+	if (!frame)
+	{
+		printf("Archive is not seekable, pack it with --seekable.\n");
+		return false;
+	}
+
+	if (!Codec::available(type))
+	{
+		printf("Archive is compressed by codec which is not built in.\n");
+		return false;
+	}
+
+	/* decode from the piece holding the header, stop after the member */
+	input.seekg(frame->compressedOffset);
+	DecompressStreamBuf decompressBuf(input, type);
+	std::istream decompressed(&decompressBuf);
+
+	decompressed.ignore(entry.offset - frame->uncompressedOffset);
+
+	HeaderInfo headerInfo;
+	if (!readMemberHeader(decompressed, headerInfo) || !indexedMember(headerInfo, member) ||
+		!createParentDirs(basePath, headerInfo.name))
+	{
+		return false;
+	}
+
+	bool created = createFileType(headerInfo, decompressed, basePath) && !decompressBuf.bad();
+	return createDelayedLinks() && created;
+}
+
+bool
+TarUnpacker::indexedMember(const HeaderInfo & headerInfo, std::string_view member)
+{
+	/* directories are indexed with their trailing slash, found without it */
+	std::string_view name = headerInfo.name;
+	if (name == member || (name.length() == member.length() + 1 && name.back() == '/' &&
+		name.compare(0, member.length(), member) == 0))
+	{
+		return true;
+	}
+
+	printf("Index points to %.*s, not to %.*s: it belongs to another archive.\n",
+		(int)name.length(), name.data(), (int)member.length(), member.data());
+	return false;
+}
+
+bool
+TarUnpacker::verify(const std::string & path)
+{
+	ArchiveReader reader;
+	if (!reader.open(path))
+	{
+		return false;
+	}
+
+	return reader.hasExpand() && reader.complete();
+}
+
+bool
+TarUnpacker::unpackMapped(const std::string & path, const std::string & basePath)
+{
+	ArchiveReader reader;
+	if (!reader.open(path) || !reader.hasExpand())
+	{
+		return false;
+	}
+
+	uint64_t next = 0;
+	for (const ArchiveEntry & entry : reader)
+	{
+		next = entry.next;
+		HeaderInfo headerInfo;
+		convertHeader(*entry.header, headerInfo);
+
+		if (PaxHeader::isPaxType(headerInfo.typeflag))
+		{
+			if (!readExtended(entry))
+			{
+				return false;
+			}
+			continue;
+		}
+		applyExtended(headerInfo);
+		if (escapes(headerInfo))
+		{
+			return false;
+		}
+
+		if (!matches(headerInfo.name))
+		{
+			continue;
+		}
+
+		if (filtered() && !createParentDirs(basePath, headerInfo.name))
+		{
+			return false;
+		}
+
+		if (!createFileType(headerInfo, entry, basePath))
+		{
+			/* can't create file */
+			/* stop */
+			return false;
+		}
+	}
+
+	/* iteration also stops on a damaged header or a truncated member */
+	return next + BLOCK_SIZE <= reader.size() && ArchiveReader::isEmptyBlock(reader.data() + next);
+}
+
+void
+TarUnpacker::setChunkSize(size_t size)
+{
+	copyEngine.setChunkSize(size);
+}
+
+void
+TarUnpacker::setZeroCopy(bool enable)
+{
+	zeroCopy = enable;
+}
+
+void
+TarUnpacker::setReflink(bool enable)
+{
+	reflink = enable;
+}
+
+void
+TarUnpacker::setThreadCount(size_t count)
+{
+	threadCount = count ? count : 1;
+}
+
+void
+TarUnpacker::setUring(bool enable)
+{
+	uring = enable;
+}
+
+void
+TarUnpacker::setIncremental(bool enable)
+{
+	incremental = enable;
+}
+
+void
+TarUnpacker::setMapped(bool enable)
+{
+	mapped = enable;
+}
+
+void
+TarUnpacker::addInclude(const std::string & pattern)
+{
+	includes.push_back(pattern);
+}
+
+void
+TarUnpacker::addExclude(const std::string & pattern)
+{
+	excludes.push_back(pattern);
+}
+
+bool
+TarUnpacker::matches(std::string_view name) const
+{
+	if (!filtered())
+	{
+		return true;
+	}
+
+	if (!name.empty() && name.back() == '/')
+	{
+		name.remove_suffix(1);
+	}
+
+	/* fnmatch wants C string, names longer than a path can't be created anyway */
+	char member[PATH_MAX];
+	if (name.length() >= sizeof(member))
+	{
+		return false;
+	}
+	std::memcpy(member, name.data(), name.length());
+	member[name.length()] = '\0';
+
+	/* FNM_LEADING_DIR: pattern of a directory matches everything under it */
+	for (auto it = excludes.begin(); it != excludes.end(); ++it)
+	{
+		if (fnmatch(it->c_str(), member, FNM_LEADING_DIR) == 0)
+		{
+			return false;
+		}
+	}
+
+	if (includes.empty())
+	{
+		return true;
+	}
+
+	for (auto it = includes.begin(); it != includes.end(); ++it)
+	{
+		if (fnmatch(it->c_str(), member, FNM_LEADING_DIR) == 0)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+const std::string &
+TarUnpacker::memberPath(const std::string & basePath, std::string_view name)
+{
+	/* capacity stays, so no allocation once the longest path was seen */
+	pathBuffer.assign(basePath);
+	pathBuffer += '/';
+	pathBuffer.append(name);
+	return pathBuffer;
+}
+
+bool
+TarUnpacker::createParentDirs(const std::string & basePath, std::string_view name)
+{
+	size_t slash = name.find('/');
+	while (slash != std::string_view::npos && slash + 1 < name.length())
+	{
+		const std::string & dir = memberPath(basePath, name.substr(0, slash));
+		if (mkdir(dir.c_str(), RWX) && errno != EEXIST)
+		{
+			return false;
+		}
+
+		slash = name.find('/', slash + 1);
+	}
+
+	return true;
+}
+
+void
+TarUnpacker::listMember(const HeaderInfo & headerInfo, std::ostream & output)
+{
+	char type;
+	switch (headerInfo.typeflag)
+	{
+	case DIRTYPE:
+	case GNUTYPE_DUMPDIR:	type = 'd'; break;
+	case SYMTYPE:	type = 'l'; break;
+	case LNKTYPE:	type = 'h'; break;
+	case CHRTYPE:	type = 'c'; break;
+	case BLKTYPE:	type = 'b'; break;
+	case FIFOTYPE:	type = 'p'; break;
+	default:		type = '-'; break;
+	}
+
+	const char * letters = "rwxrwxrwx";
+	char mode[11];
+	mode[0] = type;
+	for (int i = 0; i < 9; ++i)
+	{
+		mode[i + 1] = headerInfo.mode & (0400 >> i) ? letters[i] : '-';
+	}
+	mode[10] = '\0';
+
+	char date[32];
+	struct tm tm;
+	time_t mtime = headerInfo.mtime;
+	localtime_r(&mtime, &tm);
+	strftime(date, sizeof(date), "%Y-%m-%d %H:%M", &tm);
+
+	char line[128];
+	snprintf(line, sizeof(line), "%s %.*s/%.*s %12lld %s ", mode,
+		(int)headerInfo.uname.length(), headerInfo.uname.data(),
+		(int)headerInfo.gname.length(), headerInfo.gname.data(),
+		(long long)(headerInfo.sparse ? headerInfo.realSize : (uint64_t)headerInfo.size), date);
+
+	output << line << headerInfo.name;
+	if (headerInfo.typeflag == SYMTYPE)
+	{
+		output << " -> " << headerInfo.linkname;
+	}
+	else if (headerInfo.typeflag == LNKTYPE)
+	{
+		output << " link to " << headerInfo.linkname;
+	}
+	output << '\n';
+}
+
+std::string
+TarUnpacker::extractName(const std::string & path)
+{
+	std::string name = std::string(path);
+	const size_t last_slash_idx = name.find_last_of("\\/");
+	if (std::string::npos != last_slash_idx)
+	{
+		name.erase(0, last_slash_idx + 1);
+	}
+
+	/* remove extension */
+	const size_t period_idx = name.rfind('.');
+	if (std::string::npos != period_idx)
+	{
+		name.erase(period_idx);
+	}
+
+	return name;
+}
+
+std::string
+TarUnpacker::getDirFileName(const std::string & path)
+{
+	std::string name = std::string(path);
+	const size_t last_slash_idx = name.find_last_of("\\/");
+	if (std::string::npos != last_slash_idx)
+	{
+		name.erase(0, last_slash_idx + 1);
+	}
+
+	return name;
+}
+
+std::string
+TarUnpacker::getBasePath(const std::string & path)
+{
+	/* members are joined to it with '/', an empty one would make them absolute */
+	std::string basePath = path.substr(0, path.length() - getDirFileName(path).length());
+	return basePath.empty() ? "." : basePath;
+}
+
+bool
+TarUnpacker::checkExpand(std::ifstream & finput, std::streampos & sizeOfContent)
+{
+	finput.seekg(-2 * BLOCK_SIZE, std::ios::end);
+	sizeOfContent = finput.tellg();
+
+	finput.read((char*)&workBuffer, BLOCK_SIZE);
+	finput.read((char*)&additionalBuffer, BLOCK_SIZE);
+
+	finput.seekg(0, std::ios::beg);
+
+	if (std::memcmp(&workBuffer, &emptyBuffer, BLOCK_SIZE) == 0 &&
+		std::memcmp(&additionalBuffer, &emptyBuffer, BLOCK_SIZE) == 0)
+	{
+		return true;
+	}
+
+	return false;
+}
+
+void
+TarUnpacker::convertHeader(const PosixHeader & header, HeaderInfo & headerInfo)
+{
+	HeaderCodec::decode(header, headerInfo);
+}
+
+bool
+TarUnpacker::readExtended(const HeaderInfo & headerInfo, std::istream & input)
+{
+	PaxHeader & records = headerInfo.typeflag == XGLTYPE ? globalExtended : extended;
+	std::string & data = records.data();
+	data.resize(headerInfo.size);
+	input.read(&data[0], data.size());
+	if ((size_t)input.gcount() != data.size())
+	{
+		return false;
+	}
+	input.ignore(CopyEngine::alignToBlock(headerInfo.size) - headerInfo.size);
+
+	return records.parse(headerInfo.typeflag == XGLTYPE);
+}
+
+bool
+TarUnpacker::readExtended(const ArchiveEntry & entry)
+{
+	PaxHeader & records = entry.header->typeflag == XGLTYPE ? globalExtended : extended;
+	records.data().assign((const char*)entry.data, entry.size);
+	return records.parse(entry.header->typeflag == XGLTYPE);
+}
+
+bool
+TarUnpacker::readExtended(const HeaderInfo & headerInfo, int fd, uint64_t offset)
+{
+	PaxHeader & records = headerInfo.typeflag == XGLTYPE ? globalExtended : extended;
+	std::string & data = records.data();
+	data.resize(headerInfo.size);
+	return pread(fd, &data[0], data.size(), offset) == (ssize_t)data.size() &&
+		records.parse(headerInfo.typeflag == XGLTYPE);
+}
+
+bool
+TarUnpacker::applyExtended(HeaderInfo & headerInfo)
+{
+	bool moved = HeaderCodec::joinPrefix(headerInfo, prefixedName);
+
+	globalExtended.apply(headerInfo);
+	moved = extended.apply(headerInfo) || moved;
+
+	/* absolute names go under the target directory, as with gnu tar */
+	moved = HeaderCodec::dropRoot(headerInfo.name) || moved;
+	if (headerInfo.typeflag == LNKTYPE)
+	{
+		HeaderCodec::dropRoot(headerInfo.linkname);
+	}
+	return moved;
+}
+
+/* ".." as a whole component of name */
+static bool
+hasParentStep(std::string_view name)
+{
+	size_t start = 0;
+	while (start <= name.length())
+	{
+		size_t end = name.find('/', start);
+		if (end == std::string_view::npos)
+		{
+			end = name.length();
+		}
+		if (name.substr(start, end - start) == "..")
+		{
+			return true;
+		}
+		start = end + 1;
+	}
+	return false;
+}
+
+bool
+TarUnpacker::escapes(const HeaderInfo & headerInfo) const
+{
+	if (!hasParentStep(headerInfo.name) && !(headerInfo.typeflag == LNKTYPE && hasParentStep(headerInfo.linkname)))
+	{
+		return false;
+	}
+
+	printf("Member %.*s leads out of the target directory.\n", (int)headerInfo.name.length(), headerInfo.name.data());
+	return true;
+}
+
+bool
+TarUnpacker::readMemberHeader(std::istream & input, HeaderInfo & headerInfo)
+{
+	input.read((char*)&header, BLOCK_SIZE);
+	convertHeader(header, headerInfo);
+	if (!input || !checkHeader(headerInfo, header))
+	{
+		return false;
+	}
+
+	while (PaxHeader::isPaxType(headerInfo.typeflag))
+	{
+		if (!readExtended(headerInfo, input))
+		{
+			return false;
+		}
+
+		input.read((char*)&header, BLOCK_SIZE);
+		headerInfo = HeaderInfo();
+		convertHeader(header, headerInfo);
+		if (!input || !checkHeader(headerInfo, header))
+		{
+			return false;
+		}
+	}
+
+	applyExtended(headerInfo);
+	return !escapes(headerInfo);
+}
+
+bool
+TarUnpacker::checkHeader(const HeaderInfo & headerInfo, const PosixHeader & header)
+{
+	/* magic alone says nothing, old and gnu archives differ there */
+	return headerInfo.checksum == HeaderCodec::checksum(header) && headerInfo.size != HEADER_NUMBER_BAD;
+}
+
+bool
+TarUnpacker::createFileType(const HeaderInfo & header, std::istream & finput, const std::string & basePath)
+{
+	switch (header.typeflag)
+	{
+	case REGTYPE:	/* regular file */
+	case AREGTYPE:	/* regular file */
+	{
+		const std::string & targetPath = memberPath(basePath, header.name);
+		if (incremental)
+		{
+			removeMember(basePath, header.name);
+		}
+		supersedeLink(targetPath);
+
+		int targetFd = openTarget(targetPath.c_str(), 0666);
+		if (targetFd == -1)
+		{
+			return false;
+		}
+
+		bool written = header.sparse ? writeSparse(header, finput, targetFd) :
+			archiveFd != -1 ? writeContentInKernel(header, finput, targetFd) :
+			writeContentToTargetFile(header, finput, targetFd);
+
+		fchmod(targetFd, header.mode);
+		close(targetFd);
+
+		if (!written)
+		{
+			return false;
+		}
+	}
+	break;
+	case GNUTYPE_DUMPDIR:
+	{
+		dumpBuffer.resize(header.size);
+		finput.read(&dumpBuffer[0], dumpBuffer.size());
+		if ((size_t)finput.gcount() != dumpBuffer.size())
+		{
+			return false;
+		}
+		finput.ignore(CopyEngine::alignToBlock(header.size) - header.size);
+
+		return createDumpDir(header, dumpBuffer, basePath);
+	}
+	default:
+	{
+		if (!createEntry(header, basePath))
+		{
+			return false;
+		}
+
+		/* payload of a type which is not created */
+		finput.ignore(header.blockCount * BLOCK_SIZE);
+	}
+	break;
+	}
+
+	return true;
+}
+
+bool
+TarUnpacker::createFileType(const HeaderInfo & header, const ArchiveEntry & entry, const std::string & basePath)
+{
+	switch (header.typeflag)
+	{
+	case REGTYPE:	/* regular file */
+	case AREGTYPE:	/* regular file */
+	{
+		const std::string & targetPath = memberPath(basePath, header.name);
+		supersedeLink(targetPath);
+		bool written = header.sparse ? writeSparseFromMapping(header, entry, targetPath) :
+			writeContentFromMapping(entry, targetPath);
+		if (!written)
+		{
+			return false;
+		}
+
+		chmod(targetPath.c_str(), header.mode);
+	}
+	break;
+	case GNUTYPE_DUMPDIR:
+		return createDumpDir(header, std::string_view((const char*)entry.data, entry.size), basePath);
+	default:
+		return createEntry(header, basePath);
+	}
+
+	return true;
+}
+
+bool
+TarUnpacker::createEntry(const HeaderInfo & header, const std::string & basePath)
+{
+	const std::string & path = memberPath(basePath, header.name);
+
+	struct stat existing;
+	if (incremental && !lstat(path.c_str(), &existing))
+	{
+		if (header.typeflag == DIRTYPE && S_ISDIR(existing.st_mode))
+		{
+			/* kept with its content, a dumpdir tells what goes away */
+			chmod(path.c_str(), header.mode);
+			return true;
+		}
+
+		removeMember(basePath, header.name);
+	}
+
+	/* in windows label () is regular file which contains all info from base file */
+	switch (header.typeflag)
+	{
+	case DIRTYPE:	/* directory */
+	{
+		/* create dir */
+		Error errorType;
+		const int32_t dir_err = mkdir(path.c_str(), 0);
+		struct stat s;
+		if (dir_err && errno == EEXIST && !lstat(path.c_str(), &s) && S_ISDIR(s.st_mode))
+		{
+			/* directory again, appended by -u or -r: only its mode is applied */
+		}
+		else if (dir_err)
+		{
+			/* error creating file */
+			switch (errno)
+			{
+			case EACCES:
+				errorType = Error::NO_ACCESS;
+				break;
+			case ENOENT:
+				errorType = Error::BAD_PATH;
+				break;
+			default:
+				errorType = Error::UNKNOWN_ERROR;
+			}
+
+			return false;
+		}
+
+		chmod(path.c_str(), header.mode);
+		errorType = Error::SUCCESS;
+
+		if (errorType != Error::SUCCESS)
+		{
+			return false;
+		}
+	}
+	break;
+	case LNKTYPE:	/* link */
+	{
+		/* target is a member extracted before, named from the same base */
+		const std::string target = basePath + '/' + std::string(header.linkname);
+
+		/* link to a symlink which isn't there yet: the same symlink, made with it */
+		auto delayed = delayedLinks.find(target);
+		if (delayed != delayedLinks.end())
+		{
+			const std::string linkTarget = delayed->second.target;
+			return delayLink(path, linkTarget);
+		}
+
+		if (link(target.c_str(), path.c_str()))
+		{
+			/* a name which is there already is replaced, as a regular file would be */
+			if (errno != EEXIST || unlink(path.c_str()) || link(target.c_str(), path.c_str()))
+			{
+				return false;
+			}
+		}
+	}
+	break;
+	case SYMTYPE:	/* reserved */
+	{
+		/* target is kept as it was read, relative to the link; it is made after */
+		/* every other member, so none of them can be written through it */
+		if (!delayLink(path, header.linkname))
+		{
+			return false;
+		}
+	}
+	break;
+	case CHRTYPE:	/* character special */
+	{
+
+	}
+	break;
+	case BLKTYPE:	/* block special */
+	{
+
+	}
+	break;
+	case FIFOTYPE:	/* FIFO special */
+	{
+		if (mkfifo(path.c_str(), header.mode))
+		{
+			return false;
+		}
+	}
+	break;
+	case CONTTYPE:	/* reserved */
+	{
+
+	}
+	break;
+	default:
+	{
+		/* something wrong */
+	}
+	break;
+	}
+
+	return true;
+}
+
+bool
+TarUnpacker::createDumpDir(const HeaderInfo & header, std::string_view listing, const std::string & basePath)
+{
+	/* name ends with '/', lstat of "file/" fails with ENOTDIR */
+	std::string_view name = header.name;
+	while (name.length() > 1 && name.back() == '/')
+	{
+		name.remove_suffix(1);
+	}
+	const std::string path = memberPath(basePath, name);
+
+	struct stat s;
+	if (lstat(path.c_str(), &s) || !S_ISDIR(s.st_mode))
+	{
+		if (incremental)
+		{
+			removeMember(basePath, name);
+		}
+
+		if (mkdir(path.c_str(), 0))
+		{
+			return false;
+		}
+	}
+
+	if (incremental)
+	{
+		/* flag byte and null terminated name each, an empty name ends the list */
+		std::unordered_set<std::string_view> kept;
+		for (size_t pos = 0; pos < listing.length() && listing[pos] != '\0';)
+		{
+			size_t end = listing.find('\0', pos);
+			if (end == std::string_view::npos)
+			{
+				end = listing.length();
+			}
+			kept.insert(listing.substr(pos + 1, end - pos - 1));
+			pos = end + 1;
+		}
+
+		/* reached from basePath without following symlinks, deletions stay inside it */
+		int dirFd = openMemberDir(basePath, name);
+		if (dirFd == -1)
+		{
+			printf("Directory %s leads out of the target directory.\n", path.c_str());
+			return false;
+		}
+
+		std::vector<std::string> deleted;
+		DIR * dir = fdopendir(dup(dirFd));
+		if (!dir)
+		{
+			close(dirFd);
+			return false;
+		}
+		while (struct dirent * dirent = readdir(dir))
+		{
+			const char * entryName = dirent->d_name;
+			if (strcmp(entryName, ".") && strcmp(entryName, "..") && !kept.count(entryName))
+			{
+				deleted.push_back(entryName);
+			}
+		}
+		closedir(dir);
+
+		for (const std::string & victim : deleted)
+		{
+			removeAt(dirFd, victim.c_str());
+		}
+		close(dirFd);
+	}
+
+	/* mode last, it may forbid the removal */
+	chmod(path.c_str(), header.mode);
+	return true;
+}
+
+static int
+removeOne(const char * path, const struct stat *, int, struct FTW *)
+{
+	return remove(path);
+}
+
+bool
+TarUnpacker::removePath(const std::string & path)
+{
+	struct stat s;
+	if (lstat(path.c_str(), &s))
+	{
+		return errno == ENOENT;
+	}
+
+	if (!S_ISDIR(s.st_mode))
+	{
+		return unlink(path.c_str()) == 0;
+	}
+
+	/* children first, symlinks are not followed */
+	return nftw(path.c_str(), removeOne, 16, FTW_DEPTH | FTW_PHYS) == 0;
+}
+
+bool
+TarUnpacker::removeAt(int dirFd, const char * name)
+{
+	struct stat s;
+	if (fstatat(dirFd, name, &s, AT_SYMLINK_NOFOLLOW))
+	{
+		return errno == ENOENT;
+	}
+
+	if (!S_ISDIR(s.st_mode))
+	{
+		return unlinkat(dirFd, name, 0) == 0;
+	}
+
+	/* children first, a symlink is removed, never entered */
+	int childFd = openat(dirFd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	DIR * dir = childFd == -1 ? nullptr : fdopendir(childFd);
+	if (!dir)
+	{
+		if (childFd != -1)
+		{
+			close(childFd);
+		}
+		return false;
+	}
+
+	bool removed = true;
+	while (struct dirent * dirent = readdir(dir))
+	{
+		if (strcmp(dirent->d_name, ".") && strcmp(dirent->d_name, ".."))
+		{
+			removed = removeAt(childFd, dirent->d_name) && removed;
+		}
+	}
+	closedir(dir);
+
+	return removed && unlinkat(dirFd, name, AT_REMOVEDIR) == 0;
+}
+
+int
+TarUnpacker::openMemberDir(const std::string & basePath, std::string_view name)
+{
+	int dirFd = open(basePath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	std::string step;
+	size_t pos = 0;
+	while (dirFd != -1 && pos < name.length())
+	{
+		size_t slash = name.find('/', pos);
+		if (slash == std::string_view::npos)
+		{
+			slash = name.length();
+		}
+		step.assign(name.substr(pos, slash - pos));
+		pos = slash + 1;
+
+		if (step.empty() || step == ".")
+		{
+			continue;
+		}
+		if (step == "..")
+		{
+			close(dirFd);
+			errno = EPERM;
+			return -1;
+		}
+
+		/* a symlink on the way fails with ELOOP or ENOTDIR */
+		int nextFd = openat(dirFd, step.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+		close(dirFd);
+		dirFd = nextFd;
+	}
+	return dirFd;
+}
+
+bool
+TarUnpacker::removeMember(const std::string & basePath, std::string_view name)
+{
+	while (!name.empty() && name.back() == '/')
+	{
+		name.remove_suffix(1);
+	}
+
+	size_t slash = name.rfind('/');
+	std::string leaf(slash == std::string_view::npos ? name : name.substr(slash + 1));
+	if (leaf.empty() || leaf == "." || leaf == "..")
+	{
+		return false;
+	}
+
+	int dirFd = openMemberDir(basePath, slash == std::string_view::npos ? std::string_view() : name.substr(0, slash));
+	if (dirFd == -1)
+	{
+		/* no parent, nothing to remove */
+		return errno == ENOENT;
+	}
+
+	bool removed = removeAt(dirFd, leaf.c_str());
+	close(dirFd);
+	return removed;
+}
+
+int
+TarUnpacker::openTarget(const char * path, mode_t mode)
+{
+	/* a symlink there is replaced, never written through */
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, mode);
+	if (fd == -1 && errno == ELOOP && unlink(path) == 0)
+	{
+		fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, mode);
+	}
+	return fd;
+}
+
+bool
+TarUnpacker::delayLink(const std::string & path, std::string_view target)
+{
+	/* empty file holds the place: nothing can be created below it meanwhile */
+	int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0);
+	struct stat s;
+	if (fd == -1 && errno == EEXIST && lstat(path.c_str(), &s) == 0 && !S_ISDIR(s.st_mode) &&
+		unlink(path.c_str()) == 0)
+	{
+		fd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0);
+	}
+	if (fd == -1)
+	{
+		return false;
+	}
+
+	bool placed = fstat(fd, &s) == 0;
+	close(fd);
+	if (placed)
+	{
+		delayedLinks[path] = { std::string(target), s.st_dev, s.st_ino };
+	}
+	return placed;
+}
+
+void
+TarUnpacker::supersedeLink(const std::string & path)
+{
+	if (!delayedLinks.empty())
+	{
+		delayedLinks.erase(path);
+	}
+}
+
+bool
+TarUnpacker::createDelayedLinks()
+{
+	bool created = true;
+	for (const auto & delayed : delayedLinks)
+	{
+		const std::string & path = delayed.first;
+		const DelayedLink & link = delayed.second;
+
+		/* a member after the link put something else there */
+		struct stat s;
+		if (lstat(path.c_str(), &s) || s.st_dev != link.dev || s.st_ino != link.ino)
+		{
+			continue;
+		}
+
+		if (unlink(path.c_str()) || symlink(link.target.c_str(), path.c_str()))
+		{
+			created = false;
+		}
+	}
+	delayedLinks.clear();
+	return created;
+}
+
+bool
+TarUnpacker::writeContentToTargetFile(const HeaderInfo & header, std::istream & input, int targetFd)
+{
+	/* read/write content, skip padding of the last block */
+	return copyEngine.copyUnpadded(input, targetFd, header.size) == (uint64_t)header.size;
+}
+
+bool
+TarUnpacker::writeContentFromMapping(const ArchiveEntry & entry, const std::string & targetPath)
+{
+	int targetFd = openTarget(targetPath.c_str(), 0666);
+	if (targetFd == -1)
+	{
+		return false;
+	}
+
+	uint64_t written = 0;
+	while (written < entry.size)
+	{
+		ssize_t n = write(targetFd, entry.data + written, entry.size - written);
+		if (n <= 0)
+		{
+			break;
+		}
+		written += n;
+	}
+
+	close(targetFd);
+	return written == entry.size;
+}
+
+bool
+TarUnpacker::writeContentInKernel(const HeaderInfo & header, std::istream & input, int targetFd)
+{
+	std::streampos pos = input.tellg();
+	uint64_t copied = 0;
+	if (reflink)
+	{
+		copied = copyEngine.cloneRange(archiveFd, pos, targetFd, 0, header.size);
+	}
+	if (zeroCopy && copied < (uint64_t)header.size)
+	{
+		copied += copyEngine.copyKernel(archiveFd, (uint64_t)pos + copied, targetFd, copied, header.size - copied);
+	}
+
+	if (copied == (uint64_t)header.size)
+	{
+		input.seekg(pos + (std::streamoff)CopyEngine::alignToBlock(copied));
+		return true;
+	}
+
+	/* kernel refused, the rest goes through the buffer */
+	if (lseek(targetFd, copied, SEEK_SET) != (off_t)copied)
+	{
+		return false;
+	}
+
+	input.seekg(pos + (std::streamoff)copied);
+	return copied + copyEngine.copyUnpadded(input, targetFd, header.size - copied, copied) == (uint64_t)header.size;
+}
+
+bool
+TarUnpacker::writeSparse(const HeaderInfo & header, std::istream & input, int targetFd)
+{
+	/* map is read block by block until it is complete */
+	size_t mapSize = 0;
+	sparseMap.clear();
+	while (!SparseMap::decode(sparseMap, extents, mapSize))
+	{
+		size_t length = sparseMap.length();
+		if (length >= (uint64_t)header.size)
+		{
+			return false;
+		}
+
+		sparseMap.resize(length + BLOCK_SIZE);
+		input.read(&sparseMap[length], BLOCK_SIZE);
+		if (input.gcount() != BLOCK_SIZE)
+		{
+			return false;
+		}
+	}
+
+	if (mapSize + SparseMap::dataSize(extents) != (uint64_t)header.size)
+	{
+		return false;
+	}
+
+	for (const SparseExtent & extent : extents)
+	{
+		if (lseek(targetFd, extent.offset, SEEK_SET) != (off_t)extent.offset ||
+			copyEngine.copyPiece(input, targetFd, extent.size) != extent.size)
+		{
+			return false;
+		}
+	}
+	input.ignore(CopyEngine::alignToBlock(header.size) - header.size);
+
+	/* holes are what was never written */
+	return ftruncate(targetFd, header.realSize) == 0;
+}
+
+bool
+TarUnpacker::writeSparseFromMapping(const HeaderInfo & header, const ArchiveEntry & entry, const std::string & targetPath)
+{
+	size_t mapSize = 0;
+	if (!SparseMap::decode(std::string_view((const char*)entry.data, entry.size), extents, mapSize) ||
+		mapSize + SparseMap::dataSize(extents) != entry.size)
+	{
+		return false;
+	}
+
+	int targetFd = openTarget(targetPath.c_str(), 0666);
+	if (targetFd == -1)
+	{
+		return false;
+	}
+
+	const int8_t * data = entry.data + mapSize;
+	bool written = true;
+	for (const SparseExtent & extent : extents)
+	{
+		uint64_t done = 0;
+		while (written && done < extent.size)
+		{
+			ssize_t n = pwrite(targetFd, data + done, extent.size - done, extent.offset + done);
+			written = n > 0;
+			done += written ? n : 0;
+		}
+		data += extent.size;
 	}
+
+	written = written && ftruncate(targetFd, header.realSize) == 0;
+	close(targetFd);
+	return written;
 }
@@ -3,8 +3,22 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <climits>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "../TarCommon.h"
+#include "../Copy/CopyEngine.h"
+#include "../Header/HeaderCodec.h"
+#include "../Reader/ArchiveReader.h"
+#include "../Index/ArchiveIndex.h"
+#include "../Compress/DecompressStreamBuf.h"
+#include "../Dedup/DedupStreamBuf.h"
+#include "../Pax/PaxHeader.h"
+#include "../Sparse/SparseMap.h"
+#include "../Stream/FdStreamBuf.h"
 
 /*
 		:
@@ -32,6 +46,14 @@
 
 		  
 	*/
+/* symlink member waiting for the end of extraction, its place is held by an empty file */
+struct DelayedLink
+{
+	std::string target;
+	dev_t dev;		/* of the placeholder */
+	ino_t ino;
+};
+
 class TarUnpacker
 {
 private:
@@ -39,33 +61,206 @@ private:
 	ContentData emptyBuffer = { NULL }; 		/* eof init */
 	ContentData workBuffer;
 	ContentData additionalBuffer;
+	CopyEngine copyEngine;
+	bool zeroCopy = false;
+	bool reflink = false;
+	int archiveFd = -1;		/* second descriptor of archive for kernel copy */
+	size_t threadCount = 1;
+	bool mapped = false;
+	std::vector<std::string> includes;
+	std::vector<std::string> excludes;
+	std::string pathBuffer;
+	bool uring = false;
+	bool incremental = false;
+	std::string dumpBuffer;		/* payload of a dumpdir */
+	std::string dedupStorePath;
+	PaxHeader extended;		/* records for the member after an extended header */
+	PaxHeader globalExtended;	/* records of the last global header, for every member after it */
+	std::string prefixedName;	/* prefix/name of a ustar header */
+	std::vector<SparseExtent> extents;
+	std::string sparseMap;
+	std::unordered_map<std::string, DelayedLink> delayedLinks;	/* by placeholder path */
+	std::ostream * listing = nullptr;	/* while list() reads a stream: members are printed, not created */
+
+	bool unpackArchive(const std::string & path);
+
+	/* unpackStream without the delayed links */
+	bool unpackMembers(std::istream & input, const std::string & basePath);
+
+	/* plain archive in a file, one pread of a header per member */
+	bool listPlain(int fd, std::ostream & output);
+
+	bool unpackMapped(const std::string & path, const std::string & basePath);
+
+	bool unpackCompressed(std::istream & input, const std::string & basePath, Compression type);
+
+	/* manifest read back through the chunk store */
+	bool unpackDeduplicated(std::istream & input, const std::string & basePath);
+
+	/* decompress only the pieces holding member, by frame table of index */
+	bool extractCompressedMember(std::istream & input, const ArchiveIndex & index,
+		const IndexEntry & entry, const std::string & member, const std::string & basePath, Compression type);
+
+	/* header at the indexed offset is the one of member, false with a message if not */
+	bool indexedMember(const HeaderInfo & headerInfo, std::string_view member);
 
 public:
 	TarUnpacker() {};
 
-	void unpack(const std::string & path);
+	/* "-" is stdin extracted into the current directory; a pipe, socket or device */
+	/* path is read forward like it, parallel and kernel copy modes need a file; */
+	/* false if the archive is damaged or a member can't be created */
+	bool unpack(const std::string & path);
+
+	/* forward only extraction, end of archive is found inline */
+	bool unpackStream(std::istream & input, const std::string & basePath);
+
+	/* archive, compressed archive or dedup manifest read forward from fd */
+	bool unpackDescriptor(int fd, const std::string & basePath);
+
+	/* print members passing the filters; "-", pipes, compressed archives and dedup */
+	/* manifests are read forward like unpack reads them, payloads are skipped */
+	bool list(const std::string & path, std::ostream & output = std::cout);
+
+	/* extract one member, found by <archive>.idx sidecar which is built on first use;
+	   compressed archive needs the sidecar written with --seekable */
+	bool extractMember(const std::string & path, const std::string & member);
+
+	/* every header has correct checksum and archive ends with 2 empty blocks */
+	bool verify(const std::string & path);
+
+	/* size of one read/write while copying file content */
+	void setChunkSize(size_t size);
+
+	/* move file content with copy_file_range/sendfile, falls back to buffered copy */
+	void setZeroCopy(bool enable);
+
+	/* payloads of a plain archive on the same btrfs/xfs are cloned (FICLONERANGE) instead of */
+	/* copied, as far as they lie on clone blocks; the rest is copied. Packing with */
+	/* TarPacker::setAlignPayloads puts big payloads there */
+	void setReflink(bool enable);
+
+	/* more than one thread creates files in parallel, see ParallelUnpacker */
+	void setThreadCount(size_t count);
+
+	/* create and write small files in io_uring batches, see UringUnpacker */
+	/* falls back to synchronous calls where io_uring is not available */
+	void setUring(bool enable);
+
+	/* replay incremental archives in order: members replace whatever is on disk */
+	/* and dumpdirs remove entries deleted since; always runs on the serial stream path */
+	void setIncremental(bool enable);
+
+	/* chunk store of .dedup manifests, see DedupStreamBuf */
+	void setDedup(const std::string & storePath);
+
+	/* write manifest back as plain tar: <name>.tar.dedup becomes <name>.tar */
+	bool rehydrate(const std::string & path);
+
+	/* read archive through ArchiveReader mapping instead of stream */
+	void setMapped(bool enable);
+
+	/* glob over member names, a directory pattern takes its content too */
+	/* without includes every member is taken, excludes win over includes */
+	void addInclude(const std::string & pattern);
+
+	void addExclude(const std::string & pattern);
+
+	bool filtered() const { return !includes.empty() || !excludes.empty(); }
+
+	bool matches(std::string_view name) const;
+
+	/* filtered members may come without their directories */
+	bool createParentDirs(const std::string & basePath, std::string_view name);
+
+	/* basePath/name in a buffer reused for every member, valid until the next call */
+	const std::string & memberPath(const std::string & basePath, std::string_view name);
+
+	/* extended or global header: its payload is parsed and applies to the next member */
+	/* or to all of them, false if the payload is truncated or malformed */
+	bool readExtended(const HeaderInfo & headerInfo, std::istream & input);
+
+	bool readExtended(const ArchiveEntry & entry);
+
+	/* payload after the header at offset */
+	bool readExtended(const HeaderInfo & headerInfo, int fd, uint64_t offset);
+
+	/* member takes its ustar prefix and what pax headers give: name, size, times, owner, */
+	/* sparse map; a leading '/' of name and hard link target is dropped. True if its */
+	/* name or size is not the one in its header block */
+	bool applyExtended(HeaderInfo & headerInfo);
+
+	/* name or hard link target has a ".." step, such a member is refused */
+	bool escapes(const HeaderInfo & headerInfo) const;
+
+	/* header at the current position of input, pax headers are read with the member after them */
+	bool readMemberHeader(std::istream & input, HeaderInfo & headerInfo);
+
+	/* line like tar -tv prints */
+	void listMember(const HeaderInfo & headerInfo, std::ostream & output);
 
 	std::string extractName(const std::string & path);
 
 	std::string getDirFileName(const std::string & path);
 
+	/* directory of archive at path, "." when path has none */
+	std::string getBasePath(const std::string & path);
+
 	/* Check end of file. It must contains 2 blocks size of 512 bytes at the end of file */
 	bool checkExpand(std::ifstream & finput, std::streampos & sizeOfContent);
 
-	HeaderInfo * convertHeader(const PosixHeader & header);
+	/* text fields of headerInfo view into header */
+	static void convertHeader(const PosixHeader & header, HeaderInfo & headerInfo);
+
+	bool checkHeader(const HeaderInfo & headerInfo, const PosixHeader & header);
 
-	/* to calculate checksum must summarizes all bytes of header */
-	/* but in field checksum first seven bytes must set to whitespace ((char)32)  */
-	/* the last byte eight set to trailing zero (\0) */
-	int64_t calculateUnsignedCheckSum(PosixHeader & header) const;
+	bool createFileType(const HeaderInfo & headerInfo, std::istream & finput, const std::string & basePath);
 
-	bool checkHeader(const HeaderInfo & headerInfo, PosixHeader & header);
+	/* payload is taken from the mapping */
+	bool createFileType(const HeaderInfo & headerInfo, const ArchiveEntry & entry, const std::string & basePath);
 
-	bool createFileType(const HeaderInfo & headerInfo, std::ifstream & finput, const std::string & basePath);
+	/* any entry without payload */
+	bool createEntry(const HeaderInfo & headerInfo, const std::string & basePath);
+
+	/* directory of a dumpdir member, with incremental removes entries not in listing */
+	bool createDumpDir(const HeaderInfo & header, std::string_view listing, const std::string & basePath);
+
+	/* file or whole tree at path, nothing there is fine */
+	static bool removePath(const std::string & path);
+
+	/* file or whole tree name in directory dirFd, symlinks are removed and never followed */
+	static bool removeAt(int dirFd, const char * name);
+
+	/* directory name below basePath, opened step by step without following symlinks; */
+	/* -1 if a step is missing, is not a directory or is ".." */
+	static int openMemberDir(const std::string & basePath, std::string_view name);
+
+	/* removePath confined to basePath, for what an archive names */
+	static bool removeMember(const std::string & basePath, std::string_view name);
+
+	/* regular file to write a member into, O_NOFOLLOW: a symlink at path is replaced */
+	static int openTarget(const char * path, mode_t mode);
+
+	/* symlink at path is made by createDelayedLinks, after every other member */
+	bool delayLink(const std::string & path, std::string_view target);
+
+	/* member written at path after a symlink member of the same name wins over it */
+	void supersedeLink(const std::string & path);
+
+	/* symlinks whose placeholders are still there, called at the end of every extraction */
+	bool createDelayedLinks();
 
 	bool createDir(const HeaderInfo & header, Error & errorType);
 
-	void writeContentToTargetFile(const HeaderInfo & header, std::ifstream & input,
-		std::ofstream & target);
+	bool writeContentToTargetFile(const HeaderInfo & header, std::istream & input, int targetFd);
+
+	bool writeContentFromMapping(const ArchiveEntry & entry, const std::string & targetPath);
+
+	bool writeContentInKernel(const HeaderInfo & header, std::istream & input, int targetFd);
+
+	/* data extents of a sparse member at their offsets, holes are left unwritten */
+	bool writeSparse(const HeaderInfo & header, std::istream & input, int targetFd);
+
+	bool writeSparseFromMapping(const HeaderInfo & header, const ArchiveEntry & entry, const std::string & targetPath);
 
 };
\ No newline at end of file
@@ -0,0 +1,242 @@
+#include "UringUnpacker.h"
+
+UringUnpacker::UringUnpacker(TarUnpacker & unpacker, const std::string & basePath, UringQueue & ring)
+	: unpacker(unpacker), basePath(basePath), ring(ring)
+{
+	/* umask can only be read by setting it */
+	mask = umask(0);
+	umask(mask);
+}
+
+bool
+UringUnpacker::run(std::istream & input)
+{
+	static const ContentData zeros = { 0 };
+
+	for (;;)
+	{
+		input.read((char*)&header, BLOCK_SIZE);
+		if (input.gcount() != BLOCK_SIZE)
+		{
+			/* truncated */
+			flush();
+			return false;
+		}
+
+		if (std::memcmp(&header, &zeros, BLOCK_SIZE) == 0)
+		{
+			/* end of archive */
+			return flush();
+		}
+
+		HeaderInfo headerInfo;
+		TarUnpacker::convertHeader(header, headerInfo);
+
+		if (!unpacker.checkHeader(headerInfo, header))
+		{
+			flush();
+			return false;
+		}
+
+		if (PaxHeader::isPaxType(headerInfo.typeflag))
+		{
+			if (!unpacker.readExtended(headerInfo, input))
+			{
+				flush();
+				return false;
+			}
+			continue;
+		}
+		unpacker.applyExtended(headerInfo);
+		if (unpacker.escapes(headerInfo))
+		{
+			flush();
+			return false;
+		}
+
+		if (!unpacker.matches(headerInfo.name))
+		{
+			/* no seeking here, content is read through */
+			input.ignore(headerInfo.blockCount * BLOCK_SIZE);
+			continue;
+		}
+
+		if (unpacker.filtered() && !unpacker.createParentDirs(basePath, headerInfo.name))
+		{
+			flush();
+			return false;
+		}
+
+		bool small = (headerInfo.typeflag == REGTYPE || headerInfo.typeflag == AREGTYPE) &&
+			headerInfo.size <= URING_SMALL_FILE && !headerInfo.sparse;
+		if (small)
+		{
+			if (!add(headerInfo, input))
+			{
+				return false;
+			}
+			continue;
+		}
+
+		if (!flush() || !unpacker.createFileType(headerInfo, input, basePath))
+		{
+			return false;
+		}
+	}
+}
+
+bool
+UringUnpacker::add(const HeaderInfo & headerInfo, std::istream & input)
+{
+	const std::string & path = unpacker.memberPath(basePath, headerInfo.name);
+	const size_t hash = std::hash<std::string_view>()(path);
+	unpacker.supersedeLink(path);
+	size_t size = headerInfo.size;
+
+	bool repeated = false;
+	for (const Pending & pending : batch)
+	{
+		if (pending.hash == hash && path == paths.data() + pending.pathOffset)
+		{
+			repeated = true;
+			break;
+		}
+	}
+
+	if (repeated || batch.size() == ring.depth() || (dataUsed + size > URING_BATCH_BYTES && !batch.empty()))
+	{
+		if (!flush())
+		{
+			return false;
+		}
+	}
+
+	Pending pending;
+	pending.pathOffset = paths.size();
+	paths.insert(paths.end(), path.c_str(), path.c_str() + path.length() + 1);
+	pending.dataOffset = dataUsed;
+	pending.size = size;
+	pending.hash = hash;
+	pending.mode = headerInfo.mode;
+	pending.fd = -1;
+	pending.written = 0;
+
+	dataUsed += size;
+	if (data.size() < dataUsed)
+	{
+		data.resize(dataUsed);
+	}
+
+	input.read((char*)data.data() + pending.dataOffset, size);
+	if ((size_t)input.gcount() != size)
+	{
+		/* truncated, what is batched already is still written */
+		flush();
+		return false;
+	}
+	input.ignore(CopyEngine::alignToBlock(size) - size);
+
+	batch.push_back(pending);
+	return true;
+}
+
+bool
+UringUnpacker::flush()
+{
+	if (batch.empty())
+	{
+		return true;
+	}
+
+	/* creation stays synchronous, see the class comment */
+	for (size_t i = 0; i < batch.size(); ++i)
+	{
+		Pending & pending = batch[i];
+		const char * path = paths.data() + pending.pathOffset;
+		pending.fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, pending.mode);
+		if (pending.fd != -1 && (pending.mode & mask))
+		{
+			fchmod(pending.fd, pending.mode);
+		}
+		else if (pending.fd == -1 && errno == EEXIST)
+		{
+			/* overwrite keeps the inode, as createFileType does; a symlink is replaced */
+			pending.fd = TarUnpacker::openTarget(path, pending.mode);
+			if (pending.fd != -1)
+			{
+				fchmod(pending.fd, pending.mode);
+			}
+		}
+
+		if (pending.fd == -1)
+		{
+			/* later files of the batch are not created either */
+			break;
+		}
+	}
+
+	bool result = true;
+	size_t writes = 0;
+	for (size_t i = 0; result && i < batch.size(); ++i)
+	{
+		if (batch[i].fd != -1 && batch[i].size > 0)
+		{
+			ring.write(batch[i].fd, data.data() + batch[i].dataOffset, batch[i].size, 0, i);
+			writes++;
+		}
+	}
+	if (result && writes)
+	{
+		result = ring.complete([this](uint64_t i, int32_t written) {
+			batch[i].written = written > 0 ? written : 0;
+		});
+	}
+
+	for (size_t i = 0; result && i < batch.size(); ++i)
+	{
+		Pending & pending = batch[i];
+		if (pending.fd == -1)
+		{
+			/* can't create file */
+			result = false;
+			break;
+		}
+
+		while (pending.written < pending.size)
+		{
+			/* short write, finish it synchronously */
+			ssize_t n = pwrite(pending.fd, data.data() + pending.dataOffset + pending.written,
+				pending.size - pending.written, pending.written);
+			if (n <= 0)
+			{
+				result = false;
+				break;
+			}
+			pending.written += n;
+		}
+	}
+
+	size_t closes = 0;
+	for (size_t i = 0; i < batch.size(); ++i)
+	{
+		if (batch[i].fd != -1)
+		{
+			if (!ring.close(batch[i].fd, i))
+			{
+				close(batch[i].fd);
+				continue;
+			}
+			closes++;
+		}
+	}
+	if (closes && !ring.complete([](uint64_t, int32_t) {}))
+	{
+		result = false;
+	}
+
+	batch.clear();
+	paths.clear();
+	dataUsed = 0;
+
+	return result;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include "TarUnpacker.h"
+#include "../Uring/UringQueue.h"
+
+/*
+	io_uring mode of TarUnpacker, forward only like unpackStream.
+	Payloads of small regular files are read into a batch, the files are
+	created one by one and then written and closed with one submission per step
+	for the whole batch. Creation stays synchronous: io_uring can't create
+	without punting to its workers, which then fight for the directory lock.
+	Files are created with O_EXCL and their mode, so fchmod is needed only when
+	umask took bits away; a file which exists already is truncated and chmod-ed.
+	Any other member writes the batch first and is extracted by TarUnpacker,
+	so directories exist before the files in them.
+*/
+class UringUnpacker
+{
+private:
+	struct Pending
+	{
+		size_t pathOffset;
+		size_t dataOffset;
+		size_t size;
+		size_t hash;	/* of the path, a member repeated in the batch writes it first */
+		uint16_t mode;
+		int fd;
+		size_t written;
+	};
+
+	TarUnpacker & unpacker;
+	std::string basePath;
+	UringQueue & ring;
+	mode_t mask;			/* umask of the process */
+
+	PosixHeader header;
+	std::vector<Pending> batch;
+	std::vector<char> paths;
+	std::vector<int8_t> data;
+	size_t dataUsed = 0;
+
+	/* payload of a small regular file, false if archive is truncated or the batch failed */
+	bool add(const HeaderInfo & headerInfo, std::istream & input);
+
+	/* create, write and close all pending files, false stops extraction like TarUnpacker::createFileType */
+	bool flush();
+
+public:
+	UringUnpacker(TarUnpacker & unpacker, const std::string & basePath, UringQueue & ring);
+
+	/* same as TarUnpacker::unpackStream */
+	bool run(std::istream & input);
+};
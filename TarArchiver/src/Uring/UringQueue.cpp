@@ -0,0 +1,255 @@
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <linux/io_uring.h>
+#undef BLOCK_SIZE
+
+#include "UringQueue.h"
+
+/* glibc has no wrappers for these two */
+static int
+uringSetup(unsigned entries, struct io_uring_params * params)
+{
+	return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int
+uringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags)
+{
+	return (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0);
+}
+
+UringQueue::~UringQueue()
+{
+	release();
+}
+
+void
+UringQueue::release()
+{
+	if (sqes)
+	{
+		munmap(sqes, sqesSize);
+	}
+	if (cqRing && cqRing != sqRing)
+	{
+		munmap(cqRing, cqRingSize);
+	}
+	if (sqRing)
+	{
+		munmap(sqRing, sqRingSize);
+	}
+	if (ringFd != -1)
+	{
+		::close(ringFd);
+	}
+
+	ringFd = -1;
+	entries = 0;
+	queued = 0;
+	sqes = nullptr;
+	sqRing = nullptr;
+	cqRing = nullptr;
+}
+
+bool
+UringQueue::open(unsigned depth)
+{
+	release();
+
+	struct io_uring_params params;
+	std::memset(&params, 0, sizeof(params));
+
+	/* one thread submits and reaps: completions are run when we wait for them (6.1) */
+	params.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+	ringFd = uringSetup(depth, &params);
+	if (ringFd < 0 && errno == EINVAL)
+	{
+		std::memset(&params, 0, sizeof(params));
+		ringFd = uringSetup(depth, &params);
+	}
+	if (ringFd < 0)
+	{
+		/* ENOSYS on old kernels, EPERM when disabled by sysctl or seccomp */
+		ringFd = -1;
+		return false;
+	}
+
+	sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+	/* both rings in one mapping since 5.4 */
+	bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+	if (single)
+	{
+		sqRingSize = cqRingSize = sqRingSize > cqRingSize ? sqRingSize : cqRingSize;
+	}
+
+	sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		ringFd, IORING_OFF_SQ_RING);
+	if (sqRing == MAP_FAILED)
+	{
+		sqRing = nullptr;
+		release();
+		return false;
+	}
+
+	cqRing = single ? sqRing : mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+	if (cqRing == MAP_FAILED)
+	{
+		cqRing = nullptr;
+		release();
+		return false;
+	}
+
+	sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+	void * entryMap = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		ringFd, IORING_OFF_SQES);
+	if (entryMap == MAP_FAILED)
+	{
+		release();
+		return false;
+	}
+	sqes = (struct io_uring_sqe*)entryMap;
+
+	char * sq = (char*)sqRing;
+	sqHead = (unsigned*)(sq + params.sq_off.head);
+	sqTail = (unsigned*)(sq + params.sq_off.tail);
+	sqMask = (unsigned*)(sq + params.sq_off.ring_mask);
+	sqArray = (unsigned*)(sq + params.sq_off.array);
+
+	char * cq = (char*)cqRing;
+	cqHead = (unsigned*)(cq + params.cq_off.head);
+	cqTail = (unsigned*)(cq + params.cq_off.tail);
+	cqMask = (unsigned*)(cq + params.cq_off.ring_mask);
+	cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+	entries = params.sq_entries;
+	return true;
+}
+
+struct io_uring_sqe *
+UringQueue::next(uint8_t opcode, int fd, uint64_t userData)
+{
+	if (ringFd == -1 || queued == entries)
+	{
+		return nullptr;
+	}
+
+	unsigned tail = *sqTail;
+	unsigned slot = tail & *sqMask;
+
+	struct io_uring_sqe * sqe = &sqes[slot];
+	std::memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = opcode;
+	sqe->fd = fd;
+	sqe->user_data = userData;
+
+	sqArray[slot] = slot;
+	__atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+	++queued;
+
+	return sqe;
+}
+
+bool
+UringQueue::openat(int dirFd, const char * path, int flags, mode_t mode, uint64_t userData)
+{
+	struct io_uring_sqe * sqe = next(IORING_OP_OPENAT, dirFd, userData);
+	if (!sqe)
+	{
+		return false;
+	}
+
+	sqe->addr = (uint64_t)path;
+	sqe->open_flags = flags;
+	sqe->len = mode;
+	return true;
+}
+
+bool
+UringQueue::read(int fd, void * data, size_t size, uint64_t offset, uint64_t userData)
+{
+	struct io_uring_sqe * sqe = next(IORING_OP_READ, fd, userData);
+	if (!sqe)
+	{
+		return false;
+	}
+
+	sqe->addr = (uint64_t)data;
+	sqe->len = size;
+	sqe->off = offset;
+	return true;
+}
+
+bool
+UringQueue::write(int fd, const void * data, size_t size, uint64_t offset, uint64_t userData)
+{
+	struct io_uring_sqe * sqe = next(IORING_OP_WRITE, fd, userData);
+	if (!sqe)
+	{
+		return false;
+	}
+
+	sqe->addr = (uint64_t)data;
+	sqe->len = size;
+	sqe->off = offset;
+	return true;
+}
+
+bool
+UringQueue::close(int fd, uint64_t userData)
+{
+	return next(IORING_OP_CLOSE, fd, userData) != nullptr;
+}
+
+bool
+UringQueue::statx(int dirFd, const char * path, int flags, unsigned mask, struct statx * result, uint64_t userData)
+{
+	struct io_uring_sqe * sqe = next(IORING_OP_STATX, dirFd, userData);
+	if (!sqe)
+	{
+		return false;
+	}
+
+	sqe->addr = (uint64_t)path;
+	sqe->statx_flags = flags;
+	sqe->len = mask;
+	sqe->off = (uint64_t)result;
+	return true;
+}
+
+bool
+UringQueue::complete(const std::function<void(uint64_t, int32_t)> & done)
+{
+	unsigned toSubmit = queued;
+	unsigned left = queued;
+	queued = 0;
+
+	while (left > 0)
+	{
+		int submitted = uringEnter(ringFd, toSubmit, 1, IORING_ENTER_GETEVENTS);
+		if (submitted < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			return false;
+		}
+		toSubmit -= (unsigned)submitted < toSubmit ? (unsigned)submitted : toSubmit;
+
+		unsigned head = *cqHead;
+		unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+		for (; head != tail && left > 0; ++head, --left)
+		{
+			const struct io_uring_cqe & cqe = cqes[head & *cqMask];
+			done(cqe.user_data, cqe.res);
+		}
+		__atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+	}
+
+	return true;
+}
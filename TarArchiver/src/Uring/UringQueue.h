@@ -0,0 +1,85 @@
+#pragma once
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <functional>
+
+#include "../TarCommon.h"
+
+/* linux/io_uring.h stays in UringQueue.cpp: it brings linux/fs.h with another BLOCK_SIZE */
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+/* submission queue entries, also the most operations queued between two complete calls */
+#define URING_DEPTH 256
+
+/* bigger files are left to the synchronous copy path */
+#define URING_SMALL_FILE (64 * 1024)
+
+/* file content held by one batch */
+#define URING_BATCH_BYTES (16 * 1024 * 1024)
+
+/*
+	Minimal io_uring ring over the raw syscalls, liburing is not needed.
+	Operations are queued with openat/read/write/close/statx and go to the
+	kernel together on complete, which waits for all of them: one
+	io_uring_enter for a whole batch instead of a syscall per operation.
+	open fails where the kernel has no io_uring or it is disabled,
+	callers keep their synchronous path for that case.
+*/
+class UringQueue
+{
+private:
+	int ringFd = -1;
+	unsigned entries = 0;
+	unsigned queued = 0;	/* prepared, not submitted yet */
+
+	void * sqRing = nullptr;
+	size_t sqRingSize = 0;
+	void * cqRing = nullptr;
+	size_t cqRingSize = 0;
+	struct io_uring_sqe * sqes = nullptr;
+	size_t sqesSize = 0;
+
+	unsigned * sqHead = nullptr;
+	unsigned * sqTail = nullptr;
+	unsigned * sqMask = nullptr;
+	unsigned * sqArray = nullptr;
+	unsigned * cqHead = nullptr;
+	unsigned * cqTail = nullptr;
+	unsigned * cqMask = nullptr;
+	struct io_uring_cqe * cqes = nullptr;
+
+	/* empty entry for the next operation, nullptr if depth operations are queued */
+	struct io_uring_sqe * next(uint8_t opcode, int fd, uint64_t userData);
+
+	void release();
+
+public:
+	UringQueue() {};
+	~UringQueue();
+
+	UringQueue(const UringQueue &) = delete;
+	UringQueue & operator=(const UringQueue &) = delete;
+
+	/* false if io_uring can't be used here */
+	bool open(unsigned depth = URING_DEPTH);
+
+	bool available() const { return ringFd != -1; }
+
+	unsigned depth() const { return entries; }
+
+	/* false when the queue is full, call complete first */
+	bool openat(int dirFd, const char * path, int flags, mode_t mode, uint64_t userData);
+
+	bool read(int fd, void * data, size_t size, uint64_t offset, uint64_t userData);
+
+	bool write(int fd, const void * data, size_t size, uint64_t offset, uint64_t userData);
+
+	bool close(int fd, uint64_t userData);
+
+	bool statx(int dirFd, const char * path, int flags, unsigned mask, struct statx * result, uint64_t userData);
+
+	/* submit queued operations and wait for every one of them, done gets userData and result or -errno */
+	/* false if the ring itself failed, results of operations are left to done */
+	bool complete(const std::function<void(uint64_t, int32_t)> & done);
+};
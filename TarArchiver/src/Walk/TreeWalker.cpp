@@ -0,0 +1,276 @@
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <algorithm>
+#include <cerrno>
+
+#include "TreeWalker.h"
+
+/* record returned by getdents64, glibc has no declaration for it */
+struct LinuxDirent64
+{
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+TreeWalker::TreeWalker(WalkOrder order, UringQueue * ring)
+	: order(order), ring(ring && ring->available() ? ring : nullptr)
+{
+}
+
+bool
+TreeWalker::walk(const std::string & basePath, const std::string & name,
+	const std::function<bool(const WalkEntry &)> & visit,
+	const std::function<bool()> & leave)
+{
+	this->visit = visit;
+	this->leave = leave;
+	member = name;
+
+	const std::string rootPath = basePath + name;
+	WalkEntry entry;
+	if (fstatat(AT_FDCWD, rootPath.c_str(), &entry.s, AT_SYMLINK_NOFOLLOW))
+	{
+		printf("File %s not found.\n", rootPath.c_str());
+		/* nothing to pack, stat is garbage */
+		return false;
+	}
+
+	if (!S_ISDIR(entry.s.st_mode))
+	{
+		entry.name = member;
+		entry.dirFd = AT_FDCWD;
+		entry.leaf = rootPath.c_str();
+		return this->visit(entry);
+	}
+
+	int fd = openat(AT_FDCWD, rootPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd == -1)
+	{
+		return false;
+	}
+
+	bool walked = walkDirectory(fd, entry.s, rootPath.c_str(), AT_FDCWD, 0);
+	close(fd);
+	return walked;
+}
+
+bool
+TreeWalker::list(int fd, size_t depth)
+{
+	if (levels.size() <= depth)
+	{
+		levels.resize(depth + 1);
+	}
+	if (batch.empty())
+	{
+		batch.resize(WALK_BATCH_SIZE);
+	}
+
+	Level & level = levels[depth];
+	level.items.clear();
+	level.names.clear();
+
+	for (;;)
+	{
+		long got = syscall(SYS_getdents64, fd, batch.data(), batch.size());
+		if (got < 0)
+		{
+			return false;
+		}
+		if (got == 0)
+		{
+			break;
+		}
+
+		for (long pos = 0; pos < got;)
+		{
+			const LinuxDirent64 * dirent = (const LinuxDirent64*)(batch.data() + pos);
+			pos += dirent->d_reclen;
+
+			const char * leaf = dirent->d_name;
+			if (leaf[0] == '.' && (leaf[1] == '\0' || (leaf[1] == '.' && leaf[2] == '\0')))
+			{
+				continue;
+			}
+
+			level.items.push_back({ (ino_t)dirent->d_ino, level.names.size() });
+			level.names.insert(level.names.end(), leaf, leaf + strlen(leaf) + 1);
+		}
+	}
+
+	const char * names = level.names.data();
+	if (order == WalkOrder::INODE)
+	{
+		std::sort(level.items.begin(), level.items.end(), [names](const Item & a, const Item & b) {
+			return a.ino != b.ino ? a.ino < b.ino : strcmp(names + a.nameOffset, names + b.nameOffset) < 0;
+		});
+	}
+	else
+	{
+		std::sort(level.items.begin(), level.items.end(), [names](const Item & a, const Item & b) {
+			return strcmp(names + a.nameOffset, names + b.nameOffset) < 0;
+		});
+	}
+
+	statAll(fd, depth);
+	return true;
+}
+
+static void
+statFromStatx(const struct statx & x, struct stat & s)
+{
+	std::memset(&s, 0, sizeof(s));
+	s.st_dev = makedev(x.stx_dev_major, x.stx_dev_minor);
+	s.st_ino = x.stx_ino;
+	s.st_mode = x.stx_mode;
+	s.st_nlink = x.stx_nlink;
+	s.st_uid = x.stx_uid;
+	s.st_gid = x.stx_gid;
+	s.st_rdev = makedev(x.stx_rdev_major, x.stx_rdev_minor);
+	s.st_size = x.stx_size;
+	s.st_blksize = x.stx_blksize;
+	s.st_blocks = x.stx_blocks;
+	s.st_atim.tv_sec = x.stx_atime.tv_sec;
+	s.st_atim.tv_nsec = x.stx_atime.tv_nsec;
+	s.st_mtim.tv_sec = x.stx_mtime.tv_sec;
+	s.st_mtim.tv_nsec = x.stx_mtime.tv_nsec;
+	s.st_ctim.tv_sec = x.stx_ctime.tv_sec;
+	s.st_ctim.tv_nsec = x.stx_ctime.tv_nsec;
+}
+
+void
+TreeWalker::statAll(int fd, size_t depth)
+{
+	Level & level = levels[depth];
+	const size_t count = level.items.size();
+	level.stats.resize(count);
+	level.found.assign(count, 0);
+
+	size_t first = 0;
+	if (ring)
+	{
+		const size_t step = ring->depth();
+		if (statxBuffer.size() < step)
+		{
+			statxBuffer.resize(step);
+		}
+
+		for (; first < count; first += step)
+		{
+			size_t last = first + step < count ? first + step : count;
+			for (size_t i = first; i < last; ++i)
+			{
+				ring->statx(fd, level.names.data() + level.items[i].nameOffset, AT_SYMLINK_NOFOLLOW,
+					STATX_BASIC_STATS, &statxBuffer[i - first], i);
+			}
+
+			bool completed = ring->complete([&](uint64_t i, int32_t result) {
+				if (result == 0)
+				{
+					statFromStatx(statxBuffer[i - first], level.stats[i]);
+					level.found[i] = 1;
+				}
+				else if (result != -ENOENT)
+				{
+					/* old kernel without statx in the ring, ask synchronously */
+					level.found[i] = !fstatat(fd, level.names.data() + level.items[i].nameOffset,
+						&level.stats[i], AT_SYMLINK_NOFOLLOW);
+				}
+			});
+
+			if (!completed)
+			{
+				/* ring broke, this step and the rest go synchronously */
+				ring = nullptr;
+				break;
+			}
+		}
+	}
+
+	for (size_t i = first; i < count; ++i)
+	{
+		level.found[i] = !fstatat(fd, level.names.data() + level.items[i].nameOffset,
+			&level.stats[i], AT_SYMLINK_NOFOLLOW);
+	}
+}
+
+bool
+TreeWalker::walkDirectory(int fd, const struct stat & s, const char * leaf, int parentFd, size_t depth)
+{
+	/* list before the directory is visited, so a failure stops before its header */
+	if (!list(fd, depth))
+	{
+		return false;
+	}
+
+	children.clear();
+	for (size_t i = 0; i < levels[depth].items.size(); ++i)
+	{
+		if (levels[depth].found[i])
+		{
+			children.push_back({ levels[depth].names.data() + levels[depth].items[i].nameOffset,
+				&levels[depth].stats[i] });
+		}
+	}
+
+	WalkEntry entry;
+	entry.name = member;
+	entry.dirFd = parentFd;
+	entry.leaf = leaf;
+	entry.s = s;
+	entry.children = &children;
+	if (!visit(entry))
+	{
+		return false;
+	}
+	entry.children = nullptr;
+
+	const size_t memberLength = member.length();
+	for (size_t i = 0; i < levels[depth].items.size(); ++i)
+	{
+		/* levels may grow in the recursion, take the names again every time */
+		const char * child = levels[depth].names.data() + levels[depth].items[i].nameOffset;
+
+		member.resize(memberLength);
+		member += '/';
+		member += child;
+
+		if (!levels[depth].found[i])
+		{
+			printf("File %s not found.\n", member.c_str());
+			continue;
+		}
+		entry.s = levels[depth].stats[i];
+
+		if (S_ISDIR(entry.s.st_mode))
+		{
+			int childFd = openat(fd, child, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+			if (childFd == -1)
+			{
+				return false;
+			}
+
+			bool walked = walkDirectory(childFd, entry.s, child, fd, depth + 1);
+			close(childFd);
+			if (!walked)
+			{
+				return false;
+			}
+			continue;
+		}
+
+		entry.name = member;
+		entry.dirFd = fd;
+		entry.leaf = child;
+		if (!visit(entry))
+		{
+			return false;
+		}
+	}
+
+	member.resize(memberLength);
+	return !leave || leave();
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <functional>
+
+#include "../TarCommon.h"
+#include "../Uring/UringQueue.h"
+
+/* bytes of directory entries asked from the kernel at once */
+#define WALK_BATCH_SIZE (128 * 1024)
+
+enum class WalkOrder
+{
+	NAME = 0,	/* bytewise by name, same member order on any machine */
+	INODE		/* by inode number, fewer seeks on spinning disks; same order for the same filesystem */
+};
+
+/* entry of a directory, stat-ed before the directory is visited */
+struct WalkChild
+{
+	const char * leaf;
+	const struct stat * s;
+};
+
+/* one entry, valid only inside the visit call */
+struct WalkEntry
+{
+	std::string_view name;		/* member name: root name and path below it */
+	int dirFd;					/* directory holding the entry */
+	const char * leaf;			/* entry relative to dirFd, for openat/readlinkat */
+	struct stat s;
+	const std::vector<WalkChild> * children = nullptr;	/* directory: entries found in it, in walk order */
+};
+
+/*
+	Depth first walk relative to directory descriptors: every directory is
+	opened with openat from its parent, listed with getdents64 in large batches
+	and its entries are stat-ed with fstatat, so no path is resolved from the root.
+	A directory is fully listed and its entries stat-ed before it is visited,
+	its visit sees them as children.
+	Listing buffers are kept per depth and reused, the walk allocates only
+	while it meets a deeper or bigger directory than before.
+	With a ring all entries of a directory are stat-ed by batched statx right
+	after listing, instead of one fstatat per entry.
+*/
+class TreeWalker
+{
+private:
+	struct Item
+	{
+		ino_t ino;
+		size_t nameOffset;
+	};
+
+	struct Level
+	{
+		std::vector<Item> items;
+		std::vector<char> names;
+		std::vector<struct stat> stats;		/* by item */
+		std::vector<char> found;
+	};
+
+	WalkOrder order;
+	std::vector<Level> levels;
+	std::vector<char> batch;
+	UringQueue * ring;
+	std::vector<struct statx> statxBuffer;
+	std::vector<WalkChild> children;	/* of the directory being visited */
+	std::string member;
+	std::function<bool(const WalkEntry &)> visit;
+	std::function<bool()> leave;
+
+	/* list directory open as fd into levels[depth] */
+	bool list(int fd, size_t depth);
+
+	/* stats and found of levels[depth], through the ring if there is one */
+	void statAll(int fd, size_t depth);
+
+	/* member holds the directory name; false stops the walk */
+	bool walkDirectory(int fd, const struct stat & s, const char * leaf, int parentFd, size_t depth);
+
+public:
+	/* ring is optional, the walk does not own it */
+	TreeWalker(WalkOrder order = WalkOrder::NAME, UringQueue * ring = nullptr);
+
+	/* walk basePath + name, entries are named from name on */
+	/* false if basePath + name is missing, visit stopped the walk or a directory could not be listed */
+	/* entries which vanish before they are stat-ed are reported and skipped */
+	/* leave, if given, is called after the children of a directory while its descriptor is still open */
+	bool walk(const std::string & basePath, const std::string & name,
+		const std::function<bool(const WalkEntry &)> & visit,
+		const std::function<bool()> & leave = nullptr);
+};
@@ -1,10 +1,290 @@
+#include <climits>
+#include <stdexcept>
+
 #include "Packer/TarPacker.h"
 #include "Unpacker/TarUnpacker.h"
 
+/* whole text is a number in [min, max]; stol alone takes "4k" as 4 and throws on "k" */
+static bool
+parseNumber(const char * text, long min, long max, long & value)
+{
+	try
+	{
+		size_t used = 0;
+		value = std::stol(text, &used);
+		return text[used] == '\0' && value >= min && value <= max;
+	}
+	catch (const std::logic_error &)
+	{
+		/* std::invalid_argument or std::out_of_range */
+		return false;
+	}
+}
 
-int main()
+/* -o: archive into a file or stdout; messages go to stderr then, they would mix into it */
+static bool
+packToOutput(TarPacker & packer, const std::string & path, const std::string & output)
 {
+	if (output != "-")
+	{
+		FileSink file(output);
+		return file.isOpen() && packer.packTo(file, path);
+	}
+
+	int fd = dup(STDOUT_FILENO);
+	if (fd == -1 || dup2(STDERR_FILENO, STDOUT_FILENO) == -1)
+	{
+		return false;
+	}
+
+	bool packed;
+	{
+		FdSink out(fd);
+		packed = packer.packTo(out, path);
+	}
+	close(fd);
+	return packed;
+}
+
+static void
+usage(const char * program)
+{
+	printf("usage: %s -c|-r|-u <path> | -x <archive> | -t <archive> [options]\n"
+		"  -c <path>            pack path into <name>.tar in current directory\n"
+		"  -r <path>            append path to existing <name>.tar, rewriting only its end\n"
+		"  -u <path>            append only entries newer than their copy in <name>.tar\n"
+		"  -x <archive>         extract next to archive, repeat -x to extract several in order\n"
+		"                       - reads stdin and extracts into the current directory\n"
+		"  -t <archive>         list members\n"
+		"  -o <file>            write archive of -c to file, - for stdout, as it is made\n"
+		"  --include <glob>     take only matching members (-x, -t)\n"
+		"  --exclude <glob>     skip matching members (-x, -t)\n"
+		"  --member <name>      extract one member using <archive>.idx (-x)\n"
+		"  --index              write <archive>.idx sidecar (-c)\n"
+		"  --threads <n>        parallel read ahead (-c) or file creation (-x)\n"
+		"  --memory <MiB>       read ahead budget (-c)\n"
+		"  --chunk <KiB>        copy chunk size\n"
+		"  --zero-copy          copy content inside the kernel\n"
+		"  --reflink            clone payloads from the archive on btrfs/xfs, copy the rest (-x)\n"
+		"  --clone-align        start big payloads at 4 KiB in the archive for --reflink (-c)\n"
+		"  --mmap               read archive through a mapping (-x)\n"
+		"  --gzip|zstd|lz4      compress archive, detected on -x (-c)\n"
+		"  --level <n>          compression level (-c)\n"
+		"  --owner-cache <file> keep uid/gid names between runs (-c)\n"
+		"  --uring              batch stat/open/read/write of small files with io_uring\n"
+		"  --inode-order        members of a directory by inode, not by name (-c)\n"
+		"  --snapshot <file>    incremental: pack only what changed since the snapshot (-c)\n"
+		"  --incremental        replay incremental archives, deleted entries are removed (-x)\n"
+		"  --dedup <store>      chunks in store, archive is a manifest <name>.tar.dedup (-c, -x)\n"
+		"  --rehydrate          write manifest back as plain <name>.tar (-x)\n"
+		"  --hard-dereference   pack every name of a hard linked file with its data (-c)\n"
+		"  -S, --sparse         pack holes of sparse files as a map, data only (-c)\n"
+		"  --precise-mtime      keep nanoseconds of mtimes in pax headers (-c)\n"
+		"  --seekable           compressed pieces per member group, frame table in .idx (-c)\n",
+		program);
+}
+
+int main(int argc, char ** argv)
+{
+	char mode = 0;
+	std::string target;
+	std::vector<std::string> archives;	/* -x, in order */
+	std::string member;
+	std::string output;
 	TarPacker packer;
-	packer.pack("/home/osboxes/projects/TarArchiveLinux/bin/x64/Debug/fff");
+	TarUnpacker unpacker;
+	Compression compression = Compression::NONE;
+	int level = COMPRESS_DEFAULT_LEVEL;
+	bool rehydrate = false;
+	long number = 0;
+
+	/* a value which is no number falls through to usage, like an unknown option */
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string arg = argv[i];
+		const bool hasValue = i + 1 < argc;
+
+		if ((arg == "-c" || arg == "-x" || arg == "-t") && hasValue)
+		{
+			mode = arg[1];
+			target = argv[++i];
+			if (mode == 'x')
+			{
+				archives.push_back(target);
+			}
+		}
+		else if ((arg == "-r" || arg == "-u") && hasValue)
+		{
+			mode = 'c';
+			target = argv[++i];
+			packer.setMode(arg == "-r" ? PackMode::APPEND : PackMode::UPDATE);
+		}
+		else if (arg == "-o" && hasValue)
+		{
+			output = argv[++i];
+		}
+		else if (arg == "--include" && hasValue)
+		{
+			unpacker.addInclude(argv[++i]);
+		}
+		else if (arg == "--exclude" && hasValue)
+		{
+			unpacker.addExclude(argv[++i]);
+		}
+		else if (arg == "--member" && hasValue)
+		{
+			member = argv[++i];
+		}
+		else if (arg == "--index")
+		{
+			packer.setIndex(true);
+		}
+		else if (arg == "--threads" && hasValue && parseNumber(argv[++i], 0, LONG_MAX, number))
+		{
+			packer.setThreadCount(number);
+			unpacker.setThreadCount(number);
+		}
+		else if (arg == "--memory" && hasValue && parseNumber(argv[++i], 0, LONG_MAX >> 20, number))
+		{
+			packer.setMemoryBudget((size_t)number * 1024 * 1024);
+		}
+		else if (arg == "--chunk" && hasValue && parseNumber(argv[++i], 0, LONG_MAX >> 10, number))
+		{
+			size_t size = (size_t)number * 1024;
+			packer.setChunkSize(size);
+			unpacker.setChunkSize(size);
+		}
+		else if (arg == "--zero-copy")
+		{
+			packer.setZeroCopy(true);
+			unpacker.setZeroCopy(true);
+		}
+		else if (arg == "--reflink")
+		{
+			unpacker.setReflink(true);
+		}
+		else if (arg == "--clone-align")
+		{
+			packer.setAlignPayloads(true);
+		}
+		else if (arg == "--mmap")
+		{
+			unpacker.setMapped(true);
+		}
+		else if (arg == "--gzip" || arg == "-z")
+		{
+			compression = Compression::GZIP;
+		}
+		else if (arg == "--zstd")
+		{
+			compression = Compression::ZSTD;
+		}
+		else if (arg == "--lz4")
+		{
+			compression = Compression::LZ4;
+		}
+		else if (arg == "--owner-cache" && hasValue)
+		{
+			packer.setOwnerCache(argv[++i]);
+		}
+		else if (arg == "--uring")
+		{
+			packer.setUring(true);
+			unpacker.setUring(true);
+		}
+		else if (arg == "--inode-order")
+		{
+			packer.setWalkOrder(WalkOrder::INODE);
+		}
+		else if (arg == "--snapshot" && hasValue)
+		{
+			packer.setSnapshot(argv[++i]);
+		}
+		else if (arg == "--incremental")
+		{
+			unpacker.setIncremental(true);
+		}
+		else if (arg == "--dedup" && hasValue)
+		{
+			const std::string store = argv[++i];
+			packer.setDedup(store);
+			unpacker.setDedup(store);
+		}
+		else if (arg == "--rehydrate")
+		{
+			rehydrate = true;
+		}
+		else if (arg == "--hard-dereference")
+		{
+			packer.setHardLinks(false);
+		}
+		else if (arg == "--sparse" || arg == "-S")
+		{
+			packer.setSparse(true);
+		}
+		else if (arg == "--precise-mtime")
+		{
+			packer.setPreciseTimes(true);
+		}
+		else if (arg == "--seekable")
+		{
+			packer.setSeekable(true);
+		}
+		else if (arg == "--level" && hasValue && parseNumber(argv[++i], INT_MIN, INT_MAX, number))
+		{
+			level = number;
+		}
+		else
+		{
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (!packer.setCompression(compression, level))
+	{
+		printf("Compression is not built in.\n");
+		return 1;
+	}
+
+	switch (mode)
+	{
+	case 'c':
+		if (!output.empty())
+		{
+			return packToOutput(packer, target, output) ? 0 : 1;
+		}
+		return packer.pack(target) ? 0 : 1;
+	case 'x':
+		if (!member.empty())
+		{
+			return unpacker.extractMember(target, member) ? 0 : 1;
+		}
+		if (rehydrate)
+		{
+			bool rehydrated = true;
+			for (const std::string & archive : archives)
+			{
+				rehydrated = unpacker.rehydrate(archive) && rehydrated;
+			}
+			return rehydrated ? 0 : 1;
+		}
+		/* a full dump and its incrementals are replayed oldest first, a broken one stops the replay */
+		for (const std::string & archive : archives)
+		{
+			if (!unpacker.unpack(archive))
+			{
+				printf("Extraction of %s stopped.\n", archive.c_str());
+				return 1;
+			}
+		}
+		break;
+	case 't':
+		return unpacker.list(target) ? 0 : 1;
+	default:
+		usage(argv[0]);
+		return 1;
+	}
+
 	return 0;
-}
\ No newline at end of file
+}
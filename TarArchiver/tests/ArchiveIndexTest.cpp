@@ -0,0 +1,183 @@
+#include "Check.h"
+#include "Builder/ArchiveBuilder.h"
+#include "Index/ArchiveIndex.h"
+
+/*
+	Index lookup: offsets the packer gives, names the unpacker gives (ustar
+	prefix, leading '/'), sidecar tied to its archive. A sidecar left by an
+	older archive at the same path must never extract a wrong member.
+
+	ArchiveIndexTest <work directory>
+*/
+
+static void
+checkLookup()
+{
+	ArchiveIndex index;
+	index.add("dir/", DIRTYPE, 0, 1);
+	index.add("dir/file", REGTYPE, 700, 2);
+	index.addExtended(100);
+	index.add("dir/long", REGTYPE, 1, 3);
+
+	const IndexEntry * dir = index.find("dir");
+	CHECK(dir && dir == index.find("dir/") && dir->offset == 0 && dir->typeflag == DIRTYPE);
+
+	const IndexEntry * file = index.find("dir/file");
+	CHECK(file && file->offset == BLOCK_SIZE && file->size == 700 && file->mtime == 2);
+	CHECK(!index.find("dir/file/"));
+	CHECK(!index.find("dir/fil"));
+	CHECK(!index.find("file"));
+
+	/* indexed at its pax header */
+	const IndexEntry * longMember = index.find("dir/long");
+	CHECK(longMember && longMember->offset == 4 * BLOCK_SIZE && longMember->extended == 2 * BLOCK_SIZE);
+	CHECK(index.archiveSize() == 10 * BLOCK_SIZE);
+}
+
+/* builder archive with a member named by ustar prefix, as other tars write it */
+static std::string
+prefixArchive()
+{
+	ArchiveBuilder builder;
+	builder.addDirectory("top");
+	builder.addFile("leaf", "prefixed\n", 9);
+	builder.addFile(std::string(150, 'n'), "long\n", 5);
+	builder.finish();
+	std::string archive = builder.take();
+
+	PosixHeader & header = *(PosixHeader *)(archive.data() + BLOCK_SIZE);
+	memcpy(header.prefix, "/top/sub", 8);
+	memcpy(header.magic, PAXMAGIC, sizeof(header.magic));
+	memcpy(header.version, PAXVERSION, sizeof(header.version));
+	HeaderCodec::toOctal(HeaderCodec::checksum(header), header.chksum, 7);
+	header.chksum[7] = ' ';
+	return archive;
+}
+
+static void
+checkBuild()
+{
+	const std::string archive = prefixArchive();
+	ArchiveReader reader;
+	CHECK(reader.open(archive.data(), archive.size()));
+
+	ArchiveIndex index;
+	CHECK(index.build(reader));
+	CHECK(index.size() == 3);
+	CHECK(index.find("top"));
+
+	const IndexEntry * prefixed = index.find("top/sub/leaf");
+	CHECK(prefixed && prefixed->offset == BLOCK_SIZE && prefixed->size == 9);
+	CHECK(!index.find("leaf"));
+	CHECK(!index.find("/top/sub/leaf"));
+
+	const IndexEntry * longMember = index.find(std::string(150, 'n'));
+	CHECK(longMember && longMember->offset == 3 * BLOCK_SIZE && longMember->extended == 2 * BLOCK_SIZE);
+
+	/* and the unpacker extracts it under that name */
+	CHECK(checkWrite("prefix.tar", archive));
+	TarUnpacker unpacker;
+	CHECK(unpacker.extractMember("prefix.tar", "top/sub/leaf"));
+	CHECK(checkRead("top/sub/leaf") == "prefixed\n");
+}
+
+static void
+checkIdentity()
+{
+	CHECK(checkWrite("identity.tar", "archive"));
+	struct stat archive;
+	CHECK(stat("identity.tar", &archive) == 0);
+
+	ArchiveIndex index;
+	index.add("member", REGTYPE, 1, 1);
+	CHECK(index.save("identity.tar.idx", archive));
+
+	ArchiveIndex loaded;
+	CHECK(loaded.load("identity.tar.idx", archive));
+	CHECK(loaded.find("member"));
+
+	struct stat other = archive;
+	other.st_mtim.tv_nsec ^= 1;
+	CHECK(!loaded.load("identity.tar.idx", other));
+	other = archive;
+	other.st_ino += 1;
+	CHECK(!loaded.load("identity.tar.idx", other));
+	other = archive;
+	other.st_size += 1;
+	CHECK(!loaded.load("identity.tar.idx", other));
+}
+
+/* archive repacked at the same path without --index, from a tree where b became c */
+static void
+checkStaleSidecar()
+{
+	CHECK(mkdir("tree", 0755) == 0);
+	CHECK(checkWrite("tree/a", "first\n"));
+	CHECK(checkWrite("tree/b", "second\n"));
+
+	TarPacker indexed;
+	indexed.setIndex(true);
+	CHECK(indexed.pack("tree"));
+	const std::string oldSidecar = checkRead("tree.tar.idx");
+	CHECK(!oldSidecar.empty());
+
+	CHECK(unlink("tree/b") == 0);
+	CHECK(checkWrite("tree/c", "changed\n"));
+	TarPacker plain;
+	CHECK(plain.pack("tree"));
+
+	CHECK(mkdir("out", 0755) == 0);
+	CHECK(rename("tree.tar", "out/tree.tar") == 0);
+
+	/* sidecar is gone with the archive it was made for, member is looked up anew */
+	CHECK(access("tree.tar.idx", F_OK) != 0);
+	TarUnpacker unpacker;
+	CHECK(!unpacker.extractMember("out/tree.tar", "tree/b"));
+	CHECK(unpacker.extractMember("out/tree.tar", "tree/c"));
+	CHECK(checkRead("out/tree/c") == "changed\n");
+	CHECK(access("out/tree/b", F_OK) != 0);
+
+	/* old sidecar copied back: another archive, rebuilt */
+	CHECK(checkWrite("out/tree.tar.idx", oldSidecar));
+	CHECK(!unpacker.extractMember("out/tree.tar", "tree/b"));
+	CHECK(access("out/tree/b", F_OK) != 0);
+	CHECK(unpacker.extractMember("out/tree.tar", "tree/a"));
+	CHECK(checkRead("out/tree/a") == "first\n");
+
+	/* old sidecar forged to match size, mtime and inode: member name is checked */
+	struct stat current;
+	CHECK(stat("out/tree.tar", &current) == 0);
+	std::string forged = oldSidecar;
+	const uint64_t identity[] = { (uint64_t)current.st_size, (uint64_t)current.st_mtim.tv_sec,
+		(uint64_t)current.st_mtim.tv_nsec, (uint64_t)current.st_ino };
+	for (size_t i = 0; i < 4; ++i)
+	{
+		for (size_t byte = 0; byte < 8; ++byte)
+		{
+			forged[INDEX_MAGLEN + 8 * i + byte] = (char)(identity[i] >> (8 * byte));
+		}
+	}
+	CHECK(checkWrite("out/tree.tar.idx", forged));
+	ArchiveIndex index;
+	CHECK(index.load("out/tree.tar.idx", current));
+	CHECK(index.find("tree/b"));
+	CHECK(!unpacker.extractMember("out/tree.tar", "tree/b"));
+	CHECK(access("out/tree/b", F_OK) != 0);
+	CHECK(checkRead("out/tree/c") == "changed\n");
+}
+
+int
+main(int argc, char ** argv)
+{
+	if (argc != 2 || !checkWorkDir(argv[1]))
+	{
+		return 1;
+	}
+
+	checkLookup();
+	checkBuild();
+	checkIdentity();
+	checkStaleSidecar();
+
+	return checkResult("ArchiveIndexTest");
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdio>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Unpacker/TarUnpacker.h"
+
+/*
+	Checks of the behaviour tests: a failed one is printed with its line and
+	counted, the test goes on and its exit status is the count of failures.
+*/
+inline int checkFailures = 0;
+
+#define CHECK(condition) \
+	do \
+	{ \
+		if (!(condition)) \
+		{ \
+			printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+			++checkFailures; \
+		} \
+	} while (0)
+
+inline int
+checkResult(const char * test)
+{
+	if (checkFailures)
+	{
+		printf("%s: %d checks failed\n", test, checkFailures);
+	}
+	return checkFailures ? 1 : 0;
+}
+
+/* empty work directory at path, made the current directory */
+inline bool
+checkWorkDir(const std::string & path)
+{
+	TarUnpacker::removePath(path);
+	if (mkdir(path.c_str(), 0755) || chdir(path.c_str()))
+	{
+		printf("Can't create %s.\n", path.c_str());
+		return false;
+	}
+	return true;
+}
+
+inline std::string
+checkRead(const std::string & path)
+{
+	std::ifstream input(path, std::ios::binary);
+	return std::string(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+}
+
+inline bool
+checkWrite(const std::string & path, std::string_view content)
+{
+	std::ofstream output(path, std::ios::binary | std::ios::trunc);
+	output.write(content.data(), content.length());
+	return output.good();
+}
@@ -0,0 +1,203 @@
+#include <random>
+#include <sstream>
+
+#include "Check.h"
+#include "Dedup/DedupStreamBuf.h"
+
+/*
+	FastCDC cuts stay within their bounds and depend only on content, so an
+	insertion leaves the chunks after it alone; a stream deduplicated into a
+	store and a manifest is rehydrated byte for byte, a damaged chunk is caught.
+
+	DedupTest <work directory>
+*/
+
+static std::vector<size_t>
+cutAll(const std::string & data)
+{
+	std::vector<size_t> chunks;
+	const uint8_t * bytes = (const uint8_t *)data.data();
+	for (size_t pos = 0; pos < data.size();)
+	{
+		size_t length = Chunker::cut(bytes + pos, data.size() - pos);
+		chunks.push_back(length);
+		pos += length;
+	}
+	return chunks;
+}
+
+static std::vector<ChunkKey>
+keysOf(const std::string & data, const std::vector<size_t> & chunks)
+{
+	std::vector<ChunkKey> keys;
+	size_t pos = 0;
+	for (size_t length : chunks)
+	{
+		keys.push_back(Chunker::hash(data.data() + pos, length));
+		pos += length;
+	}
+	return keys;
+}
+
+static void
+checkCuts(const std::string & data)
+{
+	const std::vector<size_t> chunks = cutAll(data);
+	CHECK(chunks.size() > 1);
+	for (size_t i = 0; i + 1 < chunks.size(); ++i)
+	{
+		CHECK(chunks[i] > DEDUP_MIN_CHUNK && chunks[i] <= DEDUP_MAX_CHUNK);
+	}
+	CHECK(chunks.back() <= DEDUP_MAX_CHUNK);
+
+	/* normalized chunking keeps sizes near the average */
+	const size_t average = data.size() / chunks.size();
+	CHECK(average > DEDUP_AVG_CHUNK / 2 && average < DEDUP_AVG_CHUNK * 2);
+
+	CHECK(cutAll(data) == chunks);
+
+	/* content without cut points is cut at the biggest size */
+	const std::string zeros(4 * DEDUP_MAX_CHUNK + 100, '\0');
+	const std::vector<size_t> flat = cutAll(zeros);
+	CHECK(flat.size() == 5);
+	CHECK(flat[0] == DEDUP_MAX_CHUNK && flat.back() == 100);
+
+	/* short tails are one chunk */
+	CHECK(Chunker::cut((const uint8_t *)data.data(), DEDUP_MIN_CHUNK) == DEDUP_MIN_CHUNK);
+	CHECK(Chunker::cut((const uint8_t *)data.data(), 1) == 1);
+}
+
+static void
+checkInsertion(const std::string & data)
+{
+	const std::vector<size_t> chunks = cutAll(data);
+	const std::vector<ChunkKey> keys = keysOf(data, chunks);
+
+	std::string edited = data;
+	edited.insert(data.size() / 2, "inserted bytes");
+	const std::vector<ChunkKey> editedKeys = keysOf(edited, cutAll(edited));
+
+	std::unordered_map<ChunkKey, int, ChunkKeyHash> known;
+	for (const ChunkKey & key : keys)
+	{
+		known[key]++;
+	}
+	size_t shared = 0;
+	for (const ChunkKey & key : editedKeys)
+	{
+		shared += known.count(key);
+	}
+
+	/* chunks before the insertion are the same, after it they are found again at once */
+	size_t end = 0;
+	for (size_t i = 0; i < keys.size() && i < editedKeys.size(); ++i)
+	{
+		end += chunks[i];
+		if (end >= data.size() / 2)
+		{
+			break;
+		}
+		CHECK(keys[i] == editedKeys[i]);
+	}
+	CHECK(shared + 3 >= keys.size());
+}
+
+/* manifest of data written through DedupStreamBuf */
+static bool
+deduplicate(ChunkStore & store, const std::string & data, size_t boundary, std::string & manifest,
+	size_t & newChunks)
+{
+	std::ostringstream output;
+	DedupStreamBuf dedup(output, store);
+	std::ostream target(&dedup);
+	target.write(data.data(), boundary);
+	dedup.markBoundary();
+	target.write(data.data() + boundary, data.size() - boundary);
+	bool finished = dedup.finish();
+
+	manifest = output.str();
+	newChunks = dedup.storedChunks();
+	return finished && dedup.totalBytes() == data.size();
+}
+
+static std::string
+rehydrate(ChunkStore & store, const std::string & manifest, bool & complete)
+{
+	std::istringstream input(manifest);
+	RehydrateStreamBuf rehydrated(input, store);
+	std::istream source(&rehydrated);
+	std::string data((std::istreambuf_iterator<char>(source)), std::istreambuf_iterator<char>());
+	complete = rehydrated.complete();
+	return data;
+}
+
+static void
+checkRoundTrip(const std::string & data)
+{
+	/* the same content twice, the second copy from a boundary like a file after its header */
+	const std::string twice = data + std::string("header") + data;
+	std::string manifest;
+	size_t newChunks = 0;
+
+	{
+		ChunkStore store;
+		CHECK(store.open("store", true));
+		CHECK(deduplicate(store, twice, data.size() + 6, manifest, newChunks));
+		CHECK(newChunks > 0 && newChunks <= cutAll(data).size() + 1);
+		CHECK(manifest.size() < data.size() / 10);
+
+		/* nothing new the next time */
+		std::string again;
+		CHECK(deduplicate(store, twice, data.size() + 6, again, newChunks));
+		CHECK(newChunks == 0 && again == manifest);
+		CHECK(store.close());
+	}
+
+	{
+		ChunkStore store;
+		CHECK(store.open("store", false));
+		bool complete = false;
+		CHECK(rehydrate(store, manifest, complete) == twice);
+		CHECK(complete);
+
+		/* manifest cut short is not complete */
+		rehydrate(store, manifest.substr(0, manifest.size() - 3), complete);
+		CHECK(!complete);
+		store.close();
+	}
+
+	/* damaged chunk does not match its key */
+	std::string chunks = checkRead("store/" DEDUP_STORE_DATA);
+	CHECK(chunks.size() > 100);
+	chunks[chunks.size() / 2] ^= 0x55;
+	CHECK(checkWrite("store/" DEDUP_STORE_DATA, chunks));
+	{
+		ChunkStore store;
+		CHECK(store.open("store", false));
+		bool complete = true;
+		CHECK(rehydrate(store, manifest, complete) != twice);
+		CHECK(!complete);
+	}
+}
+
+int
+main(int argc, char ** argv)
+{
+	if (argc != 2 || !checkWorkDir(argv[1]))
+	{
+		return 1;
+	}
+
+	std::mt19937_64 random(7);
+	std::string data(4 << 20, '\0');
+	for (char & byte : data)
+	{
+		byte = (char)random();
+	}
+
+	checkCuts(data);
+	checkInsertion(data);
+	checkRoundTrip(data);
+
+	return checkResult("DedupTest");
+}
@@ -0,0 +1,199 @@
+#include <sstream>
+
+#include "Check.h"
+#include "Packer/TarPacker.h"
+#include "Copy/CopyEngine.h"
+
+/*
+	Archives which try to write or remove outside of the directory they are
+	extracted in: ".." in names, a symlink member followed by members below it,
+	hard links out of the tree, incremental removal through a symlink.
+	Every mode has to refuse them and leave victim/ alone.
+
+	EscapeTest <work directory>
+*/
+
+enum class Mode
+{
+	SERIAL = 0,
+	THREADS,
+	MAPPED
+};
+
+static const char * modeNames[] = { "serial", "threads", "mapped" };
+
+/* member header through TarPacker and its payload */
+static void
+addMember(std::string & archive, std::string_view name, int8_t typeflag,
+	std::string_view linkname = std::string_view(), std::string_view payload = std::string_view())
+{
+	struct stat s = {};
+	s.st_mode = typeflag == DIRTYPE || typeflag == GNUTYPE_DUMPDIR ? S_IFDIR | 0755 :
+		typeflag == SYMTYPE ? S_IFLNK | 0777 : S_IFREG | 0644;
+	s.st_mtim.tv_sec = 1700000000;
+
+	TarPacker packer;
+	HeaderInfo headerInfo;
+	packer.createHeader(headerInfo, name, typeflag, s, linkname);
+	headerInfo.size = payload.length();
+	packer.convertHeader(headerInfo);
+
+	std::ostringstream output;
+	packer.writeHeader(output, headerInfo);
+	output.write(payload.data(), payload.length());
+	CopyEngine::writePadding(output, payload.length());
+	archive += output.str();
+}
+
+static std::string
+finish(std::string archive)
+{
+	archive.append(2 * BLOCK_SIZE, '\0');
+	return archive;
+}
+
+/* archive as <dir>/<name>.tar extracted by an unpacker in mode, its result */
+static bool
+unpackIn(const std::string & dir, const std::string & name, const std::string & archive, Mode mode,
+	bool incremental = false)
+{
+	const std::string path = dir + "/" + name + ".tar";
+	CHECK(checkWrite(path, archive));
+
+	TarUnpacker unpacker;
+	unpacker.setIncremental(incremental);
+	if (mode == Mode::THREADS)
+	{
+		unpacker.setThreadCount(4);
+	}
+	unpacker.setMapped(mode == Mode::MAPPED);
+	return unpacker.unpack(path);
+}
+
+static std::string victim;
+
+static bool
+victimIntact()
+{
+	struct stat s;
+	return checkRead(victim + "/file") == "orig\n" && lstat((victim + "/file").c_str(), &s) == 0 &&
+		s.st_nlink == 1 && access((victim + "/planted").c_str(), F_OK) != 0;
+}
+
+static void
+checkEscapes(Mode mode)
+{
+	const std::string out = std::string("out-") + modeNames[(int)mode];
+	CHECK(mkdir(out.c_str(), 0755) == 0);
+
+	/* symlink to outside, then a file below it */
+	std::string plant;
+	addMember(plant, "x/", DIRTYPE);
+	addMember(plant, "x/a", SYMTYPE, victim);
+	addMember(plant, "x/a/planted", REGTYPE, "", "owned\n");
+	CHECK(!unpackIn(out, "plant", finish(plant), mode));
+	CHECK(victimIntact());
+
+	/* relative symlink up the tree */
+	std::string relative;
+	addMember(relative, "y/", DIRTYPE);
+	addMember(relative, "y/up", SYMTYPE, "../../victim");
+	addMember(relative, "y/up/planted", REGTYPE, "", "owned\n");
+	CHECK(!unpackIn(out, "relative", finish(relative), mode));
+	CHECK(victimIntact());
+
+	std::string dots;
+	addMember(dots, "x/", DIRTYPE);
+	addMember(dots, "x/../../victim/planted", REGTYPE, "", "owned\n");
+	CHECK(!unpackIn(out, "dots", finish(dots), mode));
+	CHECK(victimIntact());
+
+	/* hard link to a file outside, then written through */
+	std::string hard;
+	addMember(hard, "x/", DIRTYPE);
+	addMember(hard, "x/h", LNKTYPE, "../victim/file");
+	CHECK(!unpackIn(out, "hard", finish(hard), mode));
+	CHECK(victimIntact());
+	CHECK(access((out + "/x/h").c_str(), F_OK) != 0);
+
+	/* leading '/' is dropped, the member lands inside */
+	std::string absolute;
+	addMember(absolute, "/abs/", DIRTYPE);
+	addMember(absolute, "/abs/f", REGTYPE, "", "inside\n");
+	addMember(absolute, "abs/h", LNKTYPE, "/abs/f");
+	CHECK(unpackIn(out, "absolute", finish(absolute), mode));
+	CHECK(checkRead(out + "/abs/f") == "inside\n");
+	CHECK(checkRead(out + "/abs/h") == "inside\n");
+	CHECK(victimIntact());
+}
+
+/* incremental extraction removes what a dumpdir does not list, never through a symlink */
+static void
+checkRemoval(Mode mode)
+{
+	const std::string out = std::string("incremental-") + modeNames[(int)mode];
+	CHECK(mkdir(out.c_str(), 0755) == 0);
+
+	/* d is a symlink to the victim: replaced by the directory, not emptied through */
+	CHECK(symlink(victim.c_str(), (out + "/d").c_str()) == 0);
+	/* e holds a symlink to the victim which the dumpdir does not list */
+	CHECK(mkdir((out + "/e").c_str(), 0755) == 0);
+	CHECK(symlink(victim.c_str(), (out + "/e/s").c_str()) == 0);
+	CHECK(checkWrite(out + "/e/old", "old\n"));
+
+	std::string archive;
+	addMember(archive, "d/", GNUTYPE_DUMPDIR, "", std::string_view("\0", 2));
+	addMember(archive, "e/", GNUTYPE_DUMPDIR, "", std::string_view("Ykeep\0\0", 7));
+	addMember(archive, "e/keep", REGTYPE, "", "kept\n");
+	unpackIn(out, "removal", finish(archive), mode, true);
+
+	struct stat s;
+	CHECK(lstat((out + "/d").c_str(), &s) == 0 && S_ISDIR(s.st_mode));
+	CHECK(lstat((out + "/e/s").c_str(), &s) != 0);
+	CHECK(lstat((out + "/e/old").c_str(), &s) != 0);
+	CHECK(checkRead(out + "/e/keep") == "kept\n");
+	CHECK(victimIntact());
+
+	/* a dumpdir reached through a symlink which was there before is not emptied either */
+	const std::string sub = victim + "/sub-" + modeNames[(int)mode];
+	CHECK(mkdir(sub.c_str(), 0755) == 0);
+	CHECK(checkWrite(sub + "/keep", "keep\n"));
+	CHECK(symlink(victim.c_str(), (out + "/f").c_str()) == 0);
+	std::string through;
+	addMember(through, std::string("f/sub-") + modeNames[(int)mode] + "/", GNUTYPE_DUMPDIR, "",
+		std::string_view("\0", 2));
+	CHECK(!unpackIn(out, "through", finish(through), mode, true));
+	CHECK(checkRead(sub + "/keep") == "keep\n");
+	CHECK(victimIntact());
+
+	std::string dots;
+	addMember(dots, "x/../../victim/", GNUTYPE_DUMPDIR, "", std::string_view("\0", 2));
+	CHECK(!unpackIn(out, "dots", finish(dots), mode, true));
+	CHECK(victimIntact());
+}
+
+int
+main(int argc, char ** argv)
+{
+	if (argc != 2 || !checkWorkDir(argv[1]))
+	{
+		return 1;
+	}
+
+	/* absolute, symlinks in the archive point at it */
+	char * cwd = getcwd(nullptr, 0);
+	victim = std::string(cwd) + "/victim";
+	free(cwd);
+
+	CHECK(mkdir(victim.c_str(), 0755) == 0);
+	CHECK(checkWrite(victim + "/file", "orig\n"));
+
+	for (Mode mode : { Mode::SERIAL, Mode::THREADS, Mode::MAPPED })
+	{
+		checkEscapes(mode);
+	}
+	checkRemoval(Mode::SERIAL);
+	checkRemoval(Mode::THREADS);
+
+	return checkResult("EscapeTest");
+}
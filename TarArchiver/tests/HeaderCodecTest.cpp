@@ -0,0 +1,182 @@
+#include <random>
+
+#include "Check.h"
+#include "Header/HeaderCodec.h"
+#include "Reader/ArchiveReader.h"
+
+/*
+	Numeric fields and checksum of HeaderCodec against plain loops:
+	octal parsed 8 digits at a time, base-256 and its limits, sum of the cpu
+	against sumScalar.
+*/
+
+/* digit by digit, as the codec parsed before it took words */
+static uint64_t
+slowOctal(const int8_t * field, size_t length)
+{
+	size_t i = 0;
+	while (i < length && field[i] == ' ')
+	{
+		++i;
+	}
+	uint64_t value = 0;
+	for (; i < length && field[i] >= '0' && field[i] <= '7'; ++i)
+	{
+		value = value * 8 + (field[i] - '0');
+	}
+	return value;
+}
+
+static void
+checkOctal(std::mt19937_64 & random)
+{
+	int8_t field[12];
+
+	/* every width the header has, values at and past its limit */
+	for (size_t length : { 8, 12 })
+	{
+		const uint64_t limit = (uint64_t)1 << (3 * (length - 1));
+		for (uint64_t value : { (uint64_t)0, (uint64_t)1, (uint64_t)07, (uint64_t)010, limit - 1 })
+		{
+			CHECK(HeaderCodec::toOctal(value, field, length));
+			CHECK(field[length - 1] == '\0');
+			CHECK(HeaderCodec::parseOctal(field, length) == value);
+		}
+		CHECK(!HeaderCodec::toOctal(limit, field, length));
+	}
+
+	/* random digits ended anywhere by NUL, space or other bytes, led by spaces */
+	const char enders[] = { '\0', ' ', '8', '9', 'x', '/' };
+	for (int round = 0; round < 20000; ++round)
+	{
+		const size_t length = round % 2 ? 12 : 8;
+		const size_t spaces = random() % 3;
+		const size_t digits = random() % (length + 1);
+		for (size_t i = 0; i < length; ++i)
+		{
+			if (i < spaces)
+			{
+				field[i] = ' ';
+			}
+			else if (i < spaces + digits)
+			{
+				field[i] = (int8_t)('0' + random() % 8);
+			}
+			else
+			{
+				field[i] = enders[random() % sizeof(enders)];
+			}
+		}
+		CHECK(HeaderCodec::parseOctal(field, length) == slowOctal(field, length));
+	}
+}
+
+static void
+checkBase256()
+{
+	int8_t field[12];
+
+	/* sizes from 8 GiB on and the biggest one int64_t holds */
+	for (uint64_t value : { (uint64_t)8 << 30, (uint64_t)10 << 30, (uint64_t)1 << 62, (uint64_t)INT64_MAX })
+	{
+		HeaderCodec::toBase256(value, field, sizeof(field));
+		CHECK((uint8_t)field[0] == 0x80);
+		CHECK(HeaderCodec::parseOctal(field, sizeof(field)) == value);
+	}
+
+	/* 8 byte field, as uid and gid from 2^21 on */
+	HeaderCodec::toBase256(0xfffffffful, field, 8);
+	CHECK(HeaderCodec::parseOctal(field, 8) == 0xfffffffful);
+
+	/* negative: sign bit in the first byte */
+	memset(field, 0xff, sizeof(field));
+	CHECK(HeaderCodec::parseOctal(field, sizeof(field)) == HEADER_NUMBER_BAD);
+
+	/* 64 bits and more have no room in int64_t */
+	memset(field, 0, sizeof(field));
+	field[0] = (int8_t)0x80;
+	field[4] = (int8_t)0x80;
+	CHECK(HeaderCodec::parseOctal(field, sizeof(field)) == HEADER_NUMBER_BAD);
+	field[4] = 0x7f;
+	CHECK(HeaderCodec::parseOctal(field, sizeof(field)) == ((uint64_t)0x7f << 56));
+	field[3] = 1;
+	CHECK(HeaderCodec::parseOctal(field, sizeof(field)) == HEADER_NUMBER_BAD);
+}
+
+static void
+checkSum(std::mt19937_64 & random)
+{
+	alignas(64) uint8_t block[BLOCK_SIZE + 1];
+
+	memset(block, 0, sizeof(block));
+	CHECK(HeaderCodec::sum(block) == 0);
+
+	/* every byte at its maximum, unsigned */
+	memset(block, 0xff, sizeof(block));
+	CHECK(HeaderCodec::sum(block) == 0xff * BLOCK_SIZE);
+	CHECK(HeaderCodec::sumScalar(block) == 0xff * BLOCK_SIZE);
+
+	/* random blocks, aligned and one byte off */
+	for (int round = 0; round < 2000; ++round)
+	{
+		for (uint8_t & byte : block)
+		{
+			byte = (uint8_t)random();
+		}
+		CHECK(HeaderCodec::sum(block) == HeaderCodec::sumScalar(block));
+		CHECK(HeaderCodec::sum(block + 1) == HeaderCodec::sumScalar(block + 1));
+	}
+
+	/* chksum field counts as spaces whatever it holds */
+	PosixHeader header;
+	memcpy(&header, block, BLOCK_SIZE);
+	const uint64_t expected = HeaderCodec::checksum(header);
+	memset(header.chksum, 0, sizeof(header.chksum));
+	CHECK(HeaderCodec::checksum(header) == expected);
+
+	/* 6 digits, NUL and space as tar writes it */
+	CHECK(HeaderCodec::toOctal(expected, header.chksum, 7));
+	header.chksum[7] = ' ';
+	CHECK(ArchiveReader::checkSum(header));
+	header.name[0] ^= 1;
+	CHECK(!ArchiveReader::checkSum(header));
+}
+
+static void
+checkPrefix()
+{
+	PosixHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.name, "leaf", 4);
+	memcpy(header.prefix, "/usr/share", 10);
+	memcpy(header.magic, PAXMAGIC, sizeof(PAXMAGIC));
+
+	HeaderInfo headerInfo;
+	HeaderCodec::decode(header, headerInfo);
+	std::string storage;
+	CHECK(HeaderCodec::joinPrefix(headerInfo, storage));
+	CHECK(headerInfo.name == "/usr/share/leaf");
+	CHECK(HeaderCodec::dropRoot(headerInfo.name));
+	CHECK(headerInfo.name == "usr/share/leaf");
+	CHECK(!HeaderCodec::dropRoot(headerInfo.name));
+
+	/* gnu magic: the field is not a prefix */
+	memcpy(header.magic, TMAGIC, TMAGLEN);
+	HeaderCodec::decode(header, headerInfo);
+	CHECK(!HeaderCodec::joinPrefix(headerInfo, storage));
+	CHECK(headerInfo.name == "leaf");
+}
+
+int
+main()
+{
+	std::mt19937_64 random(42);
+
+	checkOctal(random);
+	checkBase256();
+	checkSum(random);
+	checkPrefix();
+
+	printf("sum: %s\n", HeaderCodec::sumName());
+	return checkResult("HeaderCodecTest");
+}
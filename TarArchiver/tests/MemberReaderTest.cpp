@@ -0,0 +1,163 @@
+#include "Check.h"
+#include "Builder/ArchiveBuilder.h"
+#include "Reader/MemberReader.h"
+
+/*
+	Archive built in memory is read back member by member; damaged,
+	truncated and oversized ones stop the reader as bad instead of running
+	past the buffer.
+*/
+
+static std::string
+sampleArchive()
+{
+	ArchiveBuilder builder(64 * 1024);
+	CHECK(builder.addDirectory("dir"));
+	CHECK(builder.addFile("dir/one", "1", 1));
+	const std::string block(BLOCK_SIZE, 'b');
+	CHECK(builder.addFile("dir/block", block.data(), block.size(), { 0600 }));
+	CHECK(builder.addSymlink("dir/link", "one"));
+	CHECK(builder.finish());
+	CHECK(!builder.addFile("late", "", 0));
+	return builder.take();
+}
+
+static void
+checkMembers()
+{
+	const std::string archive = sampleArchive();
+	/* 4 headers, 2 payload blocks, 2 end blocks */
+	CHECK(archive.size() == 8 * BLOCK_SIZE);
+
+	ArchiveReader reader;
+	CHECK(reader.open(archive.data(), archive.size()));
+	CHECK(reader.complete());
+	MemberReader members(reader);
+
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		CHECK(members.next());
+		CHECK(members.current().info.name == "dir/");
+		CHECK(members.current().info.typeflag == DIRTYPE);
+		CHECK(members.current().info.mode == 0755);
+
+		CHECK(members.next());
+		CHECK(members.current().info.name == "dir/one");
+		CHECK(members.current().offset == BLOCK_SIZE);
+		CHECK(members.current().size == 1 && members.current().data[0] == '1');
+
+		CHECK(members.next());
+		CHECK(members.current().info.name == "dir/block");
+		CHECK(members.current().info.mode == 0600);
+		CHECK(members.current().size == BLOCK_SIZE);
+		CHECK(members.current().data == reader.data() + 4 * BLOCK_SIZE);
+
+		CHECK(members.next());
+		CHECK(members.current().info.typeflag == SYMTYPE);
+		CHECK(members.current().info.linkname == "one");
+
+		CHECK(!members.next());
+		CHECK(!members.bad());
+		members.rewind();
+	}
+}
+
+/* offset of the header of dir/block in sampleArchive */
+#define BLOCK_MEMBER (3 * BLOCK_SIZE)
+
+static bool
+readsBad(const std::string & archive)
+{
+	ArchiveReader reader;
+	if (!reader.open(archive.data(), archive.size()))
+	{
+		return true;
+	}
+	MemberReader members(reader);
+	size_t count = 0;
+	while (members.next() && count < 10)
+	{
+		++count;
+	}
+	return members.bad() && count < 10;
+}
+
+/* size field of dir/block as base-256 bytes, checksum kept right */
+static void
+setSize(std::string & archive, uint64_t size, bool negative = false)
+{
+	PosixHeader & header = *(PosixHeader *)(archive.data() + BLOCK_MEMBER);
+	HeaderCodec::toBase256(size, header.size, sizeof(header.size));
+	if (negative)
+	{
+		header.size[0] = (int8_t)0xff;
+	}
+	HeaderCodec::toOctal(HeaderCodec::checksum(header), header.chksum, 7);
+	header.chksum[7] = ' ';
+}
+
+static void
+checkDamage()
+{
+	const std::string archive = sampleArchive();
+
+	/* wrong checksum */
+	std::string damaged = archive;
+	damaged[BLOCK_MEMBER] ^= 1;
+	CHECK(readsBad(damaged));
+
+	/* cut inside a payload, and right after a header */
+	CHECK(readsBad(archive.substr(0, BLOCK_MEMBER + BLOCK_SIZE + 100)));
+	CHECK(readsBad(archive.substr(0, BLOCK_MEMBER + BLOCK_SIZE)));
+
+	/* no end blocks */
+	ArchiveReader reader;
+	const std::string open = archive.substr(0, archive.size() - 2 * BLOCK_SIZE);
+	CHECK(reader.open(open.data(), open.size()));
+	CHECK(!reader.complete());
+
+	/* sizes which would run past the buffer or wrap the offset around */
+	for (uint64_t size : { (uint64_t)5 * BLOCK_SIZE, (uint64_t)1 << 40,
+		(uint64_t)INT64_MAX - 100, (uint64_t)INT64_MAX })
+	{
+		std::string oversized = archive;
+		setSize(oversized, size);
+		CHECK(readsBad(oversized));
+	}
+
+	/* negative size */
+	std::string negative = archive;
+	setSize(negative, 1, true);
+	CHECK(readsBad(negative));
+}
+
+static void
+checkReuse()
+{
+	ArchiveBuilder builder;
+	CHECK(builder.addFile("first", "a", 1));
+	CHECK(builder.finish());
+	const std::string first = builder.take();
+
+	/* take leaves an empty builder which makes the next archive */
+	CHECK(builder.data().empty());
+	CHECK(builder.addFile("second", "b", 1));
+	CHECK(builder.finish());
+
+	ArchiveReader reader;
+	CHECK(reader.open(builder.data().data(), builder.data().size()));
+	MemberReader members(reader);
+	CHECK(members.next() && members.current().info.name == "second");
+	CHECK(!members.next() && !members.bad());
+	CHECK(first.size() == builder.data().size());
+}
+
+int
+main()
+{
+	checkMembers();
+	checkDamage();
+	checkReuse();
+
+	return checkResult("MemberReaderTest");
+}
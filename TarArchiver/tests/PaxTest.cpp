@@ -0,0 +1,201 @@
+#include <sstream>
+
+#include "Check.h"
+#include "Builder/ArchiveBuilder.h"
+#include "Reader/MemberReader.h"
+
+/*
+	What the header block can't hold goes through pax records and comes back:
+	long names and link targets, sizes from 8 GiB, big ids, times before 1970
+	and with nanoseconds.
+*/
+
+static void
+checkTimeValue()
+{
+	CHECK(PaxHeader::timeValue(5, 0) == "5");
+	CHECK(PaxHeader::timeValue(0, 1) == "0.000000001");
+	CHECK(PaxHeader::timeValue(1700000000, 500000000) == "1700000000.5");
+	CHECK(PaxHeader::timeValue(-1, 0) == "-1");
+	/* -0.5 is the second before 1970 and half of it */
+	CHECK(PaxHeader::timeValue(-1, 500000000) == "-0.5");
+	CHECK(PaxHeader::timeValue(-2, 250000000) == "-1.75");
+
+	/* and parsed back the same */
+	for (int64_t seconds : { (int64_t)-2, (int64_t)-1, (int64_t)0, (int64_t)1700000000 })
+	{
+		for (uint32_t nanoseconds : { 0u, 1u, 250000000u, 999999999u })
+		{
+			PaxHeader pax;
+			PaxHeader::addRecord(pax.data(), "mtime", PaxHeader::timeValue(seconds, nanoseconds));
+			CHECK(pax.parse());
+
+			HeaderInfo headerInfo;
+			CHECK(pax.apply(headerInfo));
+			CHECK(headerInfo.mtime == seconds);
+			CHECK(headerInfo.mtimeNsec == nanoseconds);
+		}
+	}
+}
+
+static void
+checkRecords()
+{
+	PaxHeader pax;
+
+	/* length counts its own digits: 99 bytes, then 100 would need 3 of them, so 101 */
+	const std::string path(90, 'a');
+	PaxHeader::addRecord(pax.data(), "path", path);
+	PaxHeader::addRecord(pax.data(), "linkpath", std::string(87, 'b'));
+	CHECK(pax.data().compare(0, 3, "99 ") == 0);
+	CHECK(pax.data().compare(99, 4, "101 ") == 0);
+	CHECK(pax.data().size() == 200);
+	CHECK(pax.parse());
+	CHECK(pax.name() == path);
+
+	/* length which does not end on the newline */
+	pax.data() = "12 path=ab\n";
+	CHECK(!pax.parse());
+	pax.data() = "11 path=ab\n";
+	CHECK(pax.parse());
+	CHECK(pax.name() == "ab");
+
+	/* global header keeps applying, its path does not */
+	PaxHeader global;
+	PaxHeader::addRecord(global.data(), "path", "ignored");
+	PaxHeader::addRecord(global.data(), "uname", "builder");
+	CHECK(global.parse(true));
+	for (int member = 0; member < 2; ++member)
+	{
+		HeaderInfo headerInfo;
+		headerInfo.name = "kept";
+		global.apply(headerInfo);
+		CHECK(headerInfo.name == "kept");
+		CHECK(headerInfo.uname == "builder");
+	}
+}
+
+/* members of a builder archive read back by MemberReader */
+static void
+checkRoundTrip(bool precise)
+{
+	std::string longName;
+	for (int i = 0; i < 12; ++i)
+	{
+		longName += "directory-" + std::to_string(i) + "/";
+	}
+	longName += std::string(120, 'f');
+	const std::string longTarget = "../" + std::string(150, 't');
+
+	ArchiveBuilder builder;
+	builder.setPreciseTimes(precise);
+
+	MemberAttributes fresh;
+	fresh.mtime = 1700000000;
+	fresh.mtimeNsec = 123456789;
+	fresh.uid = 3000000;		/* past 8 octal digits */
+	fresh.gid = 07777777;		/* last one which fits */
+	fresh.uname = "someone";
+	fresh.gname = "group";
+	CHECK(builder.addFile(longName, "content\n", 8, fresh));
+
+	MemberAttributes old;
+	old.mtime = -2;
+	old.mtimeNsec = 500000000;
+	CHECK(builder.addSymlink("link", longTarget, old));
+	CHECK(builder.addFile("short", "", 0));
+	CHECK(builder.finish());
+
+	ArchiveReader reader;
+	CHECK(reader.open(builder.data().data(), builder.data().size()));
+	MemberReader members(reader);
+
+	CHECK(members.next());
+	const ArchiveMember & file = members.current();
+	CHECK(file.info.name == longName);
+	CHECK(file.info.typeflag == REGTYPE);
+	CHECK(file.size == 8 && memcmp(file.data, "content\n", 8) == 0);
+	CHECK(file.info.mtime == 1700000000);
+	CHECK(file.info.mtimeNsec == (precise ? 123456789u : 0u));
+	CHECK(file.info.uid == 3000000);
+	CHECK(file.info.gid == 07777777);
+	CHECK(file.info.uname == "someone");
+	CHECK(file.info.gname == "group");
+
+	CHECK(members.next());
+	const ArchiveMember & link = members.current();
+	CHECK(link.info.name == "link");
+	CHECK(link.info.typeflag == SYMTYPE);
+	CHECK(link.info.linkname == longTarget);
+	/* a time before 1970 needs pax records even without precise times */
+	CHECK(link.info.mtime == -2);
+	CHECK(link.info.mtimeNsec == (precise ? 500000000u : 0u));
+
+	CHECK(members.next());
+	CHECK(members.current().info.name == "short");
+	CHECK(members.current().size == 0);
+
+	CHECK(!members.next());
+	CHECK(!members.bad());
+}
+
+/* header of a 10 GiB file, the payload itself is left out */
+static void
+checkBigSize()
+{
+	const uint64_t size = (uint64_t)10 << 30;
+	struct stat s = {};
+	s.st_mode = S_IFREG | 0644;
+	s.st_size = size;
+	s.st_mtim.tv_sec = 1700000000;
+
+	TarPacker packer;
+	HeaderInfo headerInfo;
+	packer.createHeader(headerInfo, "big", REGTYPE, s);
+	packer.convertHeader(headerInfo);
+	std::ostringstream output;
+	packer.writeHeader(output, headerInfo);
+	const std::string blocks = output.str();
+
+	/* pax header, its records, member header */
+	CHECK(blocks.size() >= 3 * BLOCK_SIZE && blocks.size() % BLOCK_SIZE == 0);
+	if (blocks.size() < 3 * BLOCK_SIZE)
+	{
+		return;
+	}
+	const PosixHeader * extended = (const PosixHeader *)blocks.data();
+	CHECK(extended->typeflag == XHDTYPE);
+	CHECK(ArchiveReader::checkSum(*extended));
+
+	HeaderInfo extendedInfo;
+	HeaderCodec::decode(*extended, extendedInfo);
+	PaxHeader pax;
+	pax.data().assign(blocks.data() + BLOCK_SIZE, extendedInfo.size);
+	CHECK(pax.parse());
+	CHECK(pax.data().find(" size=10737418240\n") != std::string::npos);
+
+	const PosixHeader * member = (const PosixHeader *)(blocks.data() + blocks.size() - BLOCK_SIZE);
+	CHECK(ArchiveReader::checkSum(*member));
+	HeaderInfo memberInfo;
+	HeaderCodec::decode(*member, memberInfo);
+	/* base-256 in the block for readers without pax */
+	CHECK((uint8_t)member->size[0] == 0x80);
+	CHECK(memberInfo.size == size);
+
+	memberInfo.size = 0;
+	CHECK(pax.apply(memberInfo));
+	CHECK(memberInfo.size == size);
+	CHECK(memberInfo.name == "big");
+}
+
+int
+main()
+{
+	checkTimeValue();
+	checkRecords();
+	checkRoundTrip(false);
+	checkRoundTrip(true);
+	checkBigSize();
+
+	return checkResult("PaxTest");
+}
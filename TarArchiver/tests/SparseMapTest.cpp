@@ -0,0 +1,147 @@
+#include "Check.h"
+#include "Packer/TarPacker.h"
+#include "Sparse/SparseMap.h"
+
+/*
+	Sparse map in GNU format 1.0 and a sparse file packed and unpacked with it.
+	Holes are checked only where the file system reports them.
+
+	SparseMapTest <work directory>
+*/
+
+static void
+checkMap()
+{
+	const std::vector<SparseExtent> extents = { { 0, 4096 }, { 1 << 20, 512 }, { (uint64_t)10 << 30, 0 } };
+	std::string map;
+	SparseMap::encode(extents, map);
+	const std::string_view lines = "3\n0\n4096\n1048576\n512\n10737418240\n";
+	CHECK(map.compare(0, lines.size(), lines) == 0);
+	CHECK(map.size() == BLOCK_SIZE);
+
+	std::vector<SparseExtent> decoded;
+	size_t mapSize = 0;
+	CHECK(SparseMap::decode(map, decoded, mapSize));
+	CHECK(mapSize == BLOCK_SIZE);
+	CHECK(decoded.size() == extents.size());
+	for (size_t i = 0; i < decoded.size() && i < extents.size(); ++i)
+	{
+		CHECK(decoded[i].offset == extents[i].offset && decoded[i].size == extents[i].size);
+	}
+	CHECK(SparseMap::dataSize(decoded) == 4608);
+
+	/* map cut anywhere is not whole yet */
+	for (size_t length = 0; length < lines.size(); ++length)
+	{
+		CHECK(!SparseMap::decode(lines.substr(0, length), decoded, mapSize));
+	}
+	CHECK(!SparseMap::decode("2\n0\nx\n", decoded, mapSize));
+
+	/* a map over one block takes two */
+	std::vector<SparseExtent> many;
+	for (uint64_t i = 0; i < 100; ++i)
+	{
+		many.push_back({ i << 20, 4096 });
+	}
+	SparseMap::encode(many, map);
+	CHECK(map.size() % BLOCK_SIZE == 0 && map.size() > BLOCK_SIZE);
+	CHECK(SparseMap::decode(map, decoded, mapSize));
+	CHECK(mapSize == map.size() && decoded.size() == 100);
+
+	std::string name;
+	SparseMap::memberName(name, "dir/sub/file", "GNUSparseFile.0");
+	CHECK(name == "dir/sub/GNUSparseFile.0/file");
+	SparseMap::memberName(name, "file", "GNUSparseFile.0");
+	CHECK(name == "GNUSparseFile.0/file");
+}
+
+/* file of size with data at the given offsets */
+static bool
+writeSparse(const std::string & path, uint64_t size, const std::vector<uint64_t> & offsets)
+{
+	int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1)
+	{
+		return false;
+	}
+
+	bool written = ftruncate(fd, size) == 0;
+	for (uint64_t offset : offsets)
+	{
+		const std::string data(4096, (char)('a' + offset % 26));
+		written = written && pwrite(fd, data.data(), data.size(), offset) == (ssize_t)data.size();
+	}
+	return close(fd) == 0 && written;
+}
+
+static void
+checkRoundTrip()
+{
+	const uint64_t size = 64 << 20;
+	CHECK(mkdir("tree", 0755) == 0);
+	/* data in the middle, the file ends with a hole */
+	CHECK(writeSparse("tree/holes", size, { 1 << 20, 8 << 20 }));
+	/* data at both ends */
+	CHECK(writeSparse("tree/ends", size, { 0, size - 4096 }));
+
+	int fd = open("tree/holes", O_RDONLY);
+	std::vector<SparseExtent> extents;
+	const bool holes = fd != -1 && SparseMap::scan(fd, size, extents);
+	if (fd != -1)
+	{
+		close(fd);
+	}
+	if (holes)
+	{
+		/* file systems may give bigger extents than written, never less */
+		CHECK(extents.size() >= 2);
+		CHECK(extents.back().offset == size && extents.back().size == 0);
+		CHECK(SparseMap::dataSize(extents) >= 8192 && SparseMap::dataSize(extents) < size);
+	}
+	else
+	{
+		printf("no holes reported here, only content is checked\n");
+	}
+
+	TarPacker packer;
+	packer.setSparse(true);
+	CHECK(packer.pack("tree"));
+
+	struct stat s;
+	CHECK(stat("tree.tar", &s) == 0);
+	if (holes)
+	{
+		CHECK((uint64_t)s.st_size < size);
+	}
+
+	CHECK(mkdir("out", 0755) == 0);
+	CHECK(rename("tree.tar", "out/tree.tar") == 0);
+	TarUnpacker unpacker;
+	CHECK(unpacker.unpack("out/tree.tar"));
+
+	for (const char * name : { "holes", "ends" })
+	{
+		const std::string source = checkRead(std::string("tree/") + name);
+		const std::string result = checkRead(std::string("out/tree/") + name);
+		CHECK(source.size() == size);
+		CHECK(result == source);
+	}
+	if (holes)
+	{
+		CHECK(stat("out/tree/holes", &s) == 0 && (uint64_t)s.st_blocks * 512 < size);
+	}
+}
+
+int
+main(int argc, char ** argv)
+{
+	if (argc != 2 || !checkWorkDir(argv[1]))
+	{
+		return 1;
+	}
+
+	checkMap();
+	checkRoundTrip();
+
+	return checkResult("SparseMapTest");
+}
@@ -0,0 +1,48 @@
+#!/bin/sh
+# Archive grown by -u and -r holds its directories more than once, every copy
+# must extract over the one before it, serially and with --threads.
+#
+#   update_roundtrip.sh <TarArchiver> <work directory>
+set -e
+
+tar="$1"
+work="$2"
+
+rm -rf "$work"
+mkdir -p "$work/tree/sub/deeper"
+cd "$work"
+echo one > tree/a
+echo two > tree/sub/b
+echo three > tree/sub/deeper/c
+touch -d '2020-01-01' tree/a tree/sub/b tree/sub/deeper/c
+
+"$tar" -c tree
+
+# a new file changes the mtime of its directory, -u takes both again
+echo four > tree/sub/d
+"$tar" -u tree
+# -r takes everything again
+echo five > tree/e
+"$tar" -r tree
+
+for mode in serial threads; do
+	mkdir "$mode"
+	cp tree.tar "$mode/"
+	if [ "$mode" = threads ]; then
+		"$tar" -x "$mode/tree.tar" --threads 4 > /dev/null
+	else
+		"$tar" -x "$mode/tree.tar" > /dev/null
+	fi
+	diff -r tree "$mode/tree"
+
+	# and once more over what is there
+	rm "$mode/tree/sub/d"
+	if [ "$mode" = threads ]; then
+		"$tar" -x "$mode/tree.tar" --threads 4 > /dev/null
+	else
+		"$tar" -x "$mode/tree.tar" > /dev/null
+	fi
+	diff -r tree "$mode/tree"
+done
+
+echo "update round trip ok"